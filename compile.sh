@@ -4,7 +4,7 @@ exit_code=0;
 
 if [ $# -ne 0 ] && [ "$1" == "clean" ]
 then
-    rm -rf run/*.exe bin/*.o bin/*.a bin/*.d *.exe *.out
+    rm -rf run/*.exe bin/*.o bin/*.a bin/*.d bin/*.so bin/*.rootmap bin/*.pcm bin/stat_dict.cxx *.exe *.out
     ./run/remove_backups.sh
     exit_code=$?
 else
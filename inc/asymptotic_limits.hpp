@@ -0,0 +1,45 @@
+#ifndef H_ASYMPTOTIC_LIMITS
+#define H_ASYMPTOTIC_LIMITS
+
+#include <cstddef>
+#include <string>
+#include <functional>
+
+#include "compact_model.hpp"
+#include "compact_fitter.hpp"
+
+//CLs upper limits on the signal strength from the asymptotic distribution of the
+//q~_mu test statistic, as combine -M Asymptotic computes them. The expected limits
+//use the Asimov data set built from the background-only fit to the observed data
+class AsymptoticLimits{
+public:
+  AsymptoticLimits(const CompactModel &model,
+                   const std::string &pdf_name = "model_s",
+                   const std::string &poi_name = "r");
+
+  double GetConfidenceLevel() const;
+  AsymptoticLimits & SetConfidenceLevel(double confidence_level);
+  double GetTolerance() const;
+  AsymptoticLimits & SetTolerance(double tolerance);
+
+  double ObservedLimit();
+  double ExpectedLimit(double num_sigma);
+  double CLs(double mu);
+
+  static double NormalCDF(double x);
+  static double NormalQuantile(double p);
+
+private:
+  CompactFitter data_fitter_, asimov_fitter_;
+  std::string pdf_name_, poi_name_;
+  double confidence_level_, tolerance_;
+  bool is_setup_;
+  double mu_hat_, data_nll_hat_, asimov_nll_hat_, sigma_;
+
+  void Setup();
+  double TestStatistic(CompactFitter &fitter, double nll_hat, double mu_hat, double mu);
+  double AsimovTestStatistic(double mu);
+  double FindRoot(const std::function<double(double)> &f, double guess) const;
+};
+
+#endif
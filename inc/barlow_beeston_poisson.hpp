@@ -0,0 +1,35 @@
+#ifndef H_BARLOW_BEESTON_POISSON
+#define H_BARLOW_BEESTON_POISSON
+
+#include "RooAbsPdf.h"
+#include "RooArgSet.h"
+#include "RooRealProxy.h"
+
+//Poisson term for n observed given mu expected, with the MC statistical uncertainty
+//(relative uncertainty rel_unc on mu) profiled in closed form, Barlow-Beeston lite style.
+//The scale beta of mu maximizing Poisson(n|beta*mu)*Gaus(beta|1,rel_unc) is the positive
+//root of beta^2+(mu*rel_unc^2-1)*beta-n*rel_unc^2 = 0, so it never becomes a fit parameter
+class BarlowBeestonPoisson : public RooAbsPdf{
+public:
+  BarlowBeestonPoisson();
+  BarlowBeestonPoisson(const char *name, const char *title,
+                       RooAbsReal &n, RooAbsReal &mu, RooAbsReal &rel_unc);
+  BarlowBeestonPoisson(const BarlowBeestonPoisson &other, const char *name = nullptr);
+  virtual ~BarlowBeestonPoisson();
+
+  virtual TObject * clone(const char *new_name) const;
+
+  virtual Int_t getAnalyticalIntegral(RooArgSet &all_vars, RooArgSet &anal_vars,
+                                      const char *range_name = nullptr) const;
+  virtual Double_t analyticalIntegral(Int_t code, const char *range_name = nullptr) const;
+
+protected:
+  RooRealProxy n_, mu_, rel_unc_;
+
+  virtual Double_t evaluate() const;
+
+private:
+  ClassDef(BarlowBeestonPoisson, 1)
+};
+
+#endif
@@ -0,0 +1,17 @@
+#ifndef H_BARLOW_BEESTON_SCALE
+#define H_BARLOW_BEESTON_SCALE
+
+#include <cmath>
+
+//Scale beta of the expected yield mu maximizing Poisson(n|beta*mu)*Gaus(beta|1,rel_unc),
+//the positive root of beta^2+(mu*rel_unc^2-1)*beta-n*rel_unc^2 = 0. Kept free of ROOT so
+//the compact model shares it with BarlowBeestonPoisson; being header-only, it is also
+//shipped with the class code imported into the workspaces
+inline double BarlowBeestonScale(double n, double mu, double rel_unc){
+  if(rel_unc <= 0.) return 1.;
+  double var = rel_unc*rel_unc;
+  double b = 1.-mu*var;
+  return 0.5*(b+std::sqrt(b*b+4.*n*var));
+}
+
+#endif
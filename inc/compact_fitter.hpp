@@ -0,0 +1,64 @@
+#ifndef H_COMPACT_FITTER
+#define H_COMPACT_FITTER
+
+#include <cstddef>
+#include <string>
+#include <vector>
+#include <set>
+
+#include "compact_model.hpp"
+
+//Minimizes the NLL of a compact model with a damped Newton method. Only the gradient is
+//exact, propagated forward through the node list; no exact second derivatives are
+//computed. The steps use the Gauss-Newton (Fisher) approximation of the Hessian, which
+//drops the curvature of the expected yields and is only exact where they are linear in
+//the parameters. The covariance inverts central differences of the analytic gradient at
+//the minimum (steps h = 1e-4*max(|x|, 1), one-sided at range edges), so the errors carry
+//that O(h^2) differencing error, falling back to the Gauss-Newton matrix if it is singular
+class CompactFitter{
+public:
+  struct Result{
+    double nll, edm;
+    std::size_t iterations, nll_calls;
+    bool converged;
+    std::vector<std::string> names;
+    std::vector<double> values, errors;
+    std::vector<std::vector<double> > covariance;
+  };
+
+  CompactFitter(const CompactModel &model, const std::string &pdf_name);
+
+  const CompactModel & GetModel() const;
+  CompactModel & GetModel();
+
+  CompactFitter & Fix(const std::string &name);
+  CompactFitter & Fix(const std::string &name, double value);
+  CompactFitter & Release(const std::string &name);
+  const std::vector<std::size_t> & Parameters() const;
+
+  double GetTolerance() const;
+  CompactFitter & SetTolerance(double tolerance);
+  std::size_t GetMaxIterations() const;
+  CompactFitter & SetMaxIterations(std::size_t max_iterations);
+
+  double NLL() const;
+  double Gradient(std::vector<double> &gradient,
+                  std::vector<std::vector<double> > *hessian = nullptr) const;
+  Result Minimize();
+
+private:
+  CompactModel model_;
+  std::size_t pdf_;
+  std::vector<bool> used_;
+  std::set<std::size_t> fixed_;
+  std::vector<std::size_t> params_;
+  double tolerance_;
+  std::size_t max_iterations_;
+
+  void FindParameters();
+  std::vector<double> GetValues() const;
+  void SetValues(const std::vector<double> &values);
+  std::vector<std::vector<double> > NumericHessian(std::size_t &nll_calls);
+};
+
+#endif
@@ -0,0 +1,73 @@
+#ifndef H_COMPACT_MODEL
+#define H_COMPACT_MODEL
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <map>
+
+//Flat description of a workspace model: its nodes in dependency order, each with its
+//type, constant parameter and the indices of the nodes it depends on. The likelihood is
+//evaluated with one pass over the nodes, without building a RooFit graph
+class CompactModel{
+public:
+  enum class NodeType : std::uint32_t{variable, product, sum, ratio, exp_product, sqrt,
+      poisson, gaussian, barlow_beeston, pdf_product, unsupported};
+
+  enum Flag : std::uint32_t{floating = 1, poi = 2, nuisance = 4, observable = 8, global_observable = 16};
+
+  //For variables, value, min and max are the variable's. Otherwise value holds the
+  //node's constant: the offset of a sum, the number of numerators of a ratio, or the
+  //width of a Gaussian with only two servers
+  struct Node{
+    NodeType type;
+    std::uint32_t flags;
+    std::uint64_t first_server, num_servers;
+    double value, min, max;
+  };
+
+  CompactModel();
+  explicit CompactModel(const std::string &file_name);
+
+  void Write(const std::string &file_name) const;
+
+  std::size_t AddNode(const std::string &name, NodeType type, std::uint32_t flags,
+                      const std::vector<std::string> &servers,
+                      double value = 0., double min = 0., double max = 0.);
+
+  std::size_t NumNodes() const;
+  const Node & GetNode(std::size_t inode) const;
+  const std::string & Name(std::size_t inode) const;
+  bool HasNode(const std::string &name) const;
+  std::size_t Index(const std::string &name) const;
+  const std::uint64_t * Servers(std::size_t inode) const;
+
+  std::vector<std::size_t> Variables(std::uint32_t flags) const;
+
+  double Value(std::size_t inode) const;
+  void SetValue(std::size_t inode, double value);
+  void SetValue(const std::string &name, double value);
+  void SetRange(std::size_t inode, double min, double max);
+  void SetToExpectation(std::size_t pdf);
+
+  void Evaluate(std::vector<double> &values) const;
+  double NLL(std::size_t pdf) const;
+  double NLL(const std::string &pdf_name) const;
+
+  static const std::uint64_t version_ = 1;
+
+private:
+  std::vector<Node> nodes_;
+  std::vector<std::string> names_;
+  std::vector<std::uint64_t> servers_;
+  std::vector<double> log_factorials_;
+  std::map<std::string, std::size_t> index_;
+
+  static const char magic_[8];
+
+  void EvaluateNode(std::size_t inode, std::vector<double> &values) const;
+  double LogFactorial(std::size_t inode, const std::vector<double> &values) const;
+};
+
+#endif
@@ -0,0 +1,9 @@
+#ifndef H_COMPILE_SYSTEMATICS
+#define H_COMPILE_SYSTEMATICS
+
+#include <string>
+
+bool GetMasses(const std::string &file_name, int &mglu, int &mlsp);
+void GetOptions(int argc, char *argv[]);
+
+#endif
@@ -0,0 +1,117 @@
+#ifndef H_COMPILED_CUTS
+#define H_COMPILED_CUTS
+
+#include <cstddef>
+#include <string>
+#include <vector>
+#include <map>
+#include <tuple>
+#include <utility>
+
+#include "cut.hpp"
+#include "cut_expression.hpp"
+
+class CompiledCuts{
+public:
+  explicit CompiledCuts(const std::vector<Cut> &cuts);
+
+  const std::vector<std::string> & Variables() const;
+  std::size_t NumCuts() const;
+  std::size_t NumInstructions() const;
+  std::size_t NumClassifiedCuts() const;
+
+  void AddSums(const std::vector<const double *> &columns,
+               std::size_t num_rows,
+               std::vector<double> &sumw,
+               std::vector<double> &sumw2) const;
+
+  static const std::size_t batch_size_ = 4096;
+
+private:
+  enum class Type{real, boolean};
+
+  struct Instruction{
+    CutExpression::Op op;
+    Type type;
+    double value;
+    std::size_t ivar, left, right;
+  };
+
+  using InstructionKey = std::tuple<int, double, std::size_t, std::size_t, std::size_t>;
+
+  //A bound is passed by x when x > value (strict) or x >= value (not strict)
+  struct Threshold{
+    double value;
+    bool strict;
+    bool operator<(const Threshold &t) const;
+    bool operator==(const Threshold &t) const;
+    bool PassedBy(double x) const;
+  };
+
+  struct Interval{
+    bool has_lower, has_upper;
+    Threshold lower, upper;
+    bool operator==(const Interval &i) const;
+    bool operator<(const Interval &i) const;
+    bool Contains(double x) const;
+  };
+
+  using Box = std::map<std::size_t, Interval>;
+
+  struct TreeNode{
+    std::size_t ivar;
+    Threshold threshold;
+    std::size_t pass, fail;
+    std::vector<std::size_t> boxes;
+  };
+
+  //Cuts that share everything but their threshold boxes, e.g. the bins of a binning; a
+  //decision tree over the box edges leaves only a few candidate boxes per event
+  struct Classifier{
+    std::size_t weight;
+    std::vector<Box> boxes;
+    std::vector<std::vector<std::size_t> > cuts;
+    std::vector<TreeNode> tree;
+  };
+
+  std::size_t num_cuts_;
+  std::vector<std::string> variables_;
+  std::vector<Instruction> program_;
+  std::vector<std::pair<std::size_t, std::size_t> > outputs_;
+  std::vector<Classifier> classifiers_;
+  std::map<InstructionKey, std::size_t> instruction_ids_;
+
+  std::size_t Compile(const CutExpression::Node &node,
+                      const std::vector<std::string> &expression_variables);
+  std::size_t AddOperation(CutExpression::Op op, std::size_t left, std::size_t right);
+  std::size_t AddConstant(double value);
+  std::size_t AddInstruction(const Instruction &instruction);
+  std::size_t VariableIndex(const std::string &name);
+
+  std::size_t Factorize(const CutExpression::Node &node,
+                        const std::vector<std::string> &expression_variables,
+                        Box &box);
+  void Factorize(const CutExpression::Node &node,
+                 const std::vector<std::string> &expression_variables,
+                 bool conjunction,
+                 std::vector<std::size_t> &factors,
+                 Box &box);
+  bool AddConstraint(const CutExpression::Node &node,
+                     const std::vector<std::string> &expression_variables,
+                     Box &box);
+  std::size_t BuildTree(Classifier &classifier, const std::vector<std::size_t> &boxes) const;
+  const std::vector<std::size_t> & Classify(const Classifier &classifier,
+                                            const std::vector<const double *> &columns,
+                                            std::size_t row) const;
+
+  static bool ConstantValue(const CutExpression::Node &node, double &value);
+  static bool Inside(const Box &box,
+                     const std::vector<const double *> &columns,
+                     std::size_t row);
+
+  static void Execute(const Instruction &instruction,
+                      const double *left, const double *right,
+                      double *out, std::size_t num_rows);
+};
+
+#endif
@@ -0,0 +1,53 @@
+#ifndef H_CUT_EXPRESSION
+#define H_CUT_EXPRESSION
+
+#include <cstddef>
+#include <string>
+#include <vector>
+#include <memory>
+
+#include "cut.hpp"
+
+class CutExpression{
+public:
+  enum class Op{constant, variable,
+      negate, logical_not,
+      add, subtract, multiply, divide,
+      less, less_equal, greater, greater_equal, equal, not_equal,
+      logical_and, logical_or};
+
+  struct Node{
+    Op op;
+    double value;
+    std::size_t ivar;
+    std::shared_ptr<const Node> left, right;
+  };
+  using NodePtr = std::shared_ptr<const Node>;
+
+  explicit CutExpression(const Cut &cut);
+
+  const std::vector<std::string> & Variables() const;
+  const NodePtr & Root() const;
+
+private:
+  std::string cut_;
+  std::size_t pos_;
+  std::vector<std::string> variables_;
+  NodePtr root_;
+
+  NodePtr ParseOr();
+  NodePtr ParseAnd();
+  NodePtr ParseEquality();
+  NodePtr ParseRelational();
+  NodePtr ParseSum();
+  NodePtr ParseProduct();
+  NodePtr ParseUnary();
+  NodePtr ParsePrimary();
+
+  bool Accept(const std::string &token);
+  std::size_t VariableIndex(const std::string &name);
+
+  static NodePtr MakeNode(Op op, const NodePtr &left = NodePtr(), const NodePtr &right = NodePtr());
+};
+
+#endif
@@ -0,0 +1,41 @@
+#ifndef H_ERROR_PROPAGATOR
+#define H_ERROR_PROPAGATOR
+
+#include <cstddef>
+#include <string>
+#include <vector>
+#include <map>
+#include <utility>
+
+#include "RooWorkspace.h"
+#include "RooFitResult.h"
+#include "RooAbsArg.h"
+
+//Linear propagation of the uncertainties of a fit to many workspace functions at once.
+//Each floating parameter of the fit is moved to the ends of its error bar once, every
+//requested function is evaluated there, and each error is then sqrt(J.rho.J^T) for that
+//function's row J of the Jacobian of one-sigma shifts and the fit's correlation matrix rho
+class ErrorPropagator{
+public:
+  ErrorPropagator(RooWorkspace &w, const RooFitResult &f);
+  ErrorPropagator(RooWorkspace &w, const RooFitResult &f,
+                  const std::vector<std::string> &names);
+
+  double GetError(const std::string &name) const;
+  double GetError(const RooAbsArg &arg) const;
+  double GetCovariance(const std::string &name_a, const std::string &name_b) const;
+
+private:
+  std::map<std::string, std::size_t> index_;
+  std::vector<std::vector<std::pair<std::size_t, double> > > shifts_;
+  std::vector<std::vector<double> > correlation_;
+  std::vector<double> errors_;
+
+  std::size_t Index(const std::string &name) const;
+  double Covariance(std::size_t ifunc_a, std::size_t ifunc_b) const;
+
+  void Propagate(RooWorkspace &w, const RooFitResult &f,
+                 const std::vector<std::string> &names);
+};
+
+#endif
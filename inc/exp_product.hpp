@@ -0,0 +1,28 @@
+#ifndef H_EXP_PRODUCT
+#define H_EXP_PRODUCT
+
+#include "RooAbsReal.h"
+#include "RooArgList.h"
+#include "RooListProxy.h"
+
+//Compiled replacement for exp(@0*@1), the log-normal factor of a systematic with a
+//given strength
+class ExpProduct : public RooAbsReal{
+public:
+  ExpProduct();
+  ExpProduct(const char *name, const char *title, const RooArgList &factors);
+  ExpProduct(const ExpProduct &other, const char *name = nullptr);
+  virtual ~ExpProduct();
+
+  virtual TObject * clone(const char *new_name) const;
+
+protected:
+  RooListProxy factors_;
+
+  virtual Double_t evaluate() const;
+
+private:
+  ClassDef(ExpProduct, 1)
+};
+
+#endif
@@ -12,6 +12,8 @@
 #include "RooFitResult.h"
 #include "RooMinuit.h"
 
+#include "error_propagator.hpp"
+
 void GetOptionsExtract(int argc, char *argv[]);
 
 void RunFit(const std::string &path);
@@ -34,26 +36,26 @@ double GetMCYield(const RooWorkspace &w,
 
 double GetMCTotal(const RooWorkspace &w,
                   const std::string &bin_name);
-double GetMCTotalErr(RooWorkspace &w,
-                     const RooFitResult &f,
+double GetMCTotalErr(const RooWorkspace &w,
+                     const ErrorPropagator &errors,
                      const std::string &bin_name);
 
 double GetBkgPred(const RooWorkspace &w,
                   const std::string &bin_name);
-double GetBkgPredErr(RooWorkspace &w,
-                     const RooFitResult &f,
+double GetBkgPredErr(const RooWorkspace &w,
+                     const ErrorPropagator &errors,
                      const std::string &bin_name);
 
 double GetSigPred(const RooWorkspace &w,
                   const std::string &bin_name);
-double GetSigPredErr(RooWorkspace &w,
-                     const RooFitResult &f,
+double GetSigPredErr(const RooWorkspace &w,
+                     const ErrorPropagator &errors,
                      const std::string &bin_name);
 
 double GetTotPred(const RooWorkspace &w,
                   const std::string &bin_name);
-double GetTotPredErr(RooWorkspace &w,
-                     const RooFitResult &f,
+double GetTotPredErr(const RooWorkspace &w,
+                     const ErrorPropagator &errors,
                      const std::string &bin_name);
 
 double GetObserved(const RooWorkspace &w,
@@ -61,20 +63,20 @@ double GetObserved(const RooWorkspace &w,
 
 double GetKappaNoSys(const RooWorkspace &w,
 		     const std::string &bin_name);
-double GetKappaNoSysErr(RooWorkspace &w,
-		   const RooFitResult &f,
+double GetKappaNoSysErr(const RooWorkspace &w,
+		   const ErrorPropagator &errors,
 		   const std::string &bin_name);
 
 double GetKappaSys(const RooWorkspace &w,
 		   const std::string &bin_name);
-double GetKappaSysErr(RooWorkspace &w,
-		      const RooFitResult &f,
+double GetKappaSysErr(const RooWorkspace &w,
+		      const ErrorPropagator &errors,
 		      const std::string &bin_name);
 
 double GetLambda(const RooWorkspace &w,
                  const std::string &bin_name);
-double GetLambdaErr(RooWorkspace &w,
-                    const RooFitResult &f,
+double GetLambdaErr(const RooWorkspace &w,
+                    const ErrorPropagator &errors,
                     const std::string &bin_name);
 
 RooRealVar * SetVariables(RooWorkspace &w,
@@ -140,7 +142,4 @@ void MakeCovarianceMatrix(RooWorkspace &w,
 
 std::string PrettyBinName(std::string name);
 
-double GetError(const RooAbsReal &var,
-                const RooFitResult &f);
-
 #endif
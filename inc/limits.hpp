@@ -0,0 +1,6 @@
+#ifndef H_LIMITS
+#define H_LIMITS
+
+void GetOptions(int argc, char *argv[]);
+
+#endif
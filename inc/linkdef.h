@@ -0,0 +1,12 @@
+#ifdef __CLING__
+
+#pragma link off all globals;
+#pragma link off all classes;
+#pragma link off all functions;
+
+#pragma link C++ class ProductRatio+;
+#pragma link C++ class SqrtFunction+;
+#pragma link C++ class ExpProduct+;
+#pragma link C++ class BarlowBeestonPoisson+;
+
+#endif
@@ -0,0 +1,29 @@
+#ifndef H_NLL_KERNEL
+#define H_NLL_KERNEL
+
+#include <cstddef>
+
+//Negative log-likelihood sums over bins stored as separate arrays. The AVX2 path is
+//picked at run time when the CPU supports it; the scalar path gives the same terms
+class NLLKernel{
+public:
+  static double Poisson(const double *n, const double *log_factorial_n, const double *mu,
+                        std::size_t size);
+  static double Gaussian(const double *x, const double *mean, const double *sigma,
+                         std::size_t size);
+
+  static double PoissonScalar(const double *n, const double *log_factorial_n, const double *mu,
+                              std::size_t size);
+  static double GaussianScalar(const double *x, const double *mean, const double *sigma,
+                               std::size_t size);
+
+  static double PoissonTerm(double n, double log_factorial_n, double mu);
+  static double GaussianTerm(double x, double mean, double sigma);
+
+  static bool HasAVX2();
+
+private:
+  NLLKernel() = delete;
+};
+
+#endif
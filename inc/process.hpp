@@ -3,6 +3,7 @@
 
 #include <string>
 #include <set>
+#include <vector>
 #include <initializer_list>
 #include <tuple>
 #include <memory>
@@ -52,6 +53,16 @@ public:
 
   long GetEntries() const;
   GammaParams GetYield(const class Cut &cut = ::Cut("1")) const;
+  std::vector<GammaParams> GetYields(const std::vector<class Cut> &cuts) const;
+  std::vector<std::string> ChainFiles() const;
+  void GetSumsOfWeights(const std::string &chain_file,
+                        const std::vector<class Cut> &cuts,
+                        std::vector<double> &sumw,
+                        std::vector<double> &sumw2) const;
+  void GetColumns(const std::string &chain_file,
+                  const class Cut &selection,
+                  const std::vector<std::string> &expressions,
+                  std::vector<std::vector<double> > &columns) const;
 
   const SystCollection & Systematics() const;
   Process & Systematics(const SystCollection &systematics);
@@ -0,0 +1,63 @@
+#ifndef H_PROCESS_POOL
+#define H_PROCESS_POOL
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include <string>
+#include <functional>
+
+#include <signal.h>
+#include <sys/types.h>
+
+//Runs tasks in forked worker processes. The workers are forked when the pool is built and
+//share everything loaded before then copy-on-write, so objects that are not thread-safe
+//(RooFit workspaces and minimizers) can be used in parallel. Each worker keeps its own
+//copy of any state the tasks change. Build the pool before starting threads: a forked
+//worker only has the thread that built the pool
+class ProcessPool{
+public:
+  struct Task{
+    std::uint64_t index;
+    std::vector<double> values;
+  };
+  typedef std::function<std::vector<double>(const Task &task)> Worker;
+
+  explicit ProcessPool(const Worker &worker);
+  ProcessPool(const Worker &worker, std::size_t num_workers);
+  ~ProcessPool();
+
+  std::size_t Size() const;
+  std::vector<std::vector<double> > Run(const std::vector<Task> &tasks);
+
+private:
+  ProcessPool(const ProcessPool &) = delete;
+  ProcessPool& operator=(const ProcessPool &) = delete;
+  ProcessPool(ProcessPool &&) = delete;
+  ProcessPool& operator=(ProcessPool &&) = delete;
+
+  //Every message is a header followed by size doubles, or size characters of an error message
+  struct Header{
+    std::uint64_t id, tag, size;
+  };
+  enum Status: std::uint64_t{ok = 0, failed = 1};
+
+  struct Process{
+    pid_t pid;
+    int task_fd, result_fd;
+    bool busy;
+  };
+
+  std::vector<Process> workers_;
+  struct sigaction old_sigpipe_;
+  bool sigpipe_ignored_;
+
+  void Fork(const Worker &worker, std::size_t num_workers);
+  void Send(Process &process, std::uint64_t id, const Task &task);
+  void Stop(bool kill_workers);
+  [[noreturn]] static void Serve(const Worker &worker, int task_fd, int result_fd);
+  static bool Write(int fd, const void *data, std::size_t size);
+  static bool Read(int fd, void *data, std::size_t size);
+};
+
+#endif
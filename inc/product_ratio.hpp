@@ -0,0 +1,29 @@
+#ifndef H_PRODUCT_RATIO
+#define H_PRODUCT_RATIO
+
+#include "RooAbsReal.h"
+#include "RooArgList.h"
+#include "RooListProxy.h"
+
+//Compiled replacement for formulas like (@0*@1)/(@2*@3): the product of the numerators
+//divided by the product of the denominators
+class ProductRatio : public RooAbsReal{
+public:
+  ProductRatio();
+  ProductRatio(const char *name, const char *title,
+               const RooArgList &numerators, const RooArgList &denominators);
+  ProductRatio(const ProductRatio &other, const char *name = nullptr);
+  virtual ~ProductRatio();
+
+  virtual TObject * clone(const char *new_name) const;
+
+protected:
+  RooListProxy numerators_, denominators_;
+
+  virtual Double_t evaluate() const;
+
+private:
+  ClassDef(ProductRatio, 1)
+};
+
+#endif
@@ -0,0 +1,33 @@
+#ifndef H_PROFILE_SIGNIFICANCE
+#define H_PROFILE_SIGNIFICANCE
+
+#include <string>
+
+#include "compact_model.hpp"
+#include "compact_fitter.hpp"
+
+//Discovery significance sqrt(q_0) from the profile likelihood ratio, signed by the best
+//fit signal strength, as combine -M ProfileLikelihood --significance --uncapped computes it
+class ProfileSignificance{
+public:
+  ProfileSignificance(const CompactModel &model,
+                      const std::string &pdf_name = "model_s",
+                      const std::string &poi_name = "r");
+
+  double GetPOIMin() const;
+  ProfileSignificance & SetPOIMin(double poi_min);
+
+  double Observed() const;
+  double Expected(double mu = 1., bool postfit = false) const;
+
+  static double Significance(CompactFitter &fitter, const std::string &poi_name);
+
+private:
+  CompactModel model_;
+  std::string pdf_name_, poi_name_;
+  double poi_min_;
+
+  CompactModel UncappedModel() const;
+};
+
+#endif
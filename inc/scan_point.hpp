@@ -3,6 +3,9 @@
 
 #include <string>
 
+void ReadCombineLimits(const std::string &workdir,
+                       double &obs, double &obs_up, double &obs_down,
+                       double &exp, double &exp_up, double &exp_down);
 double GetSignif(const std::string &filename);
 std::string GetBaseName(const std::string &path);
 double ExtractNumber(const std::string &results, const std::string &key);
@@ -1,17 +1,15 @@
 #ifndef H_SIG_INJ
 #define H_SIG_INJ
 
+#include <cstdint>
 #include <vector>
 #include <string>
-#include <utility>
 
-#include "RooAbsReal.h"
-#include "RooFitResult.h"
+#include "thread_pool.hpp"
 
 void InjectSignal(const std::string id_string, double inject, std::size_t index);
-std::pair<double,double> ExtractSignal(const std::string id_string, std::size_t index, std::size_t toy, bool is_nc);
-double GetAsymError(const RooRealVar &var, double &ehi, double &elo);
-double GetError(const RooAbsReal &var, const RooFitResult &f);
+void ExtractSignal(const std::string id_string, std::size_t index, bool is_nc, std::uint64_t seed,
+                   ThreadPool &thread_pool, std::vector<double> &yvals, std::vector<double> &pulls);
 void GetOptions(int argc, char *argv[]);
 void GetStats(const std::vector<double> &vals,
               double &mean, double &median,
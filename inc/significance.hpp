@@ -0,0 +1,6 @@
+#ifndef H_SIGNIFICANCE
+#define H_SIGNIFICANCE
+
+void GetOptions(int argc, char *argv[]);
+
+#endif
@@ -0,0 +1,38 @@
+#ifndef H_SKIM_FILE
+#define H_SKIM_FILE
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+class SkimFile{
+public:
+  explicit SkimFile(const std::string &file_name);
+  ~SkimFile();
+
+  static void Write(const std::string &file_name,
+                    const std::vector<std::string> &names,
+                    const std::vector<std::vector<double> > &columns);
+
+  std::size_t NumEntries() const;
+  const std::vector<std::string> & Names() const;
+
+  bool HasColumn(const std::string &name) const;
+  const double * Column(const std::string &name) const;
+
+private:
+  SkimFile(const SkimFile &) = delete;
+  SkimFile& operator=(const SkimFile &) = delete;
+
+  std::string file_name_;
+  void *data_;
+  std::size_t size_;
+  std::uint64_t num_entries_;
+  std::vector<std::string> names_;
+  const double *columns_;
+
+  static const char magic_[8];
+};
+
+#endif
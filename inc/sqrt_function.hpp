@@ -0,0 +1,26 @@
+#ifndef H_SQRT_FUNCTION
+#define H_SQRT_FUNCTION
+
+#include "RooAbsReal.h"
+#include "RooRealProxy.h"
+
+//Compiled replacement for sqrt(@0), used as the width of Gaussian-approximated Poissons
+class SqrtFunction : public RooAbsReal{
+public:
+  SqrtFunction();
+  SqrtFunction(const char *name, const char *title, RooAbsReal &x);
+  SqrtFunction(const SqrtFunction &other, const char *name = nullptr);
+  virtual ~SqrtFunction();
+
+  virtual TObject * clone(const char *new_name) const;
+
+protected:
+  RooRealProxy x_;
+
+  virtual Double_t evaluate() const;
+
+private:
+  ClassDef(SqrtFunction, 1)
+};
+
+#endif
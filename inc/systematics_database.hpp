@@ -0,0 +1,62 @@
+#ifndef H_SYSTEMATICS_DATABASE
+#define H_SYSTEMATICS_DATABASE
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <map>
+#include <utility>
+
+class SystematicsDatabase{
+public:
+  //One "bin value" line of a systematics file, with the systematic and processes it applies to
+  struct Entry{
+    std::string systematic;
+    std::vector<std::string> processes;
+    std::string bin;
+    double value;
+  };
+
+  explicit SystematicsDatabase(const std::string &file_name);
+  ~SystematicsDatabase();
+
+  static std::vector<Entry> ReadTextFile(const std::string &file_name);
+  static void Write(const std::string &file_name,
+                    const std::map<std::pair<int, int>, std::vector<Entry> > &points);
+
+  std::size_t NumPoints() const;
+  bool HasPoint(int mglu, int mlsp) const;
+  std::vector<Entry> Entries(int mglu, int mlsp) const;
+
+private:
+  SystematicsDatabase(const SystematicsDatabase &) = delete;
+  SystematicsDatabase& operator=(const SystematicsDatabase &) = delete;
+
+  struct PointRecord{
+    std::int64_t mglu, mlsp;
+    std::uint64_t first, count;
+  };
+
+  struct EntryRecord{
+    std::uint64_t systematic, processes, bin;
+    double value;
+  };
+
+  std::string file_name_;
+  void *data_;
+  std::size_t size_;
+  std::vector<std::string> strings_;
+  const PointRecord *points_;
+  std::uint64_t num_points_;
+  const EntryRecord *entries_;
+  std::uint64_t num_entries_;
+
+  const PointRecord * FindPoint(int mglu, int mlsp) const;
+
+  static void CleanLine(std::string &line);
+
+  static const char magic_[8];
+};
+
+#endif
@@ -0,0 +1,55 @@
+#ifndef H_TOY_FITTER
+#define H_TOY_FITTER
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "compact_model.hpp"
+#include "compact_fitter.hpp"
+#include "thread_pool.hpp"
+
+//Maximum likelihood fits of the signal strength to Poisson toys of a compact model's
+//observed yields, as combine -M MaxLikelihoodFit --dataset data_obs_N does them. Both
+//draw the observables in ToyObservables order, so toy N for a given seed is the one
+//WorkspaceGenerator stores for that seed
+class ToyFitter{
+public:
+  struct Result{
+    double value, error_up, error_down;
+    bool converged;
+  };
+
+  ToyFitter(const CompactModel &model,
+            const std::string &pdf_name = "model_s",
+            const std::string &poi_name = "r");
+
+  std::uint64_t GetSeed() const;
+  ToyFitter & SetSeed(std::uint64_t seed);
+  double GetPreFitValue() const;
+  ToyFitter & SetPreFitValue(double pre_fit_value);
+  bool GetAsymmetricErrors() const;
+  ToyFitter & SetAsymmetricErrors(bool asymmetric_errors);
+
+  std::vector<Result> Fit(std::size_t num_toys, ThreadPool &pool) const;
+  std::vector<Result> Fit(std::size_t first_toy, std::size_t num_toys) const;
+
+  static std::vector<double> GenerateToy(std::uint64_t seed, std::uint64_t toy,
+                                         const std::vector<double> &rates);
+  static std::vector<std::string> ToyObservables(std::vector<std::string> observables);
+
+private:
+  CompactModel model_;
+  std::string pdf_name_, poi_name_;
+  std::uint64_t seed_;
+  double pre_fit_value_;
+  bool asymmetric_errors_;
+  std::vector<std::size_t> observables_;
+  std::vector<double> rates_;
+
+  void ProfileErrors(const CompactFitter &fitter, double nll_hat, Result &result) const;
+  double FindCrossing(CompactFitter &fitter, double nll_hat, double step) const;
+};
+
+#endif
@@ -3,6 +3,7 @@
 
 #include <string>
 #include <vector>
+#include <set>
 #include <stdexcept>
 #include <iostream>
 
@@ -33,6 +34,32 @@ void GetCountAndUncertainty(TTree &tree,
                             double &count,
                             double &uncertainty);
 
+void PrefetchFile(const std::string &file_name);
+
+void GetSumsOfWeights(TTree &tree,
+                      const std::vector<Cut> &cuts,
+                      std::vector<double> &sumw,
+                      std::vector<double> &sumw2);
+void GetSumsOfWeights(const std::string &chain_file,
+                      const std::vector<Cut> &cuts,
+                      std::vector<double> &sumw,
+                      std::vector<double> &sumw2);
+
+void GetCountsAndUncertainties(TTree &tree,
+                               const std::vector<Cut> &cuts,
+                               std::vector<double> &counts,
+                               std::vector<double> &uncertainties);
+
+void GetColumns(TTree &tree,
+                const Cut &selection,
+                const std::vector<std::string> &expressions,
+                std::vector<std::vector<double> > &columns);
+std::set<std::vector<double> > GetDistinctValues(TTree &tree,
+                                                 const std::vector<std::string> &expressions);
+
+std::vector<std::string> CutVariables(const std::vector<Cut> &cuts);
+void PruneBranches(TTree &tree, const std::vector<std::string> &variables);
+
 std::string execute(const std::string &cmd);
 
 std::vector<std::string> Tokenize(const std::string& input,
@@ -42,6 +69,10 @@ std::string ChangeExtension(std::string path, const std::string &new_ext);
 
 std::string MakeDir(std::string prefix);
 
+std::string HashString(const std::string &str);
+std::vector<std::string> Glob(const std::string &pattern);
+std::string FileSignature(const std::string &pattern);
+
 void parseMasses(const std::string &str, int &mglu, int &mlsp);
 
 template<typename T>
@@ -3,11 +3,18 @@
 
 #include <ostream>
 #include <set>
+#include <map>
 #include <string>
+#include <vector>
+#include <memory>
 #include <utility>
 #include <random>
+#include <cstdint>
 
 #include "RooWorkspace.h"
+#include "RooAbsReal.h"
+#include "RooRealVar.h"
+#include "RooArgList.h"
 
 #include "cut.hpp"
 #include "block.hpp"
@@ -17,6 +24,8 @@
 #include "block_yields.hpp"
 #include "yield_manager.hpp"
 #include "free_systematic.hpp"
+#include "systematics_database.hpp"
+#include "compact_model.hpp"
 
 class WorkspaceGenerator{
 public:
@@ -29,6 +38,7 @@ public:
                      const bool use_r4 = true,
                      const double sig_strength = 0.,
                      const double sig_xsec_f = 1.);
+  ~WorkspaceGenerator();
 
   enum class PrintLevel{silent, important, normal, everything};
 
@@ -52,9 +62,26 @@ public:
   double GetRMax() const;
   WorkspaceGenerator & SetRMax(double rmax);
 
+  const Process & GetSignal() const;
+  WorkspaceGenerator & SetSignal(const Process &signal);
+
+  const std::string & GetSystematicsFile() const;
+  WorkspaceGenerator & SetSystematicsFile(const std::string &systematics_file);
+  WorkspaceGenerator & SetSystematicsDatabase(const std::shared_ptr<const SystematicsDatabase> &database,
+                                              int mglu, int mlsp);
+
+  double GetSignalXSecFactor() const;
+  WorkspaceGenerator & SetSignalXSecFactor(double sig_xsec_f);
+
   bool UseGausApprox() const;
   WorkspaceGenerator & UseGausApprox(bool use_gaus_approx);
 
+  bool UseCompiledFunctions() const;
+  WorkspaceGenerator & UseCompiledFunctions(bool use_compiled_functions);
+
+  bool UseBarlowBeestonLite() const;
+  WorkspaceGenerator & UseBarlowBeestonLite(bool use_barlow_beeston_lite);
+
   GammaParams GetYield(const YieldKey &key) const;
   GammaParams GetYield(const Bin &bin,
                        const Process &process,
@@ -62,8 +89,16 @@ public:
   GammaParams GetYield(const Bin &bin,
                        const Process &process) const;
 
+  std::set<YieldKey> YieldKeys() const;
+
   size_t AddToys(size_t num_toys = 0);
 
+  std::uint64_t GetToySeed() const;
+  WorkspaceGenerator & SetToySeed(std::uint64_t toy_seed);
+
+  bool GetSplitToys() const;
+  WorkspaceGenerator & SetSplitToys(bool split_toys);
+
   const Process & GetInjectionModel() const;
   WorkspaceGenerator & SetInjectionModel(const Process &injection);
   bool GetDefaultInjectionModel() const;
@@ -78,9 +113,9 @@ private:
   Process injection_;
   bool inject_other_signal_;
   std::set<Block> blocks_;
-  std::map<std::string, double> obs_vals_;
-  std::map<std::string, std::poisson_distribution<> > obs_gens_;
   std::string systematics_file_;
+  std::shared_ptr<const SystematicsDatabase> systematics_db_;
+  std::pair<int, int> systematics_point_;
   bool use_r4_;
   double sig_strength_, sig_xsec_f_;
   double rmax_;
@@ -93,35 +128,59 @@ private:
   bool do_dilepton_;
   bool do_mc_kappa_correction_;
   size_t num_toys_;
+  std::uint64_t toy_seed_;
+  bool split_toys_;
   bool gaus_approx_;
+  bool compiled_functions_;
+  bool barlow_beeston_lite_;
   mutable bool w_is_valid_;
 
+  //Model nodes are built natively and kept here, by name, until they are imported in bulk
+  std::vector<std::unique_ptr<RooAbsReal> > nodes_;
+  std::vector<std::vector<std::string> > node_servers_;
+  std::vector<std::pair<CompactModel::NodeType, double> > node_types_;
+  std::map<std::string, RooAbsReal*> node_index_;
+  std::map<std::string, std::size_t> num_clients_;
+  std::vector<std::string> pending_servers_;
+
+  //The first template_size_ nodes form the signal-independent background and data model,
+  //which is reused when only the signal changes
+  bool template_is_valid_;
+  std::size_t template_size_;
+  std::set<FreeSystematic> template_systematics_;
+  std::set<std::string> template_glob_observables_, template_nuisances_, template_syst_names_;
+
   static YieldManager yields_;
-  static std::mt19937_64 prng_;
-  static std::poisson_distribution<> dist_;
 
-  static std::mt19937_64 InitializePRNG();
-  static int GetPoisson(double rate);
+  static std::uint64_t RandomSeed();
+  static std::string SourceDirectory();
+  static std::vector<std::vector<double> > GenerateToys(std::uint64_t seed,
+                                                        std::size_t first_toy,
+                                                        std::size_t num_toys,
+                                                        const std::vector<double> &rates);
 
-  void SetupToys(const RooArgSet &obs);
-  void GenerateToys(RooArgSet &obs);
-  void ResetToys(RooArgSet &obs);
   void UpdateWorkspace();
+  void BuildTemplate();
+  void RestoreTemplate();
+  std::set<FreeSystematic> BackgroundSystematics() const;
+  void UpdateSignalWeights();
+  void ComputeYields() const;
   void AddPOI();
   void ReadSystematicsFile();
-  static void CleanLine(std::string &line);
   void AddDileptonSystematic();
   bool NeedsDileptonBin(const Bin &bin) const;
   void MakeDileptonBin(const Bin &bin, Bin &dilep_bin, Cut &dilep_cut) const;
-  void AddSystematicsGenerators();
+  void AddBinSystematicsGenerators();
+  void AddProcessSystematicsGenerators(const std::set<Process> &processes);
   void AddSystematicGenerator(const std::string &name);
   void AddData(const Block &block);
   void AddBackgroundFractions(const Block &block);
   void AddABCDParameters(const Block &block);
   void AddRawBackgroundPredictions(const Block &block);
   void AddKappas(const Block &block);
-  void AddMCYields(const Block &block);
-  void AddMCPdfs(const Block &block);
+  void AddMCYields(const Block &block, const std::set<Process> &processes);
+  void AddMCPdfs(const Block &block, const std::set<Process> &processes);
+  void AddMCPdfProduct(const Block &block);
   void AddMCProcessSums(const Block &block);
   void AddMCRowSums(const Block &block);
   void AddMCColSums(const Block &block);
@@ -130,7 +189,10 @@ private:
   void AddMCKappa(const Block &block);
   void AddFullBackgroundPredictions(const Block &block);
   void AddSignalPredictions(const Block &block);
-  void AddPdfs(const Block &block);
+  void AddNullPdfs(const Block &block);
+  void AddAltPdfs(const Block &block);
+  double BackgroundMCUncertainty(const Block &block, std::size_t irow, std::size_t icol) const;
+  double TotalMCUncertainty(const Block &block, std::size_t irow, std::size_t icol) const;
   void AddDebug(const Block &block);
   void AddDummyNuisance();
   void AddFullPdf();
@@ -142,6 +204,27 @@ private:
 		  const std::string &n_name,
 		  const std::string &mu_name,
 		  bool allow_approx);
+
+  RooAbsReal & AddNode(RooAbsReal *node, CompactModel::NodeType type, double param = 0.);
+  RooRealVar & AddVar(const std::string &name, double value);
+  RooRealVar & AddVar(const std::string &name, double value, double min, double max);
+  RooAbsReal & AddProduct(const std::string &name, const std::vector<std::string> &factors);
+  RooAbsReal & AddSum(const std::string &name, const std::vector<std::string> &terms,
+                      double offset = 0.);
+  RooAbsReal & AddFormula(const std::string &name, const std::string &formula,
+                          const std::vector<std::string> &arguments);
+  RooAbsReal & AddRatio(const std::string &name,
+                        const std::vector<std::string> &numerators,
+                        const std::vector<std::string> &denominators);
+  RooAbsReal & AddExpProduct(const std::string &name, const std::vector<std::string> &factors);
+  RooAbsReal & AddSqrt(const std::string &name, const std::string &argument);
+  RooAbsReal & AddPdfProduct(const std::string &name, const std::vector<std::string> &pdfs);
+  RooAbsReal & Node(const std::string &name);
+  RooArgList NodeList(const std::vector<std::string> &names);
+  void ImportNodes();
+  CompactModel MakeCompactModel() const;
+  void RemoveLastNode();
+  void ClearNodes();
   void PrintComparison(std::ostream &stream, const Bin &bin,
                        const Process &process, const Block &block) const;
 };
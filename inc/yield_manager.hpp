@@ -2,12 +2,18 @@
 #define H_YIELD_MANAGER
 
 #include <map>
+#include <set>
+#include <array>
+#include <vector>
+#include <string>
+#include <cstddef>
 
 #include "yield_key.hpp"
 #include "gamma_params.hpp"
 #include "bin.hpp"
 #include "process.hpp"
 #include "cut.hpp"
+#include "thread_pool.hpp"
 
 class YieldManager{
 public:
@@ -18,17 +24,53 @@ public:
 		       const Process &process,
 		       const Cut &cut) const;
 
+  void ComputeYields(const std::set<YieldKey> &keys) const;
+
   const double & Luminosity() const;
   double & Luminosity();
 
+  static std::size_t NumThreads();
+  static void NumThreads(std::size_t num_threads);
+
+  static const std::string & SkimDir();
+  static void SkimDir(const std::string &skim_dir);
+
+  static const std::string & CacheFile();
+  static void CacheFile(const std::string &file_name);
+
 private:
   static std::map<YieldKey, GammaParams> yields_;
   static const double store_lumi_;
+  static std::string cache_file_;
+  static std::map<std::string, GammaParams> cached_yields_;
+  static std::map<std::string, GammaParams> pending_yields_;
+  static std::map<std::set<std::string>, std::string> file_signatures_;
+  static std::size_t num_threads_;
+  static std::string skim_dir_;
   double local_lumi_;
   bool verbose_;
 
   bool HaveYield(const YieldKey &key) const;
   void ComputeYield(const YieldKey &key) const;
+  void StoreYield(const YieldKey &key, const GammaParams &gps) const;
+  std::array<Cut, 5> GetCuts(const YieldKey &key) const;
+  bool ReadCachedYield(const YieldKey &key) const;
+  static std::map<std::string, GammaParams> ReadCache(const std::string &file_name);
+  static void WriteCache();
+  static std::string CacheRecord(const std::string &hash, const GammaParams &gps);
+  static bool ParseCacheRecord(const std::string &line, std::string &hash, GammaParams &gps);
+  std::string CacheHash(const YieldKey &key) const;
+  const std::string & FilesSignature(const Process &process) const;
+  std::vector<GammaParams> GetSkimmedYields(const Process &process,
+                                            const Cut &baseline,
+                                            const std::vector<Cut> &cuts,
+                                            ThreadPool &pool) const;
+
+  static std::string WeightExpression(const Process &process);
+
+  static Cut MetTruCut(const Cut &cut);
+  static GammaParams CascadeYield(const std::vector<GammaParams> &levels, bool count_zeros);
+  static GammaParams AverageMet(const GammaParams &met_gps, const GammaParams &mettru_gps);
 };
 
 #endif
@@ -0,0 +1,107 @@
+#! /usr/bin/env python
+
+from __future__ import print_function
+
+import argparse
+import os
+import tempfile
+import shutil
+import subprocess
+import sys
+
+import ROOT
+
+import utils
+
+ROOT.PyConfig.IgnoreCommandLineOptions = True
+
+run_dir = os.path.join(os.path.dirname(utils.full_path(__file__)), "..", "run")
+
+def run_in_temp_dir(command, workspace_path, result_name, log_path):
+    cwd = os.getcwd()
+    work_dir = tempfile.mkdtemp()
+    link_path = os.path.join(work_dir, os.path.basename(workspace_path))
+    os.symlink(workspace_path, link_path)
+
+    os.chdir(work_dir)
+    with open(log_path, "a") as dn:
+        subprocess.check_call(command+["-d",link_path], stdout=dn, stderr=dn)
+    os.chdir(cwd)
+
+    results = []
+    with utils.ROOTFile(os.path.join(work_dir, result_name), "read") as result:
+        for entry in result.Get("limit"):
+            results.append((entry.quantileExpected, entry.limit))
+    shutil.rmtree(work_dir)
+    return results
+
+def combine_results(workspace_path, log_path):
+    values = dict()
+    limits = run_in_temp_dir(["combine","-M","Asymptotic"],
+                             workspace_path, "higgsCombineTest.Asymptotic.mH120.root", log_path)
+    for quantile, limit in limits:
+        if quantile < 0.:
+            values["Observed limit"] = limit
+        else:
+            values["Expected limit {:g}".format(round(quantile, 3))] = limit
+
+    signif = ["combine","-M","ProfileLikelihood","--significance","--uncapped=1","--rMin=-10."]
+    values["Observed significance"] = run_in_temp_dir(signif, workspace_path,
+                                                      "higgsCombineTest.ProfileLikelihood.mH120.root", log_path)[0][1]
+    values["Expected significance"] = run_in_temp_dir(signif+["--expectSignal=1","--toysFreq","-t","-1"], workspace_path,
+                                                      "higgsCombineTest.ProfileLikelihood.mH120.root", log_path)[0][1]
+    return values
+
+def native_results(workspace_path):
+    values = dict()
+    output = subprocess.check_output([os.path.join(run_dir, "limits.exe"),"-f",workspace_path])
+    output += subprocess.check_output([os.path.join(run_dir, "significance.exe"),"-f",workspace_path,
+                                       "--r_min","-10","--expectSignal","1","--postfit"])
+    for line in output.decode("utf-8").splitlines():
+        if ":" not in line:
+            continue
+        name, value = line.rsplit(":", 1)
+        name = name.strip()
+        if name.startswith("Expected limit "):
+            name = "Expected limit {:g}".format(round(float(name.split()[-1]), 3))
+        values[name] = float(value)
+    return values
+
+def validate(workspace_path, tolerance, log_path):
+    workspace_path = utils.full_path(workspace_path)
+    print("Workspace file: {}".format(workspace_path))
+    native = native_results(workspace_path)
+    combine = combine_results(workspace_path, log_path)
+
+    num_bad = 0
+    for name in sorted(combine.keys()):
+        if name not in native:
+            print(" {:24s} combine {:10.5f}    native missing".format(name, combine[name]))
+            num_bad += 1
+            continue
+        diff = abs(native[name]-combine[name])/max(abs(combine[name]), 1.e-3)
+        bad = diff > tolerance
+        if bad:
+            num_bad += 1
+        print(" {:24s} combine {:10.5f}    native {:10.5f}    rel. diff. {:8.5f}{}".format(
+            name, combine[name], native[name], diff, "    FAIL" if bad else ""))
+    return num_bad
+
+if __name__ == "__main__":
+    parser = argparse.ArgumentParser(description="Compares the native limits and significances from the .model files with combine on stored workspaces",
+                                     formatter_class=argparse.ArgumentDefaultsHelpFormatter)
+    parser.add_argument("workspace_files", nargs="+", help="Files containing RooWorkspaces, each with its .model file next to it")
+    parser.add_argument("--tolerance", type=float, default=0.01, help="Largest relative difference accepted between native and combine results")
+    parser.add_argument("--log_file", default=os.devnull, help="Log file in which to write combine output")
+
+    args = parser.parse_args()
+
+    log_path = utils.full_path(args.log_file)
+    utils.cmsenv("~/cmssw/CMSSW_7_4_14/src")
+    num_bad = 0
+    for workspace_file in args.workspace_files:
+        num_bad += validate(workspace_file, args.tolerance, log_path)
+    if num_bad > 0:
+        print("{} results differ from combine by more than {}".format(num_bad, args.tolerance))
+        sys.exit(1)
+    print("All native results agree with combine within {}".format(args.tolerance))
@@ -21,7 +21,27 @@ def ensureDir(path):
 def fullPath(path):
   return os.path.realpath(os.path.abspath(os.path.expanduser(path)))
 
-def SendSignalWorkspaces(input_dir, output_dir, num_jobs, injection_strength, injection_model):
+def SignalOptions(output_dir, injection_strength, injection_model, yield_cache):
+  options = "-o {} --sig_strength {} -u all -l 35.9 -p".format(
+    output_dir, (injection_strength if injection_strength >= 0. else 0.))
+  if injection_strength >= 0.:
+    options += " --unblind none"
+    if injection_model != "":
+      options += " --inject "+injection_model
+  if yield_cache != "":
+    options += " --yield_cache "+fullPath(yield_cache)
+  return options
+
+def RunLocalScan(input_dir, output_dir, injection_strength, injection_model, yield_cache):
+  input_dir = fullPath(input_dir)
+  output_dir = fullPath(output_dir)
+  ensureDir(output_dir)
+  cmd = "./run/wspace_sig.exe --scan {} {}".format(
+    input_dir, SignalOptions(output_dir, injection_strength, injection_model, yield_cache))
+  print(cmd)
+  subprocess.check_call(cmd.split())
+
+def SendSignalWorkspaces(input_dir, output_dir, num_jobs, injection_strength, injection_model, yield_cache):
   input_dir = fullPath(input_dir)
   output_dir = fullPath(output_dir)
 
@@ -56,12 +76,8 @@ def SendSignalWorkspaces(input_dir, output_dir, num_jobs, injection_strength, in
 
       for ifile in range(len(job_files)):
         f = job_files[ifile]
-        cmd = "./run/wspace_sig.exe -f {} -o {} --sig_strength {} -u all -l 35.9 -p".format(
-          f, output_dir, (injection_strength if injection_strength >= 0. else 0.))
-        if injection_strength >= 0.:
-          cmd += " --unblind none"
-          if injection_model != "":
-            cmd += " --inject "+injection_model
+        cmd = "./run/wspace_sig.exe -f {} {}".format(
+          f, SignalOptions(output_dir, injection_strength, injection_model, yield_cache))
         run_file.write("echo Starting to process file {} of {}\n".format(ifile+1, len(job_files)))
         run_file.write(cmd+"\n\n")
 
@@ -84,6 +100,13 @@ if __name__ == "__main__":
                       help="Amount of signal to inject. Negative values turn off signal injection. Note that signal injection replaces the data with MC yields, even at injection strength of 0.")
   parser.add_argument("--injection_model", default="",
                       help="Path to signal ntuple to use for signal injection. If unspecified, uses the same signal model as used to construct the likelihood function")
+  parser.add_argument("--yield_cache", default="",
+                      help="File in which to store and look up yields, so that background and data yields are reused across the scan. Background and data yields are only computed once with --local; batch jobs that start together all miss the cache and compute them independently, and later jobs reuse whatever the earlier ones stored. If unspecified, no cache is used.")
+  parser.add_argument("--local", action="store_true",
+                      help="Produce all workspaces in a single multithreaded process on this machine instead of submitting batch jobs")
   args = parser.parse_args()
 
-  SendSignalWorkspaces(args.input_dir, args.output_dir, args.num_jobs, args.injection_strength, args.injection_model)
+  if args.local:
+    RunLocalScan(args.input_dir, args.output_dir, args.injection_strength, args.injection_model, args.yield_cache)
+  else:
+    SendSignalWorkspaces(args.input_dir, args.output_dir, args.num_jobs, args.injection_strength, args.injection_model, args.yield_cache)
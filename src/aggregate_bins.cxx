@@ -9,6 +9,8 @@
 #include <unistd.h>
 #include <getopt.h>
 
+#include "TSystem.h"
+
 #include "bin.hpp"
 #include "process.hpp"
 #include "utilities.hpp"
@@ -17,6 +19,7 @@
 #include "cross_sections.hpp"
 
 #include "workspace_generator.hpp"
+#include "yield_manager.hpp"
 
 using namespace std;
 
@@ -34,10 +37,15 @@ namespace{
   int mglu = 1800.;
   int mlsp = 100.;
   bool use_r4 = true;
+  string skim_dir = "";
 }
 
 int main(int argc, char *argv[]){
   GetOptions(argc, argv);
+  if(skim_dir != ""){
+    gSystem->mkdir(skim_dir.c_str(), kTRUE);
+    YieldManager::SkimDir(skim_dir);
+  }
 
   string hostname = execute("echo $HOSTNAME");
   string basefolder("/net/cms2/cms2r0/babymaker/");
@@ -140,6 +148,7 @@ void GetOptions(int argc, char *argv[]){
       {"nbm_low", required_argument, 0, 0},
       {"nbm_high", required_argument, 0, 0},
       {"no_r4", no_argument, 0, 0},
+      {"skim_dir", required_argument, 0, 0},
       {0, 0, 0, 0}
     };
 
@@ -178,6 +187,8 @@ void GetOptions(int argc, char *argv[]){
         mlsp = atoi(optarg);
       }else if(optname == "no_r4"){
 	use_r4 = false;
+      }else if(optname == "skim_dir"){
+        skim_dir = optarg;
       }else{
         printf("Bad option! Found option name %s\n", optname.c_str());
       }
@@ -0,0 +1,184 @@
+#include "asymptotic_limits.hpp"
+
+#include <cmath>
+
+#include <string>
+#include <vector>
+#include <limits>
+#include <algorithm>
+
+#include "utilities.hpp"
+
+using namespace std;
+
+AsymptoticLimits::AsymptoticLimits(const CompactModel &model,
+                                   const string &pdf_name,
+                                   const string &poi_name):
+  data_fitter_(model, pdf_name),
+  asimov_fitter_(model, pdf_name),
+  pdf_name_(pdf_name),
+  poi_name_(poi_name),
+  confidence_level_(0.95),
+  tolerance_(1e-3),
+  is_setup_(false),
+  mu_hat_(0.),
+  data_nll_hat_(0.),
+  asimov_nll_hat_(0.),
+  sigma_(1.){
+  if(!(model.GetNode(model.Index(poi_name)).flags & CompactModel::poi)){
+    ERROR(poi_name+" is not a parameter of interest");
+  }
+}
+
+double AsymptoticLimits::GetConfidenceLevel() const{
+  return confidence_level_;
+}
+
+AsymptoticLimits & AsymptoticLimits::SetConfidenceLevel(double confidence_level){
+  confidence_level_ = confidence_level;
+  return *this;
+}
+
+double AsymptoticLimits::GetTolerance() const{
+  return tolerance_;
+}
+
+AsymptoticLimits & AsymptoticLimits::SetTolerance(double tolerance){
+  tolerance_ = tolerance;
+  return *this;
+}
+
+double AsymptoticLimits::ObservedLimit(){
+  Setup();
+  double alpha = 1.-confidence_level_;
+  return FindRoot([this, alpha](double mu){return CLs(mu)-alpha;},
+                  max(mu_hat_, 0.)+2.*sigma_);
+}
+
+double AsymptoticLimits::ExpectedLimit(double num_sigma){
+  //The band edge where sqrt(q_A) = Phi^-1(1-alpha*Phi(N))+N, so CLs = alpha for data
+  //fluctuating N sigma away from the background-only expectation
+  Setup();
+  double alpha = 1.-confidence_level_;
+  double target = NormalQuantile(1.-alpha*NormalCDF(num_sigma))+num_sigma;
+  return FindRoot([this, target](double mu){return target-sqrt(AsimovTestStatistic(mu));},
+                  target*sigma_);
+}
+
+double AsymptoticLimits::CLs(double mu){
+  Setup();
+  double q = TestStatistic(data_fitter_, data_nll_hat_, mu_hat_, mu);
+  double q_a = AsimovTestStatistic(mu);
+  if(q_a <= 0.) return 1.;
+  double sqrt_q = sqrt(q), sqrt_q_a = sqrt(q_a);
+  double clsb, clb;
+  if(q <= q_a){
+    clsb = NormalCDF(-sqrt_q);
+    clb = NormalCDF(sqrt_q_a-sqrt_q);
+  }else{
+    clsb = NormalCDF(-0.5*(q+q_a)/sqrt_q_a);
+    clb = NormalCDF(-0.5*(q-q_a)/sqrt_q_a);
+  }
+  return clb > 0. ? clsb/clb : 1.;
+}
+
+double AsymptoticLimits::NormalCDF(double x){
+  return 0.5*erfc(-x/sqrt(2.));
+}
+
+double AsymptoticLimits::NormalQuantile(double p){
+  //Acklam's rational approximation, polished with one Halley step
+  if(!(p > 0. && p < 1.)) ERROR("Normal quantile needs 0 < p < 1, got "+to_string(p));
+  static const double a[6] = {-3.969683028665376e+01, 2.209460984245205e+02, -2.759285104469687e+02,
+                              1.383577518672690e+02, -3.066479806614716e+01, 2.506628277459239e+00};
+  static const double b[5] = {-5.447609879822406e+01, 1.615858368580409e+02, -1.556989798598866e+02,
+                              6.680131188771972e+01, -1.328068155288572e+01};
+  static const double c[6] = {-7.784894002430293e-03, -3.223964580411365e-01, -2.400758277161838e+00,
+                              -2.549732539343734e+00, 4.374664141464968e+00, 2.938163982698783e+00};
+  static const double d[4] = {7.784695709041462e-03, 3.224671290700398e-01, 2.445134137142996e+00,
+                              3.754408661907416e+00};
+  const double p_low = 0.02425;
+  double x;
+  if(p < p_low || p > 1.-p_low){
+    double q = sqrt(-2.*log(p < p_low ? p : 1.-p));
+    x = (((((c[0]*q+c[1])*q+c[2])*q+c[3])*q+c[4])*q+c[5])/((((d[0]*q+d[1])*q+d[2])*q+d[3])*q+1.);
+    if(p > 1.-p_low) x = -x;
+  }else{
+    double q = p-0.5, r = q*q;
+    x = (((((a[0]*r+a[1])*r+a[2])*r+a[3])*r+a[4])*r+a[5])*q
+      /(((((b[0]*r+b[1])*r+b[2])*r+b[3])*r+b[4])*r+1.);
+  }
+  double e = NormalCDF(x)-p;
+  double u = e*sqrt(2.*M_PI)*exp(0.5*x*x);
+  return x-u/(1.+0.5*x*u);
+}
+
+void AsymptoticLimits::Setup(){
+  if(is_setup_) return;
+  const CompactModel &data = data_fitter_.GetModel();
+  size_t poi = data.Index(poi_name_);
+
+  data_fitter_.Release(poi_name_);
+  data_nll_hat_ = data_fitter_.Minimize().nll;
+  mu_hat_ = data.Value(poi);
+
+  //The background-only fit to the data sets the nuisances of the Asimov data set, and
+  //leaves the data fitter there as the starting point of the conditional fits
+  data_fitter_.Fix(poi_name_, 0.);
+  data_fitter_.Minimize();
+  CompactModel asimov(data);
+  asimov.SetToExpectation(asimov.Index(pdf_name_));
+  asimov_fitter_ = CompactFitter(asimov, pdf_name_);
+  asimov_fitter_.Fix(poi_name_, 0.);
+  asimov_nll_hat_ = asimov_fitter_.Minimize().nll;
+  is_setup_ = true;
+
+  //Width of the POI near mu = 1, used to start the searches for the limits
+  double q_a = AsimovTestStatistic(1.);
+  sigma_ = q_a > 0. ? 1./sqrt(q_a) : 1.;
+}
+
+double AsymptoticLimits::TestStatistic(CompactFitter &fitter, double nll_hat, double mu_hat, double mu){
+  //q~_mu is zero when the best fit is above mu; below zero it is measured from mu = 0,
+  //which the POI's lower bound of 0 already enforces in the unconditional fit
+  if(mu <= mu_hat) return 0.;
+  fitter.Fix(poi_name_, mu);
+  double nll = fitter.Minimize().nll;
+  return max(2.*(nll-nll_hat), 0.);
+}
+
+double AsymptoticLimits::AsimovTestStatistic(double mu){
+  return TestStatistic(asimov_fitter_, asimov_nll_hat_, 0., mu);
+}
+
+double AsymptoticLimits::FindRoot(const function<double(double)> &f, double guess) const{
+  //f decreases with mu and is positive at 0. Bracket by doubling, then Illinois steps
+  double lo = 0., f_lo = f(lo);
+  double hi = max(guess, 1e-3), f_hi = f(hi);
+  while(f_hi > 0.){
+    lo = hi;
+    f_lo = f_hi;
+    hi *= 2.;
+    if(hi > 1e9) ERROR("Could not bracket the limit");
+    f_hi = f(hi);
+  }
+  int side = 0;
+  double mid = hi;
+  for(size_t iteration = 0; iteration < 100 && hi-lo > tolerance_*hi; ++iteration){
+    mid = f_hi != f_lo ? (lo*f_hi-hi*f_lo)/(f_hi-f_lo) : 0.5*(lo+hi);
+    double f_mid = f(mid);
+    if(f_mid == 0.) return mid;
+    if(f_mid > 0.){
+      lo = mid;
+      f_lo = f_mid;
+      if(side == 1) f_hi *= 0.5;
+      side = 1;
+    }else{
+      hi = mid;
+      f_hi = f_mid;
+      if(side == -1) f_lo *= 0.5;
+      side = -1;
+    }
+  }
+  return f_hi != f_lo ? (lo*f_hi-hi*f_lo)/(f_hi-f_lo) : 0.5*(lo+hi);
+}
@@ -0,0 +1,59 @@
+#include "barlow_beeston_poisson.hpp"
+
+#include <cmath>
+#include <limits>
+
+#include "barlow_beeston_scale.hpp"
+
+ClassImp(BarlowBeestonPoisson)
+
+BarlowBeestonPoisson::BarlowBeestonPoisson():
+  RooAbsPdf(),
+  n_(),
+  mu_(),
+  rel_unc_(){
+}
+
+BarlowBeestonPoisson::BarlowBeestonPoisson(const char *name, const char *title,
+                                           RooAbsReal &n, RooAbsReal &mu, RooAbsReal &rel_unc):
+  RooAbsPdf(name, title),
+  n_("n", "n", this, n),
+  mu_("mu", "mu", this, mu),
+  rel_unc_("rel_unc", "rel_unc", this, rel_unc){
+}
+
+BarlowBeestonPoisson::BarlowBeestonPoisson(const BarlowBeestonPoisson &other, const char *name):
+  RooAbsPdf(other, name),
+  n_("n", this, other.n_),
+  mu_("mu", this, other.mu_),
+  rel_unc_("rel_unc", this, other.rel_unc_){
+}
+
+BarlowBeestonPoisson::~BarlowBeestonPoisson(){
+}
+
+TObject * BarlowBeestonPoisson::clone(const char *new_name) const{
+  return new BarlowBeestonPoisson(*this, new_name);
+}
+
+Int_t BarlowBeestonPoisson::getAnalyticalIntegral(RooArgSet &all_vars, RooArgSet &anal_vars,
+                                                  const char */*range_name*/) const{
+  if(matchArgs(all_vars, anal_vars, n_)) return 1;
+  return 0;
+}
+
+Double_t BarlowBeestonPoisson::analyticalIntegral(Int_t /*code*/, const char */*range_name*/) const{
+  //The profiled term is used as a likelihood factor as is; declaring it normalized in n
+  //keeps RooFit from integrating it numerically
+  return 1.;
+}
+
+Double_t BarlowBeestonPoisson::evaluate() const{
+  double n = n_, mu = mu_, rel_unc = rel_unc_;
+  double beta = BarlowBeestonScale(n, mu, rel_unc);
+  double mean = beta*mu;
+  if(mean <= 0.) return n <= 0. ? 1. : std::numeric_limits<double>::min();
+  double log_l = n*std::log(mean)-mean-std::lgamma(n+1.);
+  if(rel_unc > 0.) log_l -= 0.5*(beta-1.)*(beta-1.)/(rel_unc*rel_unc);
+  return std::exp(log_l);
+}
@@ -0,0 +1,413 @@
+#include "compact_fitter.hpp"
+
+#include <cmath>
+
+#include <string>
+#include <vector>
+#include <limits>
+#include <algorithm>
+
+#include "barlow_beeston_scale.hpp"
+#include "utilities.hpp"
+
+using namespace std;
+
+namespace{
+  typedef CompactModel::NodeType NodeType;
+
+  const size_t no_node = numeric_limits<size_t>::max();
+
+  //A likelihood term's slopes with respect to the nodes it reads, and its Gauss-Newton
+  //curvature weight*(d(plus)-d(minus))^2
+  struct Term{
+    size_t nodes[3];
+    double slopes[3];
+    size_t plus, minus;
+    double weight;
+  };
+
+  double ProductExcept(const vector<double> &values, const uint64_t *servers,
+                       size_t first, size_t last, size_t skip){
+    double product = 1.;
+    for(size_t i = first; i < last; ++i){
+      if(i != skip) product *= values[servers[i]];
+    }
+    return product;
+  }
+
+  //Derivative of a function node along the direction whose server derivatives are in tangent
+  double Tangent(const CompactModel &model, size_t inode,
+                 const vector<double> &values, const vector<double> &tangent){
+    const CompactModel::Node &node = model.GetNode(inode);
+    const uint64_t *s = model.Servers(inode);
+    size_t num = node.num_servers;
+    double d = 0.;
+    if(node.type == NodeType::product){
+      for(size_t i = 0; i < num; ++i){
+        if(tangent[s[i]] != 0.) d += tangent[s[i]]*ProductExcept(values, s, 0, num, i);
+      }
+    }else if(node.type == NodeType::sum){
+      for(size_t i = 0; i < num; ++i) d += tangent[s[i]];
+    }else if(node.type == NodeType::ratio){
+      size_t num_numerators = static_cast<size_t>(node.value);
+      double denominator = ProductExcept(values, s, num_numerators, num, num);
+      for(size_t i = 0; i < num; ++i){
+        if(tangent[s[i]] == 0.) continue;
+        if(i < num_numerators) d += tangent[s[i]]*ProductExcept(values, s, 0, num_numerators, i)/denominator;
+        else d -= tangent[s[i]]*values[inode]/values[s[i]];
+      }
+    }else if(node.type == NodeType::exp_product){
+      for(size_t i = 0; i < num; ++i){
+        if(tangent[s[i]] != 0.) d += tangent[s[i]]*ProductExcept(values, s, 0, num, i);
+      }
+      d *= values[inode];
+    }else if(node.type == NodeType::sqrt){
+      if(tangent[s[0]] != 0.) d = 0.5*tangent[s[0]]/values[inode];
+    }
+    return d;
+  }
+
+  bool Cholesky(vector<vector<double> > &a){
+    for(size_t j = 0; j < a.size(); ++j){
+      double d = a[j][j];
+      for(size_t k = 0; k < j; ++k) d -= a[j][k]*a[j][k];
+      if(!(d > 0.)) return false;
+      a[j][j] = sqrt(d);
+      for(size_t i = j+1; i < a.size(); ++i){
+        double sum = a[i][j];
+        for(size_t k = 0; k < j; ++k) sum -= a[i][k]*a[j][k];
+        a[i][j] = sum/a[j][j];
+      }
+    }
+    return true;
+  }
+
+  vector<double> CholeskySolve(const vector<vector<double> > &l, vector<double> b){
+    for(size_t i = 0; i < b.size(); ++i){
+      for(size_t k = 0; k < i; ++k) b[i] -= l[i][k]*b[k];
+      b[i] /= l[i][i];
+    }
+    for(size_t i = b.size(); i-- > 0; ){
+      for(size_t k = i+1; k < b.size(); ++k) b[i] -= l[k][i]*b[k];
+      b[i] /= l[i][i];
+    }
+    return b;
+  }
+
+  //Solves (H+lambda*D) step = -gradient over the free parameters, with D the Hessian
+  //diagonal floored at 1 so flat directions still get a bounded step
+  bool DampedStep(const vector<vector<double> > &hessian, const vector<double> &gradient,
+                  const vector<bool> &free, double lambda, vector<double> &step){
+    vector<size_t> index;
+    for(size_t i = 0; i < free.size(); ++i) if(free[i]) index.push_back(i);
+    vector<vector<double> > a(index.size(), vector<double>(index.size()));
+    vector<double> b(index.size());
+    for(size_t i = 0; i < index.size(); ++i){
+      for(size_t j = 0; j < index.size(); ++j) a[i][j] = hessian[index[i]][index[j]];
+      a[i][i] += lambda*max(hessian[index[i]][index[i]], 1.);
+      b[i] = -gradient[index[i]];
+    }
+    if(!Cholesky(a)) return false;
+    b = CholeskySolve(a, b);
+    step.assign(free.size(), 0.);
+    for(size_t i = 0; i < index.size(); ++i) step[index[i]] = b[i];
+    return true;
+  }
+
+  bool Invert(vector<vector<double> > a, vector<vector<double> > &inverse){
+    if(!Cholesky(a)) return false;
+    inverse.assign(a.size(), vector<double>(a.size()));
+    for(size_t j = 0; j < a.size(); ++j){
+      vector<double> unit(a.size(), 0.);
+      unit[j] = 1.;
+      unit = CholeskySolve(a, unit);
+      for(size_t i = 0; i < a.size(); ++i) inverse[i][j] = unit[i];
+    }
+    return true;
+  }
+}
+
+CompactFitter::CompactFitter(const CompactModel &model, const string &pdf_name):
+  model_(model),
+  pdf_(model.Index(pdf_name)),
+  used_(model.NumNodes(), false),
+  fixed_(),
+  params_(),
+  tolerance_(1e-6),
+  max_iterations_(100){
+  //Only nodes under the pdf matter; they all precede it
+  used_.at(pdf_) = true;
+  for(size_t inode = pdf_+1; inode-- > 0; ){
+    if(!used_.at(inode)) continue;
+    if(model_.GetNode(inode).type == NodeType::unsupported){
+      ERROR("Cannot fit "+pdf_name+": node "+model_.Name(inode)+" has no native form");
+    }
+    const uint64_t *s = model_.Servers(inode);
+    for(size_t i = 0; i < model_.GetNode(inode).num_servers; ++i) used_.at(s[i]) = true;
+  }
+  FindParameters();
+}
+
+const CompactModel & CompactFitter::GetModel() const{
+  return model_;
+}
+
+CompactModel & CompactFitter::GetModel(){
+  return model_;
+}
+
+CompactFitter & CompactFitter::Fix(const string &name){
+  fixed_.insert(model_.Index(name));
+  FindParameters();
+  return *this;
+}
+
+CompactFitter & CompactFitter::Fix(const string &name, double value){
+  model_.SetValue(name, value);
+  return Fix(name);
+}
+
+CompactFitter & CompactFitter::Release(const string &name){
+  fixed_.erase(model_.Index(name));
+  FindParameters();
+  return *this;
+}
+
+const vector<size_t> & CompactFitter::Parameters() const{
+  return params_;
+}
+
+double CompactFitter::GetTolerance() const{
+  return tolerance_;
+}
+
+CompactFitter & CompactFitter::SetTolerance(double tolerance){
+  tolerance_ = tolerance;
+  return *this;
+}
+
+size_t CompactFitter::GetMaxIterations() const{
+  return max_iterations_;
+}
+
+CompactFitter & CompactFitter::SetMaxIterations(size_t max_iterations){
+  max_iterations_ = max_iterations;
+  return *this;
+}
+
+double CompactFitter::NLL() const{
+  return model_.NLL(pdf_);
+}
+
+double CompactFitter::Gradient(vector<double> &gradient,
+                               vector<vector<double> > *hessian) const{
+  vector<double> values;
+  model_.Evaluate(values);
+
+  vector<Term> terms;
+  vector<size_t> stack{pdf_};
+  double nll = 0.;
+  while(!stack.empty()){
+    size_t inode = stack.back();
+    stack.pop_back();
+    const CompactModel::Node &node = model_.GetNode(inode);
+    const uint64_t *s = model_.Servers(inode);
+    if(node.type == NodeType::pdf_product){
+      stack.insert(stack.end(), s, s+node.num_servers);
+      continue;
+    }
+    nll -= values[inode];
+    Term term{{no_node, no_node, no_node}, {0., 0., 0.}, no_node, no_node, 0.};
+    if(node.type == NodeType::poisson){
+      double n = values[s[0]], mu = values[s[1]];
+      term.nodes[0] = s[1];
+      term.slopes[0] = mu > 0. ? 1.-n/mu : 0.;
+      term.plus = s[1];
+      term.weight = mu > 0. ? 1./mu : 0.;
+    }else if(node.type == NodeType::gaussian){
+      double sigma = node.num_servers > 2 ? values[s[2]] : node.value;
+      double pull = (values[s[0]]-values[s[1]])/sigma;
+      term.nodes[0] = s[0];
+      term.slopes[0] = pull/sigma;
+      term.nodes[1] = s[1];
+      term.slopes[1] = -pull/sigma;
+      if(node.num_servers > 2){
+        term.nodes[2] = s[2];
+        term.slopes[2] = (1.-pull*pull)/sigma;
+      }
+      term.plus = s[0];
+      term.minus = s[1];
+      term.weight = 1./(sigma*sigma);
+    }else if(node.type == NodeType::barlow_beeston){
+      //The MC-statistics scale is profiled, so only its explicit dependences count
+      double n = values[s[0]], mu = values[s[1]], rel_unc = values[s[2]];
+      double beta = BarlowBeestonScale(n, mu, rel_unc);
+      term.nodes[0] = s[1];
+      term.slopes[0] = mu > 0. ? beta-n/mu : 0.;
+      if(rel_unc > 0.){
+        term.nodes[1] = s[2];
+        term.slopes[1] = -(beta-1.)*(beta-1.)/(rel_unc*rel_unc*rel_unc);
+      }
+      term.plus = s[1];
+      term.weight = mu > 0. ? 1./(mu+mu*mu*rel_unc*rel_unc) : 0.;
+    }else{
+      ERROR("Cannot differentiate node "+model_.Name(inode));
+    }
+    terms.push_back(term);
+  }
+
+  size_t num_params = params_.size();
+  gradient.assign(num_params, 0.);
+  vector<vector<double> > directions;
+  if(hessian != nullptr) directions.assign(terms.size(), vector<double>(num_params, 0.));
+  vector<double> tangent(values.size(), 0.);
+  for(size_t ip = 0; ip < num_params; ++ip){
+    //Nodes before a parameter cannot depend on it, so the forward pass starts there
+    size_t param = params_[ip];
+    fill(tangent.begin(), tangent.begin()+pdf_+1, 0.);
+    tangent[param] = 1.;
+    for(size_t inode = param+1; inode <= pdf_; ++inode){
+      if(used_[inode]) tangent[inode] = Tangent(model_, inode, values, tangent);
+    }
+    for(size_t iterm = 0; iterm < terms.size(); ++iterm){
+      const Term &term = terms[iterm];
+      for(size_t i = 0; i < 3; ++i){
+        if(term.nodes[i] != no_node) gradient[ip] += term.slopes[i]*tangent[term.nodes[i]];
+      }
+      if(hessian != nullptr){
+        directions[iterm][ip] = tangent[term.plus]-(term.minus == no_node ? 0. : tangent[term.minus]);
+      }
+    }
+  }
+
+  if(hessian != nullptr){
+    hessian->assign(num_params, vector<double>(num_params, 0.));
+    for(size_t iterm = 0; iterm < terms.size(); ++iterm){
+      const vector<double> &direction = directions[iterm];
+      double weight = terms[iterm].weight;
+      for(size_t i = 0; i < num_params; ++i){
+        if(direction[i] == 0.) continue;
+        for(size_t j = 0; j <= i; ++j) (*hessian)[i][j] += weight*direction[i]*direction[j];
+      }
+    }
+    for(size_t i = 0; i < num_params; ++i){
+      for(size_t j = 0; j < i; ++j) (*hessian)[j][i] = (*hessian)[i][j];
+    }
+  }
+  return nll;
+}
+
+CompactFitter::Result CompactFitter::Minimize(){
+  size_t num_params = params_.size();
+  vector<double> x = GetValues();
+  vector<double> gradient, step;
+  vector<vector<double> > hessian;
+  Gradient(gradient, &hessian);
+  double nll = NLL();
+  size_t nll_calls = 1;
+  double lambda = 1e-3;
+  double edm = numeric_limits<double>::infinity();
+  bool converged = false;
+  size_t iteration = 0;
+  for(; iteration < max_iterations_; ++iteration){
+    //Parameters at a bound that the gradient pushes outward stay there for this step
+    vector<bool> free(num_params, true);
+    for(size_t i = 0; i < num_params; ++i){
+      const CompactModel::Node &node = model_.GetNode(params_[i]);
+      if((x[i] <= node.min && gradient[i] > 0.) || (x[i] >= node.max && gradient[i] < 0.)) free[i] = false;
+    }
+    if(DampedStep(hessian, gradient, free, 1e-9, step)){
+      edm = 0.;
+      for(size_t i = 0; i < num_params; ++i) edm -= 0.5*gradient[i]*step[i];
+      if(edm < tolerance_){
+        converged = true;
+        break;
+      }
+    }
+
+    bool stepped = false;
+    for(; lambda < 1e10 && !stepped; lambda *= 10.){
+      if(!DampedStep(hessian, gradient, free, lambda, step)) continue;
+      vector<double> trial(x);
+      for(size_t i = 0; i < num_params; ++i){
+        const CompactModel::Node &node = model_.GetNode(params_[i]);
+        trial[i] = min(max(x[i]+step[i], node.min), node.max);
+      }
+      SetValues(trial);
+      double trial_nll = NLL();
+      ++nll_calls;
+      if(trial_nll <= nll){
+        x.swap(trial);
+        nll = trial_nll;
+        stepped = true;
+      }
+    }
+    if(!stepped){
+      SetValues(x);
+      break;
+    }
+    lambda = max(1e-2*lambda, 1e-8);
+    Gradient(gradient, &hessian);
+    ++nll_calls;
+  }
+
+  Result result;
+  result.nll = nll;
+  result.edm = edm;
+  result.iterations = iteration;
+  result.converged = converged;
+  result.values = x;
+  for(const auto &param: params_) result.names.push_back(model_.Name(param));
+  if(!Invert(NumericHessian(nll_calls), result.covariance)
+     && !Invert(hessian, result.covariance)){
+    result.covariance.assign(num_params, vector<double>(num_params, numeric_limits<double>::quiet_NaN()));
+  }
+  SetValues(x);
+  result.nll_calls = nll_calls;
+  for(size_t i = 0; i < num_params; ++i) result.errors.push_back(sqrt(result.covariance[i][i]));
+  return result;
+}
+
+void CompactFitter::FindParameters(){
+  params_.clear();
+  for(const auto &var: model_.Variables(CompactModel::floating)){
+    if(used_.at(var) && fixed_.find(var) == fixed_.end()) params_.push_back(var);
+  }
+}
+
+vector<double> CompactFitter::GetValues() const{
+  vector<double> values;
+  for(const auto &param: params_) values.push_back(model_.Value(param));
+  return values;
+}
+
+void CompactFitter::SetValues(const vector<double> &values){
+  for(size_t i = 0; i < params_.size(); ++i) model_.SetValue(params_[i], values.at(i));
+}
+
+vector<vector<double> > CompactFitter::NumericHessian(size_t &nll_calls){
+  //Differences of the exact gradient, kept inside the parameter ranges
+  size_t num_params = params_.size();
+  vector<double> x = GetValues();
+  vector<vector<double> > hessian(num_params, vector<double>(num_params, 0.));
+  vector<double> gradient_lo, gradient_hi;
+  for(size_t i = 0; i < num_params; ++i){
+    const CompactModel::Node &node = model_.GetNode(params_[i]);
+    double h = 1e-4*max(fabs(x[i]), 1.);
+    double lo = max(x[i]-h, node.min), hi = min(x[i]+h, node.max);
+    vector<double> shifted(x);
+    shifted[i] = lo;
+    SetValues(shifted);
+    Gradient(gradient_lo);
+    shifted[i] = hi;
+    SetValues(shifted);
+    Gradient(gradient_hi);
+    nll_calls += 2;
+    for(size_t j = 0; j < num_params; ++j) hessian[j][i] = (gradient_hi[j]-gradient_lo[j])/(hi-lo);
+  }
+  SetValues(x);
+  for(size_t i = 0; i < num_params; ++i){
+    for(size_t j = 0; j < i; ++j) hessian[i][j] = hessian[j][i] = 0.5*(hessian[i][j]+hessian[j][i]);
+  }
+  return hessian;
+}
@@ -0,0 +1,336 @@
+#include "compact_model.hpp"
+
+#include <cmath>
+#include <cstdio>
+
+#include <string>
+#include <vector>
+#include <fstream>
+#include <limits>
+
+#include <unistd.h>
+
+#include "barlow_beeston_scale.hpp"
+#include "nll_kernel.hpp"
+#include "utilities.hpp"
+
+using namespace std;
+
+//Layout: magic, version, number of nodes and servers, (length, characters) per node
+//name, zero padding to 8 bytes, the node records, then the server indices of all nodes
+const char CompactModel::magic_[8] = {'R', 'A', '4', 'M', 'O', 'D', 'E', 'L'};
+const uint64_t CompactModel::version_;
+
+namespace{
+  template<typename T>
+  void ReadValue(ifstream &file, T &value){
+    file.read(reinterpret_cast<char *>(&value), sizeof(T));
+  }
+
+  template<typename T>
+  void WriteValue(ofstream &file, const T &value){
+    file.write(reinterpret_cast<const char *>(&value), sizeof(T));
+  }
+}
+
+CompactModel::CompactModel():
+  nodes_(),
+  names_(),
+  servers_(),
+  log_factorials_(),
+  index_(){
+}
+
+CompactModel::CompactModel(const string &file_name):
+  nodes_(),
+  names_(),
+  servers_(),
+  log_factorials_(),
+  index_(){
+  ifstream file(file_name, ios::binary);
+  if(!file) ERROR("Could not open compact model "+file_name);
+  char magic[sizeof(magic_)];
+  uint64_t version = 0, num_nodes = 0, num_servers = 0;
+  file.read(magic, sizeof(magic));
+  ReadValue(file, version);
+  ReadValue(file, num_nodes);
+  ReadValue(file, num_servers);
+  if(!file || string(magic, sizeof(magic)) != string(magic_, sizeof(magic_))){
+    ERROR("Bad header in compact model "+file_name);
+  }
+  if(version != version_){
+    ERROR("Compact model "+file_name+" has version "+to_string(version)
+          +", expected "+to_string(version_));
+  }
+  size_t offset = sizeof(magic_)+3*sizeof(uint64_t);
+  for(uint64_t inode = 0; inode < num_nodes && file; ++inode){
+    uint64_t length = 0;
+    ReadValue(file, length);
+    string name(length, ' ');
+    file.read(&name.at(0), length);
+    index_[name] = names_.size();
+    names_.push_back(name);
+    offset += sizeof(uint64_t)+length;
+  }
+  file.ignore((sizeof(uint64_t)-offset%sizeof(uint64_t))%sizeof(uint64_t));
+  nodes_.resize(num_nodes);
+  servers_.resize(num_servers);
+  if(num_nodes > 0) file.read(reinterpret_cast<char *>(&nodes_.front()), num_nodes*sizeof(Node));
+  if(num_servers > 0) file.read(reinterpret_cast<char *>(&servers_.front()), num_servers*sizeof(uint64_t));
+  if(!file) ERROR("Truncated compact model "+file_name);
+  log_factorials_.resize(num_nodes);
+  for(size_t inode = 0; inode < nodes_.size(); ++inode){
+    const Node &node = nodes_.at(inode);
+    if(node.first_server+node.num_servers > servers_.size()) ERROR("Corrupt compact model "+file_name);
+    for(size_t iserver = 0; iserver < node.num_servers; ++iserver){
+      //Nodes only depend on earlier nodes, so one pass in order evaluates the model
+      if(servers_.at(node.first_server+iserver) >= inode) ERROR("Corrupt compact model "+file_name);
+    }
+    if(node.type == NodeType::variable) log_factorials_.at(inode) = lgamma(node.value+1.);
+  }
+}
+
+void CompactModel::Write(const string &file_name) const{
+  //Write to a temporary file and rename so concurrent jobs never read a partial model
+  string temp_name = file_name+".tmp"+to_string(getpid());
+  {
+    ofstream file(temp_name, ios::binary | ios::trunc);
+    if(!file) ERROR("Could not open "+temp_name+" for writing");
+    file.write(magic_, sizeof(magic_));
+    WriteValue(file, version_);
+    WriteValue(file, static_cast<uint64_t>(nodes_.size()));
+    WriteValue(file, static_cast<uint64_t>(servers_.size()));
+    size_t offset = sizeof(magic_)+3*sizeof(uint64_t);
+    for(const auto &name: names_){
+      WriteValue(file, static_cast<uint64_t>(name.size()));
+      file.write(name.data(), name.size());
+      offset += sizeof(uint64_t)+name.size();
+    }
+    const char padding[sizeof(uint64_t)] = {0};
+    file.write(padding, (sizeof(uint64_t)-offset%sizeof(uint64_t))%sizeof(uint64_t));
+    file.write(reinterpret_cast<const char *>(nodes_.data()), nodes_.size()*sizeof(Node));
+    file.write(reinterpret_cast<const char *>(servers_.data()), servers_.size()*sizeof(uint64_t));
+    if(!file) ERROR("Could not write compact model "+temp_name);
+  }
+  if(rename(temp_name.c_str(), file_name.c_str()) != 0){
+    remove(temp_name.c_str());
+    ERROR("Could not move compact model to "+file_name);
+  }
+}
+
+size_t CompactModel::AddNode(const string &name, NodeType type, uint32_t flags,
+                             const vector<string> &servers,
+                             double value, double min, double max){
+  if(HasNode(name)) ERROR("Compact model already has a node "+name);
+  Node node{type, flags, servers_.size(), servers.size(), value, min, max};
+  for(const auto &server: servers){
+    Append(servers_, static_cast<uint64_t>(Index(server)));
+  }
+  index_[name] = nodes_.size();
+  names_.push_back(name);
+  nodes_.push_back(node);
+  log_factorials_.push_back(type == NodeType::variable ? lgamma(value+1.) : 0.);
+  return nodes_.size()-1;
+}
+
+size_t CompactModel::NumNodes() const{
+  return nodes_.size();
+}
+
+const CompactModel::Node & CompactModel::GetNode(size_t inode) const{
+  return nodes_.at(inode);
+}
+
+const string & CompactModel::Name(size_t inode) const{
+  return names_.at(inode);
+}
+
+bool CompactModel::HasNode(const string &name) const{
+  return index_.find(name) != index_.end();
+}
+
+size_t CompactModel::Index(const string &name) const{
+  auto inode = index_.find(name);
+  if(inode == index_.end()) ERROR("Compact model has no node "+name);
+  return inode->second;
+}
+
+const uint64_t * CompactModel::Servers(size_t inode) const{
+  return servers_.data()+nodes_.at(inode).first_server;
+}
+
+vector<size_t> CompactModel::Variables(uint32_t flags) const{
+  vector<size_t> variables;
+  for(size_t inode = 0; inode < nodes_.size(); ++inode){
+    const Node &node = nodes_.at(inode);
+    if(node.type == NodeType::variable && (node.flags & flags) == flags){
+      variables.push_back(inode);
+    }
+  }
+  return variables;
+}
+
+double CompactModel::Value(size_t inode) const{
+  return nodes_.at(inode).value;
+}
+
+void CompactModel::SetValue(size_t inode, double value){
+  if(nodes_.at(inode).type != NodeType::variable) ERROR(names_.at(inode)+" is not a variable");
+  nodes_.at(inode).value = value;
+  log_factorials_.at(inode) = lgamma(value+1.);
+}
+
+void CompactModel::SetValue(const string &name, double value){
+  SetValue(Index(name), value);
+}
+
+void CompactModel::SetRange(size_t inode, double min, double max){
+  if(nodes_.at(inode).type != NodeType::variable) ERROR(names_.at(inode)+" is not a variable");
+  nodes_.at(inode).min = min;
+  nodes_.at(inode).max = max;
+}
+
+void CompactModel::SetToExpectation(size_t pdf){
+  //Observed counts become their expectations and global observables the current
+  //nuisances, giving the Asimov data set for the current parameters. The observable may
+  //be either of the first two servers: data terms are Poisson(n, mu), but the MC
+  //statistics constraints are Poisson(nobsmc, nmc) or Gaussian(nobsmc, nmc, sqrt_nmc)
+  //with the global observable first, and the systematics Gaussian(x, x_0) with it second
+  vector<double> values;
+  Evaluate(values);
+  vector<size_t> stack{pdf};
+  while(!stack.empty()){
+    size_t inode = stack.back();
+    stack.pop_back();
+    const Node &node = nodes_.at(inode);
+    const uint64_t *s = servers_.data()+node.first_server;
+    if(node.type == NodeType::pdf_product){
+      stack.insert(stack.end(), s, s+node.num_servers);
+    }else if(node.type == NodeType::poisson
+             || node.type == NodeType::barlow_beeston
+             || node.type == NodeType::gaussian){
+      const uint32_t data = observable | global_observable;
+      if(nodes_.at(s[0]).flags & data){
+        SetValue(s[0], values.at(s[1]));
+      }else if(nodes_.at(s[1]).flags & data){
+        SetValue(s[1], values.at(s[0]));
+      }
+    }
+  }
+}
+
+void CompactModel::Evaluate(vector<double> &values) const{
+  //Functions get their value and pdfs their log-likelihood
+  values.resize(nodes_.size());
+  for(size_t inode = 0; inode < nodes_.size(); ++inode) EvaluateNode(inode, values);
+}
+
+double CompactModel::NLL(size_t pdf) const{
+  //Functions are evaluated node by node. The Poisson and Gaussian terms under the pdf,
+  //which are most of the work, are then gathered into arrays and summed by the kernel
+  if(pdf >= nodes_.size()) ERROR("Compact model has no node "+to_string(pdf));
+  vector<double> values(nodes_.size());
+  for(size_t inode = 0; inode <= pdf; ++inode){
+    NodeType type = nodes_[inode].type;
+    if(type == NodeType::poisson || type == NodeType::gaussian || type == NodeType::pdf_product) continue;
+    EvaluateNode(inode, values);
+  }
+
+  vector<double> n, log_factorial_n, mu, x, mean, sigma;
+  vector<size_t> stack{pdf};
+  double nll = 0.;
+  while(!stack.empty()){
+    size_t inode = stack.back();
+    stack.pop_back();
+    const Node &node = nodes_.at(inode);
+    const uint64_t *s = servers_.data()+node.first_server;
+    if(node.type == NodeType::pdf_product){
+      stack.insert(stack.end(), s, s+node.num_servers);
+    }else if(node.type == NodeType::poisson){
+      n.push_back(values[s[0]]);
+      log_factorial_n.push_back(LogFactorial(s[0], values));
+      mu.push_back(values[s[1]]);
+    }else if(node.type == NodeType::gaussian){
+      x.push_back(values[s[0]]);
+      mean.push_back(values[s[1]]);
+      sigma.push_back(node.num_servers > 2 ? values[s[2]] : node.value);
+    }else{
+      nll -= values[inode];
+    }
+  }
+  nll += NLLKernel::Poisson(n.data(), log_factorial_n.data(), mu.data(), n.size());
+  nll += NLLKernel::Gaussian(x.data(), mean.data(), sigma.data(), x.size());
+  if(std::isnan(nll)) ERROR("Compact model cannot evaluate "+names_.at(pdf));
+  return nll;
+}
+
+double CompactModel::NLL(const string &pdf_name) const{
+  return NLL(Index(pdf_name));
+}
+
+void CompactModel::EvaluateNode(size_t inode, vector<double> &values) const{
+  const Node &node = nodes_[inode];
+  const uint64_t *s = servers_.data()+node.first_server;
+  double &value = values[inode];
+  switch(node.type){
+  case NodeType::variable:
+    value = node.value;
+    break;
+  case NodeType::product:
+    value = 1.;
+    for(size_t i = 0; i < node.num_servers; ++i) value *= values[s[i]];
+    break;
+  case NodeType::sum:
+    value = node.value;
+    for(size_t i = 0; i < node.num_servers; ++i) value += values[s[i]];
+    break;
+  case NodeType::ratio:{
+    double numerator = 1., denominator = 1.;
+    size_t num_numerators = static_cast<size_t>(node.value);
+    for(size_t i = 0; i < node.num_servers; ++i){
+      if(i < num_numerators) numerator *= values[s[i]];
+      else denominator *= values[s[i]];
+    }
+    value = numerator/denominator;
+    break;
+  }
+  case NodeType::exp_product:
+    value = 1.;
+    for(size_t i = 0; i < node.num_servers; ++i) value *= values[s[i]];
+    value = exp(value);
+    break;
+  case NodeType::sqrt:
+    value = sqrt(values[s[0]]);
+    break;
+  case NodeType::poisson:
+    value = -NLLKernel::PoissonTerm(values[s[0]], LogFactorial(s[0], values), values[s[1]]);
+    break;
+  case NodeType::gaussian:
+    value = -NLLKernel::GaussianTerm(values[s[0]], values[s[1]],
+                                     node.num_servers > 2 ? values[s[2]] : node.value);
+    break;
+  case NodeType::barlow_beeston:{
+    double n = values[s[0]], mu = values[s[1]], rel_unc = values[s[2]];
+    double beta = BarlowBeestonScale(n, mu, rel_unc);
+    double mean = beta*mu;
+    if(mean <= 0.) value = n <= 0. ? 0. : log(numeric_limits<double>::min());
+    else value = n*log(mean)-mean-LogFactorial(s[0], values);
+    if(rel_unc > 0.) value -= 0.5*(beta-1.)*(beta-1.)/(rel_unc*rel_unc);
+    break;
+  }
+  case NodeType::pdf_product:
+    value = 0.;
+    for(size_t i = 0; i < node.num_servers; ++i) value += values[s[i]];
+    break;
+  case NodeType::unsupported:
+  default:
+    value = numeric_limits<double>::quiet_NaN();
+    break;
+  }
+}
+
+double CompactModel::LogFactorial(size_t inode, const vector<double> &values) const{
+  //Observed counts are variables, whose log-factorials are kept up to date
+  if(nodes_.at(inode).type == NodeType::variable) return log_factorials_.at(inode);
+  return lgamma(values.at(inode)+1.);
+}
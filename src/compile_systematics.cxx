@@ -0,0 +1,96 @@
+#include "compile_systematics.hpp"
+
+#include <cstdio>
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <map>
+#include <utility>
+
+#include <unistd.h>
+#include <getopt.h>
+
+#include "systematics_database.hpp"
+#include "utilities.hpp"
+
+using namespace std;
+
+namespace{
+  string input = "";
+  string output = "";
+}
+
+int main(int argc, char *argv[]){
+  GetOptions(argc, argv);
+  if(input == "" || output == ""){
+    cout << "Usage: compile_systematics.exe -i \"sys_folder/sys_SMS-T1tttt_*_35.9ifb\" -o T1tttt.sysdb" << endl;
+    return 1;
+  }
+
+  //A folder stands for all the sys_SMS-* files in it
+  vector<string> files = Glob(input);
+  if(files.size() == 1 && Glob(input+"/sys_SMS-*").size() > 0){
+    files = Glob(input+"/sys_SMS-*");
+  }
+
+  map<pair<int, int>, vector<SystematicsDatabase::Entry> > points;
+  for(const auto &file: files){
+    int mglu, mlsp;
+    if(!GetMasses(file, mglu, mlsp)){
+      cout << "Skipping " << file << ": no mass point in its name" << endl;
+      continue;
+    }
+    if(points.find(make_pair(mglu, mlsp)) != points.end()){
+      ERROR("Found more than one systematics file for mGluino-"+to_string(mglu)
+            +"_mLSP-"+to_string(mlsp)+". Use a more specific pattern.");
+    }
+    points[make_pair(mglu, mlsp)] = SystematicsDatabase::ReadTextFile(file);
+  }
+
+  SystematicsDatabase::Write(output, points);
+  cout << "Wrote systematics of " << points.size() << " mass points to " << output << endl;
+}
+
+bool GetMasses(const string &file_name, int &mglu, int &mlsp){
+  //File names look like sys_SMS-T1tttt_mGluino-1200_mLSP-800_35.9ifb
+  string name = file_name.substr(file_name.rfind('/')+1);
+  auto lsp_pos = name.find("_mLSP-");
+  if(lsp_pos == string::npos) return false;
+  auto parent_pos = name.rfind('-', lsp_pos);
+  if(parent_pos == string::npos) return false;
+  try{
+    mglu = stoi(name.substr(parent_pos+1));
+    mlsp = stoi(name.substr(lsp_pos+6));
+  }catch(const logic_error &){
+    return false;
+  }
+  return true;
+}
+
+void GetOptions(int argc, char *argv[]){
+  while(true){
+    static struct option long_options[] = {
+      {"input", required_argument, 0, 'i'},
+      {"output", required_argument, 0, 'o'},
+      {0, 0, 0, 0}
+    };
+
+    char opt = -1;
+    int option_index;
+    opt = getopt_long(argc, argv, "i:o:", long_options, &option_index);
+    if( opt == -1) break;
+
+    switch(opt){
+    case 'i':
+      input = optarg;
+      break;
+    case 'o':
+      output = optarg;
+      break;
+    default:
+      printf("Bad option! getopt_long returned character code 0%o\n", opt);
+      break;
+    }
+  }
+}
@@ -0,0 +1,537 @@
+#include "compiled_cuts.hpp"
+
+#include <algorithm>
+#include <map>
+#include <set>
+#include <tuple>
+#include <utility>
+#include <string>
+#include <vector>
+
+#include "utilities.hpp"
+
+using namespace std;
+
+using Op = CutExpression::Op;
+
+const size_t CompiledCuts::batch_size_;
+
+CompiledCuts::CompiledCuts(const vector<Cut> &cuts):
+  num_cuts_(cuts.size()),
+  variables_(),
+  program_(),
+  outputs_(),
+  classifiers_(),
+  instruction_ids_(){
+  vector<CutExpression> expressions;
+  for(const auto &cut: cuts){
+    expressions.push_back(CutExpression(cut));
+  }
+
+  //First pass: find cuts that share everything but their threshold boxes
+  map<size_t, vector<size_t> > cuts_by_weight;
+  for(size_t icut = 0; icut < expressions.size(); ++icut){
+    Box box;
+    size_t weight = Factorize(*expressions.at(icut).Root(), expressions.at(icut).Variables(), box);
+    cuts_by_weight[weight].push_back(icut);
+  }
+  vector<long> group(cuts.size(), -1);
+  long num_groups = 0;
+  for(const auto &weight_cuts: cuts_by_weight){
+    if(weight_cuts.second.size() < 2) continue;
+    for(const auto &icut: weight_cuts.second) group.at(icut) = num_groups;
+    ++num_groups;
+  }
+
+  //Second pass: compile only what is executed
+  variables_.clear();
+  program_.clear();
+  instruction_ids_.clear();
+  map<long, size_t> classifier_ids;
+  map<pair<size_t, Box>, size_t> box_ids;
+  for(size_t icut = 0; icut < expressions.size(); ++icut){
+    const CutExpression &expression = expressions.at(icut);
+    if(group.at(icut) < 0){
+      outputs_.push_back(make_pair(icut, Compile(*expression.Root(), expression.Variables())));
+      continue;
+    }
+    Box box;
+    size_t weight = Factorize(*expression.Root(), expression.Variables(), box);
+    auto id = classifier_ids.find(group.at(icut));
+    if(id == classifier_ids.end()){
+      id = classifier_ids.insert(make_pair(group.at(icut), classifiers_.size())).first;
+      classifiers_.push_back(Classifier());
+      classifiers_.back().weight = weight;
+    }
+    Classifier &classifier = classifiers_.at(id->second);
+    auto ibox = box_ids.find(make_pair(id->second, box));
+    if(ibox == box_ids.end()){
+      ibox = box_ids.insert(make_pair(make_pair(id->second, box), classifier.boxes.size())).first;
+      classifier.boxes.push_back(box);
+      classifier.cuts.push_back(vector<size_t>());
+    }
+    classifier.cuts.at(ibox->second).push_back(icut);
+  }
+  for(auto &classifier: classifiers_){
+    vector<size_t> all_boxes(classifier.boxes.size());
+    for(size_t ibox = 0; ibox < all_boxes.size(); ++ibox) all_boxes.at(ibox) = ibox;
+    BuildTree(classifier, all_boxes);
+  }
+}
+
+const vector<string> & CompiledCuts::Variables() const{
+  return variables_;
+}
+
+size_t CompiledCuts::NumCuts() const{
+  return num_cuts_;
+}
+
+size_t CompiledCuts::NumInstructions() const{
+  return program_.size();
+}
+
+size_t CompiledCuts::NumClassifiedCuts() const{
+  size_t num_classified = 0;
+  for(const auto &classifier: classifiers_){
+    for(const auto &cuts: classifier.cuts) num_classified += cuts.size();
+  }
+  return num_classified;
+}
+
+void CompiledCuts::AddSums(const vector<const double *> &columns,
+                           size_t num_rows,
+                           vector<double> &sumw,
+                           vector<double> &sumw2) const{
+  if(columns.size() != variables_.size()) ERROR("Need one column per variable");
+  sumw.resize(num_cuts_, 0.);
+  sumw2.resize(num_cuts_, 0.);
+  if(num_rows == 0) return;
+
+  //Every instruction fills one slot per row of the batch, so each shared sub-expression
+  //(e.g. the baseline) is computed once per event no matter how many cuts use it
+  size_t batch = min(batch_size_, num_rows);
+  vector<double> scratch(max<size_t>(program_.size(), 1)*batch);
+  vector<const double *> slots(program_.size(), nullptr);
+  for(size_t inst = 0; inst < program_.size(); ++inst){
+    if(program_.at(inst).op != Op::constant) continue;
+    fill_n(scratch.begin()+inst*batch, batch, program_.at(inst).value);
+    slots.at(inst) = &scratch.at(inst*batch);
+  }
+
+  for(size_t start = 0; start < num_rows; start += batch){
+    size_t num = min(batch, num_rows-start);
+    for(size_t inst = 0; inst < program_.size(); ++inst){
+      const Instruction &instruction = program_[inst];
+      if(instruction.op == Op::constant){
+        continue;
+      }else if(instruction.op == Op::variable){
+        slots[inst] = columns[instruction.ivar]+start;
+      }else{
+        Execute(instruction, slots[instruction.left], slots[instruction.right],
+                &scratch[inst*batch], num);
+        slots[inst] = &scratch[inst*batch];
+      }
+    }
+    for(const auto &output: outputs_){
+      const double *w = slots[output.second];
+      double this_sumw = 0., this_sumw2 = 0.;
+      for(size_t row = 0; row < num; ++row){
+        this_sumw += w[row];
+        this_sumw2 += w[row]*w[row];
+      }
+      sumw[output.first] += this_sumw;
+      sumw2[output.first] += this_sumw2;
+    }
+    //Each event follows one path down the tree and only the boxes left at its leaf are
+    //checked, so the cost does not grow with the number of bins
+    for(const auto &classifier: classifiers_){
+      const double *w = slots[classifier.weight];
+      for(size_t row = 0; row < num; ++row){
+        if(w[row] == 0.) continue;
+        for(const auto &ibox: Classify(classifier, columns, start+row)){
+          if(!Inside(classifier.boxes[ibox], columns, start+row)) continue;
+          for(const auto &icut: classifier.cuts[ibox]){
+            sumw[icut] += w[row];
+            sumw2[icut] += w[row]*w[row];
+          }
+        }
+      }
+    }
+  }
+}
+
+size_t CompiledCuts::Compile(const CutExpression::Node &node,
+                             const vector<string> &expression_variables){
+  switch(node.op){
+  case Op::constant:
+    return AddConstant(node.value);
+  case Op::variable:{
+    Instruction instruction;
+    instruction.op = Op::variable;
+    instruction.type = Type::real;
+    instruction.value = 0.;
+    instruction.ivar = VariableIndex(expression_variables.at(node.ivar));
+    instruction.left = 0;
+    instruction.right = 0;
+    return AddInstruction(instruction);
+  }
+  case Op::negate:
+  case Op::logical_not:{
+    size_t operand = Compile(*node.left, expression_variables);
+    return AddOperation(node.op, operand, operand);
+  }
+  case Op::add:
+  case Op::subtract:
+  case Op::multiply:
+  case Op::divide:
+  case Op::less:
+  case Op::less_equal:
+  case Op::greater:
+  case Op::greater_equal:
+  case Op::equal:
+  case Op::not_equal:
+  case Op::logical_and:
+  case Op::logical_or:
+  default:{
+    size_t left = Compile(*node.left, expression_variables);
+    size_t right = Compile(*node.right, expression_variables);
+    return AddOperation(node.op, left, right);
+  }
+  }
+}
+
+size_t CompiledCuts::AddOperation(Op op, size_t left_id, size_t right_id){
+  Instruction instruction;
+  instruction.op = op;
+  instruction.value = 0.;
+  instruction.ivar = 0;
+  instruction.left = left_id;
+  instruction.right = right_id;
+  switch(op){
+  case Op::logical_not:
+  case Op::less:
+  case Op::less_equal:
+  case Op::greater:
+  case Op::greater_equal:
+  case Op::equal:
+  case Op::not_equal:
+  case Op::logical_and:
+  case Op::logical_or:
+    instruction.type = Type::boolean;
+    break;
+  case Op::constant:
+  case Op::variable:
+  case Op::negate:
+  case Op::add:
+  case Op::subtract:
+  case Op::multiply:
+  case Op::divide:
+  default:
+    instruction.type = Type::real;
+    break;
+  }
+
+  const Instruction &left = program_.at(left_id);
+  const Instruction &right = program_.at(right_id);
+  //Both sides are 0 or 1, so a product gives the same result without comparisons
+  if(op == Op::logical_and && left.type == Type::boolean && right.type == Type::boolean){
+    instruction.op = Op::multiply;
+  }
+
+  //Fold operations on constants
+  if(left.op == Op::constant && right.op == Op::constant){
+    double value = 0.;
+    Execute(instruction, &left.value, &right.value, &value, 1);
+    return AddConstant(value);
+  }
+  return AddInstruction(instruction);
+}
+
+size_t CompiledCuts::AddConstant(double value){
+  Instruction instruction;
+  instruction.op = Op::constant;
+  instruction.type = Type::real;
+  instruction.value = value;
+  instruction.ivar = 0;
+  instruction.left = 0;
+  instruction.right = 0;
+  return AddInstruction(instruction);
+}
+
+size_t CompiledCuts::AddInstruction(const Instruction &instruction){
+  //Identical instructions on identical operands are only computed once
+  InstructionKey key(static_cast<int>(instruction.op), instruction.value,
+                     instruction.ivar, instruction.left, instruction.right);
+  auto id = instruction_ids_.find(key);
+  if(id != instruction_ids_.end()) return id->second;
+  program_.push_back(instruction);
+  instruction_ids_[key] = program_.size()-1;
+  return program_.size()-1;
+}
+
+size_t CompiledCuts::VariableIndex(const string &name){
+  auto var = find(variables_.cbegin(), variables_.cend(), name);
+  if(var != variables_.cend()) return var - variables_.cbegin();
+  variables_.push_back(name);
+  return variables_.size()-1;
+}
+
+size_t CompiledCuts::Factorize(const CutExpression::Node &node,
+                               const vector<string> &expression_variables,
+                               Box &box){
+  //Splits the cut into threshold constraints (box) times a weight built from everything else
+  vector<size_t> factors;
+  Factorize(node, expression_variables, false, factors, box);
+  sort(factors.begin(), factors.end());
+  if(factors.size() == 0) return AddConstant(1.);
+  size_t weight = factors.front();
+  for(size_t ifactor = 1; ifactor < factors.size(); ++ifactor){
+    weight = AddOperation(Op::multiply, weight, factors.at(ifactor));
+  }
+  return weight;
+}
+
+void CompiledCuts::Factorize(const CutExpression::Node &node,
+                             const vector<string> &expression_variables,
+                             bool conjunction,
+                             vector<size_t> &factors,
+                             Box &box){
+  if(node.op == Op::logical_and){
+    Factorize(*node.left, expression_variables, true, factors, box);
+    Factorize(*node.right, expression_variables, true, factors, box);
+  }else if(node.op == Op::multiply && !conjunction){
+    Factorize(*node.left, expression_variables, false, factors, box);
+    Factorize(*node.right, expression_variables, false, factors, box);
+  }else if(!AddConstraint(node, expression_variables, box)){
+    size_t factor = Compile(node, expression_variables);
+    if(conjunction && program_.at(factor).type == Type::real){
+      factor = AddOperation(Op::not_equal, factor, AddConstant(0.));
+    }
+    factors.push_back(factor);
+  }
+}
+
+bool CompiledCuts::AddConstraint(const CutExpression::Node &node,
+                                 const vector<string> &expression_variables,
+                                 Box &box){
+  Op op = node.op;
+  if(op != Op::less && op != Op::less_equal
+     && op != Op::greater && op != Op::greater_equal
+     && op != Op::equal) return false;
+
+  double value = 0.;
+  size_t ivar = 0;
+  if(node.left->op == Op::variable && ConstantValue(*node.right, value)){
+    ivar = node.left->ivar;
+  }else if(node.right->op == Op::variable && ConstantValue(*node.left, value)){
+    //Put the variable on the left
+    ivar = node.right->ivar;
+    if(op == Op::less) op = Op::greater;
+    else if(op == Op::less_equal) op = Op::greater_equal;
+    else if(op == Op::greater) op = Op::less;
+    else if(op == Op::greater_equal) op = Op::less_equal;
+  }else{
+    return false;
+  }
+
+  Interval &interval = box[VariableIndex(expression_variables.at(ivar))];
+  if(op == Op::greater || op == Op::greater_equal || op == Op::equal){
+    Threshold lower{value, op == Op::greater};
+    if(!interval.has_lower || interval.lower < lower){
+      interval.has_lower = true;
+      interval.lower = lower;
+    }
+  }
+  if(op == Op::less || op == Op::less_equal || op == Op::equal){
+    Threshold upper{value, op != Op::less};
+    if(!interval.has_upper || upper < interval.upper){
+      interval.has_upper = true;
+      interval.upper = upper;
+    }
+  }
+  return true;
+}
+
+size_t CompiledCuts::BuildTree(Classifier &classifier, const vector<size_t> &boxes) const{
+  //Split on the box edge that best halves the remaining boxes. Boxes on both sides of the
+  //edge go down both branches, and a leaf keeps the boxes no edge can separate
+  TreeNode node;
+  node.ivar = 0;
+  node.threshold = Threshold{0., false};
+  node.pass = 0;
+  node.fail = 0;
+  size_t best_size = boxes.size();
+  set<size_t> variables;
+  for(const auto &ibox: boxes){
+    for(const auto &var_interval: classifier.boxes.at(ibox)) variables.insert(var_interval.first);
+  }
+  for(const auto &ivar: variables){
+    //An edge t sends to the fail side boxes with lower < t and to the pass side boxes
+    //with upper > t; boxes without that bound go to both
+    vector<Threshold> lowers, uppers;
+    for(const auto &ibox: boxes){
+      const Box &box = classifier.boxes.at(ibox);
+      auto interval = box.find(ivar);
+      if(interval == box.cend()) continue;
+      if(interval->second.has_lower) lowers.push_back(interval->second.lower);
+      if(interval->second.has_upper) uppers.push_back(interval->second.upper);
+    }
+    sort(lowers.begin(), lowers.end());
+    sort(uppers.begin(), uppers.end());
+    size_t num_no_lower = boxes.size()-lowers.size();
+    size_t num_no_upper = boxes.size()-uppers.size();
+    for(const auto &edges: {&lowers, &uppers}){
+      for(const auto &threshold: *edges){
+        size_t num_fail = num_no_lower+(lower_bound(lowers.cbegin(), lowers.cend(), threshold)-lowers.cbegin());
+        size_t num_pass = num_no_upper+(uppers.cend()-upper_bound(uppers.cbegin(), uppers.cend(), threshold));
+        size_t size = max(num_pass, num_fail);
+        if(size < best_size){
+          best_size = size;
+          node.ivar = ivar;
+          node.threshold = threshold;
+        }
+      }
+    }
+  }
+
+  size_t index = classifier.tree.size();
+  if(best_size == boxes.size()){
+    node.boxes = boxes;
+    classifier.tree.push_back(node);
+    return index;
+  }
+  classifier.tree.push_back(node);
+  vector<size_t> pass, fail;
+  for(const auto &ibox: boxes){
+    const Box &box = classifier.boxes.at(ibox);
+    auto interval = box.find(node.ivar);
+    if(interval == box.cend() || !interval->second.has_upper || node.threshold < interval->second.upper){
+      pass.push_back(ibox);
+    }
+    if(interval == box.cend() || !interval->second.has_lower || interval->second.lower < node.threshold){
+      fail.push_back(ibox);
+    }
+  }
+  size_t pass_index = BuildTree(classifier, pass);
+  size_t fail_index = BuildTree(classifier, fail);
+  classifier.tree.at(index).pass = pass_index;
+  classifier.tree.at(index).fail = fail_index;
+  return index;
+}
+
+const vector<size_t> & CompiledCuts::Classify(const Classifier &classifier,
+                                              const vector<const double *> &columns,
+                                              size_t row) const{
+  const TreeNode *node = &classifier.tree.front();
+  while(node->boxes.empty()){
+    node = &classifier.tree[node->threshold.PassedBy(columns[node->ivar][row]) ? node->pass : node->fail];
+  }
+  return node->boxes;
+}
+
+bool CompiledCuts::Inside(const Box &box,
+                          const vector<const double *> &columns,
+                          size_t row){
+  for(const auto &var_interval: box){
+    if(!var_interval.second.Contains(columns[var_interval.first][row])) return false;
+  }
+  return true;
+}
+
+bool CompiledCuts::ConstantValue(const CutExpression::Node &node, double &value){
+  if(node.op == Op::constant){
+    value = node.value;
+    return true;
+  }else if(node.op == Op::negate && ConstantValue(*node.left, value)){
+    value = -value;
+    return true;
+  }
+  return false;
+}
+
+bool CompiledCuts::Threshold::operator<(const Threshold &t) const{
+  return tie(value, strict) < tie(t.value, t.strict);
+}
+
+bool CompiledCuts::Threshold::operator==(const Threshold &t) const{
+  return tie(value, strict) == tie(t.value, t.strict);
+}
+
+bool CompiledCuts::Threshold::PassedBy(double x) const{
+  return strict ? x > value : x >= value;
+}
+
+bool CompiledCuts::Interval::operator==(const Interval &i) const{
+  return has_lower == i.has_lower && has_upper == i.has_upper
+    && (!has_lower || lower == i.lower) && (!has_upper || upper == i.upper);
+}
+
+bool CompiledCuts::Interval::operator<(const Interval &i) const{
+  if(has_lower != i.has_lower) return has_lower < i.has_lower;
+  if(has_upper != i.has_upper) return has_upper < i.has_upper;
+  if(has_lower && !(lower == i.lower)) return lower < i.lower;
+  return has_upper && upper < i.upper;
+}
+
+bool CompiledCuts::Interval::Contains(double x) const{
+  //Written as direct comparisons so NaN is rejected like in the generic evaluation
+  if(has_lower && !lower.PassedBy(x)) return false;
+  if(has_upper && !(upper.strict ? x <= upper.value : x < upper.value)) return false;
+  return true;
+}
+
+void CompiledCuts::Execute(const Instruction &instruction,
+                           const double *left, const double *right,
+                           double *out, size_t num_rows){
+  //Plain loops over contiguous arrays so the compiler can vectorize each operation
+  switch(instruction.op){
+  case Op::negate:
+    for(size_t i = 0; i < num_rows; ++i) out[i] = -left[i];
+    break;
+  case Op::logical_not:
+    for(size_t i = 0; i < num_rows; ++i) out[i] = left[i] == 0.;
+    break;
+  case Op::add:
+    for(size_t i = 0; i < num_rows; ++i) out[i] = left[i] + right[i];
+    break;
+  case Op::subtract:
+    for(size_t i = 0; i < num_rows; ++i) out[i] = left[i] - right[i];
+    break;
+  case Op::multiply:
+    for(size_t i = 0; i < num_rows; ++i) out[i] = left[i] * right[i];
+    break;
+  case Op::divide:
+    //TTreeFormula evaluates division by zero to 0, which baselines like met/met_calo<5. rely on
+    for(size_t i = 0; i < num_rows; ++i) out[i] = right[i] == 0. ? 0. : left[i] / right[i];
+    break;
+  case Op::less:
+    for(size_t i = 0; i < num_rows; ++i) out[i] = left[i] < right[i];
+    break;
+  case Op::less_equal:
+    for(size_t i = 0; i < num_rows; ++i) out[i] = left[i] <= right[i];
+    break;
+  case Op::greater:
+    for(size_t i = 0; i < num_rows; ++i) out[i] = left[i] > right[i];
+    break;
+  case Op::greater_equal:
+    for(size_t i = 0; i < num_rows; ++i) out[i] = left[i] >= right[i];
+    break;
+  case Op::equal:
+    for(size_t i = 0; i < num_rows; ++i) out[i] = left[i] == right[i];
+    break;
+  case Op::not_equal:
+    for(size_t i = 0; i < num_rows; ++i) out[i] = left[i] != right[i];
+    break;
+  case Op::logical_and:
+    for(size_t i = 0; i < num_rows; ++i) out[i] = (left[i] != 0.) & (right[i] != 0.);
+    break;
+  case Op::logical_or:
+    for(size_t i = 0; i < num_rows; ++i) out[i] = (left[i] != 0.) | (right[i] != 0.);
+    break;
+  case Op::constant:
+  case Op::variable:
+  default:
+    ERROR("Cannot execute instruction "+to_string(static_cast<int>(instruction.op)));
+  }
+}
@@ -0,0 +1,151 @@
+#include "cut_expression.hpp"
+
+#include <cctype>
+#include <cstdlib>
+#include <string>
+#include <vector>
+#include <algorithm>
+
+#include "utilities.hpp"
+
+using namespace std;
+
+CutExpression::CutExpression(const Cut &cut):
+  cut_(static_cast<string>(cut)),
+  pos_(0),
+  variables_(),
+  root_(){
+  root_ = ParseOr();
+  if(pos_ != cut_.size()){
+    ERROR("Unsupported expression at position "+to_string(pos_)+" of "+cut_);
+  }
+}
+
+const vector<string> & CutExpression::Variables() const{
+  return variables_;
+}
+
+const CutExpression::NodePtr & CutExpression::Root() const{
+  return root_;
+}
+
+CutExpression::NodePtr CutExpression::ParseOr(){
+  NodePtr node = ParseAnd();
+  while(Accept("||")) node = MakeNode(Op::logical_or, node, ParseAnd());
+  return node;
+}
+
+CutExpression::NodePtr CutExpression::ParseAnd(){
+  NodePtr node = ParseEquality();
+  while(Accept("&&")) node = MakeNode(Op::logical_and, node, ParseEquality());
+  return node;
+}
+
+CutExpression::NodePtr CutExpression::ParseEquality(){
+  NodePtr node = ParseRelational();
+  while(true){
+    if(Accept("==")) node = MakeNode(Op::equal, node, ParseRelational());
+    else if(Accept("!=")) node = MakeNode(Op::not_equal, node, ParseRelational());
+    else return node;
+  }
+}
+
+CutExpression::NodePtr CutExpression::ParseRelational(){
+  NodePtr node = ParseSum();
+  while(true){
+    if(Accept("<=")) node = MakeNode(Op::less_equal, node, ParseSum());
+    else if(Accept(">=")) node = MakeNode(Op::greater_equal, node, ParseSum());
+    else if(Accept("<")) node = MakeNode(Op::less, node, ParseSum());
+    else if(Accept(">")) node = MakeNode(Op::greater, node, ParseSum());
+    else return node;
+  }
+}
+
+CutExpression::NodePtr CutExpression::ParseSum(){
+  NodePtr node = ParseProduct();
+  while(true){
+    if(Accept("+")) node = MakeNode(Op::add, node, ParseProduct());
+    else if(Accept("-")) node = MakeNode(Op::subtract, node, ParseProduct());
+    else return node;
+  }
+}
+
+CutExpression::NodePtr CutExpression::ParseProduct(){
+  NodePtr node = ParseUnary();
+  while(true){
+    if(Accept("*")) node = MakeNode(Op::multiply, node, ParseUnary());
+    else if(Accept("/")) node = MakeNode(Op::divide, node, ParseUnary());
+    else return node;
+  }
+}
+
+CutExpression::NodePtr CutExpression::ParseUnary(){
+  if(Accept("!")) return MakeNode(Op::logical_not, ParseUnary());
+  if(Accept("-")) return MakeNode(Op::negate, ParseUnary());
+  if(Accept("+")) return ParseUnary();
+  return ParsePrimary();
+}
+
+CutExpression::NodePtr CutExpression::ParsePrimary(){
+  if(Accept("(")){
+    NodePtr node = ParseOr();
+    if(!Accept(")")) ERROR("Missing ) at position "+to_string(pos_)+" of "+cut_);
+    return node;
+  }
+  if(pos_ >= cut_.size()) ERROR("Unexpected end of "+cut_);
+
+  char c = cut_.at(pos_);
+  if(isdigit(c) || c == '.'){
+    const char *begin = cut_.c_str()+pos_;
+    char *end = nullptr;
+    double value = strtod(begin, &end);
+    if(end == begin) ERROR("Bad number at position "+to_string(pos_)+" of "+cut_);
+    pos_ += end-begin;
+    auto node = make_shared<Node>();
+    node->op = Op::constant;
+    node->value = value;
+    return node;
+  }
+  if(isalpha(c) || c == '_'){
+    size_t end = pos_;
+    while(end < cut_.size() && (isalnum(cut_.at(end)) || cut_.at(end) == '_')) ++end;
+    string name = cut_.substr(pos_, end-pos_);
+    pos_ = end;
+    //Functions, arrays and TTreeFormula specials (Sum$, Max$, ...) are left to ROOT
+    if(pos_ < cut_.size() && (cut_.at(pos_) == '(' || cut_.at(pos_) == '['
+                              || cut_.at(pos_) == '$' || cut_.at(pos_) == '.')){
+      ERROR("Unsupported function or array "+name+" in "+cut_);
+    }
+    auto node = make_shared<Node>();
+    node->op = Op::variable;
+    node->ivar = VariableIndex(name);
+    return node;
+  }
+  ERROR("Unsupported character "+string(1, c)+" in "+cut_);
+}
+
+bool CutExpression::Accept(const string &token){
+  if(cut_.compare(pos_, token.size(), token) != 0) return false;
+  //Keep < from matching the start of <=, and likewise for > and !
+  size_t next = pos_+token.size();
+  if((token == "<" || token == ">" || token == "!") && next < cut_.size() && cut_.at(next) == '=') return false;
+  pos_ = next;
+  return true;
+}
+
+size_t CutExpression::VariableIndex(const string &name){
+  auto var = find(variables_.cbegin(), variables_.cend(), name);
+  if(var != variables_.cend()) return var - variables_.cbegin();
+  variables_.push_back(name);
+  return variables_.size()-1;
+}
+
+CutExpression::NodePtr CutExpression::MakeNode(Op op, const NodePtr &left, const NodePtr &right){
+  auto node = make_shared<Node>();
+  node->op = op;
+  node->value = 0.;
+  node->ivar = 0;
+  node->left = left;
+  node->right = right;
+  return node;
+}
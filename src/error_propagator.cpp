@@ -0,0 +1,159 @@
+#include "error_propagator.hpp"
+
+#include <cmath>
+
+#include <string>
+#include <vector>
+#include <map>
+#include <utility>
+
+#include "TIterator.h"
+#include "TMatrixDSym.h"
+
+#include "RooArgSet.h"
+#include "RooArgList.h"
+#include "RooRealVar.h"
+#include "RooAbsReal.h"
+
+#include "utilities.hpp"
+
+using namespace std;
+
+ErrorPropagator::ErrorPropagator(RooWorkspace &w, const RooFitResult &f):
+  index_(),
+  shifts_(),
+  correlation_(),
+  errors_(){
+  //Every function and floating variable in the workspace
+  vector<string> names;
+  RooArgSet funcs = w.allFunctions();
+  TIter iter(funcs.createIterator());
+  int size = funcs.getSize();
+  TObject *obj = nullptr;
+  int i = 0;
+  while((obj = iter()) && i < size){
+    ++i;
+    if(obj == nullptr) continue;
+    Append(names, string(obj->GetName()));
+  }
+  iter.Reset();
+  RooArgSet vars = w.allVars();
+  TIter var_iter(vars.createIterator());
+  size = vars.getSize();
+  RooRealVar *var = nullptr;
+  i = 0;
+  while((var = static_cast<RooRealVar*>(var_iter())) && i < size){
+    ++i;
+    if(var == nullptr || var->isConstant()) continue;
+    Append(names, string(var->GetName()));
+  }
+  var_iter.Reset();
+  Propagate(w, f, names);
+}
+
+ErrorPropagator::ErrorPropagator(RooWorkspace &w, const RooFitResult &f,
+                                 const vector<string> &names):
+  index_(),
+  shifts_(),
+  correlation_(),
+  errors_(){
+  Propagate(w, f, names);
+}
+
+double ErrorPropagator::GetError(const string &name) const{
+  return errors_.at(Index(name));
+}
+
+double ErrorPropagator::GetError(const RooAbsArg &arg) const{
+  return GetError(string(arg.GetName()));
+}
+
+double ErrorPropagator::GetCovariance(const string &name_a, const string &name_b) const{
+  return Covariance(Index(name_a), Index(name_b));
+}
+
+size_t ErrorPropagator::Index(const string &name) const{
+  auto loc = index_.find(name);
+  if(loc == index_.end()) ERROR("No propagated error for "+name);
+  return loc->second;
+}
+
+double ErrorPropagator::Covariance(size_t ifunc_a, size_t ifunc_b) const{
+  double sum = 0.;
+  for(const auto &a: shifts_.at(ifunc_a)){
+    for(const auto &b: shifts_.at(ifunc_b)){
+      sum += a.second*correlation_.at(a.first).at(b.first)*b.second;
+    }
+  }
+  return sum;
+}
+
+void ErrorPropagator::Propagate(RooWorkspace &w, const RooFitResult &f,
+                                const vector<string> &names){
+  vector<RooAbsReal*> funcs;
+  for(const auto &name: names){
+    if(index_.find(name) != index_.end()) continue;
+    RooAbsReal *func = w.function(name.c_str());
+    if(func == nullptr) func = w.var(name.c_str());
+    if(func == nullptr) ERROR("Could not find "+name+" in workspace");
+    index_[name] = funcs.size();
+    funcs.push_back(func);
+  }
+
+  //Row k of the Jacobian holds the one-sigma shifts of function k. A parameter is only
+  //moved once for all functions, and functions it does not reach keep their cached values
+  const RooArgList &fpf = f.floatParsFinal();
+  size_t num_params = fpf.getSize();
+  vector<vector<double> > jacobian(funcs.size(), vector<double>(num_params, 0.));
+  for(size_t ipar = 0; ipar < num_params; ++ipar){
+    const RooRealVar &fit_var = static_cast<const RooRealVar&>(fpf[ipar]);
+    RooRealVar *w_var = w.var(fit_var.GetName());
+    if(w_var == nullptr) continue;
+
+    double cenVal = fit_var.getVal();
+    double minVal = fit_var.getMin();
+    double maxVal = fit_var.getMax();
+    double downVal = cenVal-fabs(fit_var.getErrorLo());
+    double upVal = cenVal+fabs(fit_var.getErrorHi());
+    if(upVal-downVal >= maxVal-minVal){
+      //Error bars bigger than variable range
+      downVal = minVal;
+      upVal = maxVal;
+    }else if(downVal < minVal){
+      upVal += minVal - downVal;
+      downVal = minVal;
+    }else if(upVal > maxVal){
+      downVal -= upVal - maxVal;
+      upVal = maxVal;
+    }
+
+    double old_val = w_var->getVal();
+    w_var->setVal(upVal);
+    for(size_t ifunc = 0; ifunc < funcs.size(); ++ifunc){
+      jacobian.at(ifunc).at(ipar) = funcs.at(ifunc)->getVal();
+    }
+    w_var->setVal(downVal);
+    for(size_t ifunc = 0; ifunc < funcs.size(); ++ifunc){
+      jacobian.at(ifunc).at(ipar) = 0.5*(jacobian.at(ifunc).at(ipar)-funcs.at(ifunc)->getVal());
+    }
+    w_var->setVal(old_val);
+  }
+
+  //Each function depends on few parameters, so only its nonzero shifts enter J.rho.J^T
+  const TMatrixDSym &corr = f.correlationMatrix();
+  correlation_.assign(num_params, vector<double>(num_params, 0.));
+  for(size_t i = 0; i < num_params; ++i){
+    for(size_t j = 0; j < num_params; ++j){
+      correlation_.at(i).at(j) = corr(i, j);
+    }
+  }
+  shifts_.assign(funcs.size(), vector<pair<size_t, double> >());
+  errors_.assign(funcs.size(), 0.);
+  for(size_t ifunc = 0; ifunc < funcs.size(); ++ifunc){
+    for(size_t ipar = 0; ipar < num_params; ++ipar){
+      double shift = jacobian.at(ifunc).at(ipar);
+      if(shift != 0.) shifts_.at(ifunc).push_back(make_pair(ipar, shift));
+    }
+    errors_.at(ifunc) = sqrt(Covariance(ifunc, ifunc));
+  }
+}
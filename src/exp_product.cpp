@@ -0,0 +1,36 @@
+#include "exp_product.hpp"
+
+#include <cmath>
+
+ClassImp(ExpProduct)
+
+ExpProduct::ExpProduct():
+  RooAbsReal(),
+  factors_(){
+}
+
+ExpProduct::ExpProduct(const char *name, const char *title, const RooArgList &factors):
+  RooAbsReal(name, title),
+  factors_("factors", "factors", this){
+  factors_.add(factors);
+}
+
+ExpProduct::ExpProduct(const ExpProduct &other, const char *name):
+  RooAbsReal(other, name),
+  factors_("factors", this, other.factors_){
+}
+
+ExpProduct::~ExpProduct(){
+}
+
+TObject * ExpProduct::clone(const char *new_name) const{
+  return new ExpProduct(*this, new_name);
+}
+
+Double_t ExpProduct::evaluate() const{
+  double product = 1.;
+  for(int i = 0; i < factors_.getSize(); ++i){
+    product *= static_cast<const RooAbsReal&>(factors_[i]).getVal();
+  }
+  return std::exp(product);
+}
@@ -33,6 +33,7 @@
 
 #include "utilities.hpp"
 #include "styles.hpp"
+#include "error_propagator.hpp"
 
 using namespace std;
 
@@ -137,6 +138,7 @@ void PrintDebug(RooWorkspace &w,
 
   vector<string> var_names = GetVarNames(w);
   vector<string> func_names = GetFuncNames(w);
+  ErrorPropagator errors(w, f);
 
   ofstream out(file_name);
   out << "\\documentclass{article}\n";
@@ -152,7 +154,7 @@ void PrintDebug(RooWorkspace &w,
     RooRealVar *varo = w.var(var.c_str());
     if(varo == nullptr) continue;
     if(!varo->isConstant()){
-      out << TexFriendly(var) << " & $" << varo->getVal() << "\\pm" << GetError(*varo, f) << "$\\\\\n";
+      out << TexFriendly(var) << " & $" << varo->getVal() << "\\pm" << errors.GetError(*varo) << "$\\\\\n";
     }else{
       out << TexFriendly(var) << " & $" << varo->getVal() << "$\\\\\n";
     }
@@ -161,7 +163,7 @@ void PrintDebug(RooWorkspace &w,
     RooAbsReal *funco = w.function(func.c_str());
     if(funco == nullptr) continue;
     if(!funco->isConstant()){
-      out << TexFriendly(func) << " & $" << funco->getVal() << "\\pm" << GetError(*funco, f) << "$\\\\\n";
+      out << TexFriendly(func) << " & $" << funco->getVal() << "\\pm" << errors.GetError(*funco) << "$\\\\\n";
     }else{
       out << TexFriendly(func) << " & $" << funco->getVal() << "$\\\\\n";
     }
@@ -183,6 +185,7 @@ void PrintTable(RooWorkspace &w,
   string sig_name = GetSignalName(w);
   vector<string> prc_names = GetProcessNames(w);
   vector<string> bin_names = GetPlainBinNames(w);
+  ErrorPropagator errors(w, f);
 
   bool dosig(Contains(file_name, "sig_table")), blind_all(Contains(file_name, "r4blinded"));
   bool blind_2b(Contains(file_name, "1bunblinded"));
@@ -243,17 +246,17 @@ void PrintTable(RooWorkspace &w,
       out << GetMCYield(w, bin_name, prc_name) << " & ";
     }
     out << "$" << GetMCTotal(w, bin_name);
-    if(!table_clean) out << "\\pm" << GetMCTotalErr(w, f, bin_name);
+    if(!table_clean) out << "\\pm" << GetMCTotalErr(w, errors, bin_name);
     out <<  "$ & ";
 
-    if(dosig) out << "$" << GetBkgPred(w, bin_name) << "\\pm" << GetBkgPredErr(w, f, bin_name) <<  "$ & ";
+    if(dosig) out << "$" << GetBkgPred(w, bin_name) << "\\pm" << GetBkgPredErr(w, errors, bin_name) <<  "$ & ";
     out << GetMCYield(w, bin_name, sig_name) << " & ";
-    if(dosig) out << "$" << GetSigPred(w, bin_name) << "\\pm" << GetSigPredErr(w, f, bin_name) <<  "$ & ";
+    if(dosig) out << "$" << GetSigPred(w, bin_name) << "\\pm" << GetSigPredErr(w, errors, bin_name) <<  "$ & ";
     if(Contains(bin_name,"r4")){
       double kappa = GetKappaSys(w, bin_name);
       double kappa_nosys = GetKappaNoSys(w, bin_name);
-      double stat_err = GetKappaNoSysErr(w, f, bin_name)*kappa/kappa_nosys;
-      double full_err = GetKappaSysErr(w, f, bin_name);
+      double stat_err = GetKappaNoSysErr(w, errors, bin_name)*kappa/kappa_nosys;
+      double full_err = GetKappaSysErr(w, errors, bin_name);
       double sys_err = 0.;
       if(full_err >= stat_err){
 	double ratio = stat_err/full_err;
@@ -267,14 +270,14 @@ void PrintTable(RooWorkspace &w,
       out << " & ";
     }
     if(Contains(bin_name,"r4") || do_global){
-      out << "$" << GetTotPred(w, bin_name) << "\\pm" << GetTotPredErr(w, f, bin_name) <<  "$ & ";
+      out << "$" << GetTotPred(w, bin_name) << "\\pm" << GetTotPredErr(w, errors, bin_name) <<  "$ & ";
     }else{
       out << " & ";
     }
     if(Contains(bin_name,"4") && (blind_all || (!Contains(bin_name,"1b") && blind_2b))) out << "-- & ";
     else out << setprecision(0) << GetObserved(w, bin_name);
     out << setprecision(digits);
-    if(!table_clean) out << "& $" << GetLambda(w, bin_name) << "\\pm" << GetLambdaErr(w, f, bin_name) <<  "$";
+    if(!table_clean) out << "& $" << GetLambda(w, bin_name) << "\\pm" << GetLambdaErr(w, errors, bin_name) <<  "$";
     out << "\\\\\n";
     if(Contains(bin_name, "r3") || Contains(bin_name, "d3")) out << "\\hline"<<endl;
   }
@@ -329,8 +332,8 @@ double GetMCTotal(const RooWorkspace &w,
   return -1.;
 }
 
-double GetMCTotalErr(RooWorkspace &w,
-                     const RooFitResult &f,
+double GetMCTotalErr(const RooWorkspace &w,
+                     const ErrorPropagator &errors,
                      const string &bin_name){
   RooArgSet funcs = w.allFunctions();
   TIter iter(funcs.createIterator());
@@ -344,7 +347,7 @@ double GetMCTotalErr(RooWorkspace &w,
     if(name.substr(0,8) != "ymc_BLK_") continue;
     if(!(Contains(name, "_BIN_"+bin_name))) continue;
     if(Contains(name, "_PRC_")) continue;
-    return GetError(*static_cast<RooAbsReal*>(arg), f);
+    return errors.GetError(*arg);
   }
   iter.Reset();
   return -1.;
@@ -370,8 +373,8 @@ double GetBkgPred(const RooWorkspace &w,
   return -1.;
 }
 
-double GetBkgPredErr(RooWorkspace &w,
-                     const RooFitResult &f,
+double GetBkgPredErr(const RooWorkspace &w,
+                     const ErrorPropagator &errors,
                      const string &bin_name){
   RooArgSet funcs = w.allFunctions();
   TIter iter(funcs.createIterator());
@@ -385,7 +388,7 @@ double GetBkgPredErr(RooWorkspace &w,
     if(name.substr(0,9) != "nbkg_BLK_") continue;
     if(!(Contains(name, "_BIN_"+bin_name))) continue;
     if(Contains(name, "_PRC_")) continue;
-    return GetError(*static_cast<RooAbsReal*>(arg), f);
+    return errors.GetError(*arg);
   }
   iter.Reset();
   return -1.;
@@ -411,8 +414,8 @@ double GetSigPred(const RooWorkspace &w,
   return -1.;
 }
 
-double GetSigPredErr(RooWorkspace &w,
-                     const RooFitResult &f,
+double GetSigPredErr(const RooWorkspace &w,
+                     const ErrorPropagator &errors,
                      const string &bin_name){
   RooArgSet funcs = w.allFunctions();
   TIter iter(funcs.createIterator());
@@ -426,7 +429,7 @@ double GetSigPredErr(RooWorkspace &w,
     if(name.substr(0,9) != "nsig_BLK_") continue;
     if(!(Contains(name, "_BIN_"+bin_name))) continue;
     if(Contains(name, "_PRC_")) continue;
-    return GetError(*static_cast<RooAbsReal*>(arg), f);
+    return errors.GetError(*arg);
   }
   iter.Reset();
   return -1.;
@@ -452,8 +455,8 @@ double GetTotPred(const RooWorkspace &w,
   return -1.;
 }
 
-double GetTotPredErr(RooWorkspace &w,
-                     const RooFitResult &f,
+double GetTotPredErr(const RooWorkspace &w,
+                     const ErrorPropagator &errors,
                      const string &bin_name){
   RooArgSet funcs = w.allFunctions();
   TIter iter(funcs.createIterator());
@@ -467,7 +470,7 @@ double GetTotPredErr(RooWorkspace &w,
     if(name.substr(0,9) != "nexp_BLK_") continue;
     if(!(Contains(name, "_BIN_"+bin_name))) continue;
     if(Contains(name, "_PRC_")) continue;
-    return GetError(*static_cast<RooAbsReal*>(arg), f);
+    return errors.GetError(*arg);
   }
   iter.Reset();
   return -1.;
@@ -510,8 +513,8 @@ double GetKappaNoSys(const RooWorkspace &w,
   return -1.;
 }
 
-double GetKappaNoSysErr(RooWorkspace &w,
-			const RooFitResult &f,
+double GetKappaNoSysErr(const RooWorkspace &w,
+			const ErrorPropagator &errors,
 			const string &bin_name){
   RooArgSet funcs = w.allFunctions();
   TIter iter(funcs.createIterator());
@@ -525,7 +528,7 @@ double GetKappaNoSysErr(RooWorkspace &w,
     if(name.substr(0,15) != "nosyskappa_BLK_") continue;
     if(!(Contains(name, "_BIN_"+bin_name))) continue;
     if(Contains(name, "_PRC_")) continue;
-    return GetError(*static_cast<RooAbsReal*>(arg), f);
+    return errors.GetError(*arg);
   }
   iter.Reset();
   return -1.;
@@ -551,8 +554,8 @@ double GetKappaSys(const RooWorkspace &w,
   return -1.;
 }
 
-double GetKappaSysErr(RooWorkspace &w,
-		      const RooFitResult &f,
+double GetKappaSysErr(const RooWorkspace &w,
+		      const ErrorPropagator &errors,
 		      const string &bin_name){
   RooArgSet funcs = w.allFunctions();
   TIter iter(funcs.createIterator());
@@ -566,7 +569,7 @@ double GetKappaSysErr(RooWorkspace &w,
     if(name.substr(0,13) != "syskappa_BLK_") continue;
     if(!(Contains(name, "_BIN_"+bin_name))) continue;
     if(Contains(name, "_PRC_")) continue;
-    return GetError(*static_cast<RooAbsReal*>(arg), f);
+    return errors.GetError(*arg);
   }
   iter.Reset();
   return -1.;
@@ -592,8 +595,8 @@ double GetLambda(const RooWorkspace &w,
   return -1.;
 }
 
-double GetLambdaErr(RooWorkspace &w,
-                    const RooFitResult &f,
+double GetLambdaErr(const RooWorkspace &w,
+                    const ErrorPropagator &errors,
                     const string &bin_name){
   RooArgSet funcs = w.allFunctions();
   TIter iter(funcs.createIterator());
@@ -607,7 +610,7 @@ double GetLambdaErr(RooWorkspace &w,
     if(name.substr(0,12) != "kappamc_BLK_") continue;
     if(!(Contains(name, "_BIN_"+bin_name))) continue;
     if(Contains(name, "_PRC_")) continue;
-    return GetError(*static_cast<RooAbsReal*>(arg), f);
+    return errors.GetError(*arg);
   }
   iter.Reset();
   return -1.;
@@ -741,7 +744,7 @@ void MakeYieldPlot(RooWorkspace &w,
   }else if(r_var->isConstant()){
     oss << r_var->getVal() << " (fixed)";
   }else{
-    oss << r_var->getVal() << "#pm" << GetError(*r_var, f);
+    oss << r_var->getVal() << "#pm" << ErrorPropagator(w, f, {r_var->GetName()}).GetError(*r_var);
   }
   oss << flush;
   l.AddEntry(&obs, oss.str().c_str(), "");
@@ -983,6 +986,12 @@ TH1D MakeTotalHisto(RooWorkspace &w,
   h.SetLineWidth(0);
   h.SetMinimum(0.03);
 
+  vector<string> yield_names;
+  for(const auto &name: bin_names){
+    if(w.function(("nexp_"+name).c_str()) != nullptr) yield_names.push_back("nexp_"+name);
+  }
+  ErrorPropagator errors(w, f, yield_names);
+
   for(size_t ibin = 0; ibin < bin_names.size(); ++ibin){
     const string &name = bin_names.at(ibin);
     auto pos = name.find("_BIN_");
@@ -992,7 +1001,7 @@ TH1D MakeTotalHisto(RooWorkspace &w,
     RooRealVar *var = static_cast<RooRealVar*>(w.function(("nexp_"+name).c_str()));
     if(var == nullptr) continue;
     h.SetBinContent(ibin+1, var->getVal());
-    h.SetBinError(ibin+1, GetError(*var, f));
+    h.SetBinError(ibin+1, errors.GetError(*var));
   }
 
   return h;
@@ -1163,6 +1172,12 @@ void MakeCorrectionPlot(RooWorkspace &w,
   TCanvas c("can","");
   c.cd();
 
+  vector<string> lambda_names;
+  for(const auto &bin: bin_names){
+    lambda_names.push_back("kappamc_"+bin);
+  }
+  ErrorPropagator errors(w, f, lambda_names);
+
   TH1D h("", ";;#lambda", bin_names.size(), 0.5, bin_names.size()+0.5);
   for(size_t ibin = 0; ibin < bin_names.size(); ++ibin){
     string bin = bin_names.at(ibin);
@@ -1170,7 +1185,7 @@ void MakeCorrectionPlot(RooWorkspace &w,
     string plain_bin = bin.substr(pos+5);
     h.GetXaxis()->SetBinLabel(ibin+1, plain_bin.c_str());
     h.SetBinContent(ibin+1, static_cast<RooRealVar*>(w.function(("kappamc_"+bin).c_str()))->getVal());
-    h.SetBinError(ibin+1, GetError(*w.function(("kappamc_"+bin).c_str()), f));
+    h.SetBinError(ibin+1, errors.GetError("kappamc_"+bin));
   }
   h.GetXaxis()->LabelsOption("V");
   h.Draw();
@@ -1182,7 +1197,6 @@ void MakeCovarianceMatrix(RooWorkspace &w,
 			  const RooFitResult &f,
 			  string covar_file_name){
   SetVariables(w, f);
-  const RooArgList &fpf = f.floatParsFinal();
 
   vector<RooAbsReal*> yields;
   RooArgSet funcs = w.allFunctions();
@@ -1201,56 +1215,16 @@ void MakeCovarianceMatrix(RooWorkspace &w,
     yields.push_back(arg);
   }
 
-  vector<vector<double> > errors(fpf.getSize(), vector<double>(yields.size(), 0.));
-  for(Int_t iparam = 0; iparam<fpf.getSize(); ++iparam){
-    RooRealVar &rrv = static_cast<RooRealVar&>(*w.var(fpf.at(iparam)->GetName()));
-
-    double cenVal = rrv.getVal();
-    double minVal = rrv.getMin();
-    double maxVal = rrv.getMax();
-    double downVal = cenVal-fabs(rrv.getErrorLo());
-    double upVal = cenVal+fabs(rrv.getErrorHi());
-    if(upVal-downVal >= maxVal-minVal){
-      //Error bars bigger than variable range
-      downVal = minVal;
-      upVal = maxVal;
-    }else if(downVal < minVal){
-      upVal += minVal - downVal;
-      downVal = minVal;
-    }else if(upVal > maxVal){
-      downVal -= upVal - maxVal;
-      upVal = maxVal;
-    }
-
-    rrv.setVal(upVal);
-    for(size_t iyield = 0; iyield<yields.size(); ++iyield){
-      errors.at(iparam).at(iyield) = 0.5*yields.at(iyield)->getVal();
-    }
-    rrv.setVal(downVal);
-    for(size_t iyield = 0; iyield<yields.size(); ++iyield){
-      errors.at(iparam).at(iyield) -= 0.5*yields.at(iyield)->getVal();
-    }
-    rrv.setVal(cenVal);
-  }
-
-  vector<vector<double> > right(fpf.getSize(), vector<double>(yields.size(), 0.));
-  for(Int_t iparam = 0; iparam<fpf.getSize(); ++iparam){
-    for(size_t iyield = 0; iyield<yields.size(); ++iyield){
-      right.at(iparam).at(iyield) = 0.;
-      for(Int_t entry = 0; entry<fpf.getSize(); ++entry){
-	right.at(iparam).at(iyield) += f.correlation(fpf.at(iparam)->GetName(),fpf.at(entry)->GetName())
-	  * errors.at(entry).at(iyield);
-      }
-    }
+  vector<string> yield_names;
+  for(const auto &yield: yields){
+    yield_names.push_back(yield->GetName());
   }
+  ErrorPropagator errors(w, f, yield_names);
 
   vector<vector<double> > covar(yields.size(), vector<double>(yields.size(), 0.));
   for(size_t irow = 0; irow < yields.size(); ++irow){
-    for(size_t icol = 0.; icol < yields.size(); ++icol){
-      covar.at(irow).at(icol) = 0.;
-      for(Int_t ientry = 0.; ientry < fpf.getSize(); ++ientry){
-	covar.at(irow).at(icol) += errors.at(ientry).at(irow) * right.at(ientry).at(icol);
-      }
+    for(size_t icol = 0; icol < yields.size(); ++icol){
+      covar.at(irow).at(icol) = errors.GetCovariance(yield_names.at(irow), yield_names.at(icol));
     }
   }
 
@@ -1348,87 +1322,6 @@ void MakeCovarianceMatrix(RooWorkspace &w,
   cout<<"Saved correlation matrix in "<<pname<<endl<<endl;
 }
 
-double GetError(const RooAbsReal &var,
-                const RooFitResult &f){
-  // Clone self for internal use
-  RooAbsReal* cloneFunc = static_cast<RooAbsReal*>(var.cloneTree());
-  RooArgSet* errorParams = cloneFunc->getObservables(f.floatParsFinal());
-  RooArgSet* nset = cloneFunc->getParameters(*errorParams);
-
-  // Make list of parameter instances of cloneFunc in order of error matrix
-  RooArgList paramList;
-  const RooArgList& fpf = f.floatParsFinal();
-  vector<int> fpf_idx;
-  for (int i=0; i<fpf.getSize(); i++) {
-    RooAbsArg* par = errorParams->find(fpf[i].GetName());
-    if (par) {
-      paramList.add(*par);
-      fpf_idx.push_back(i);
-    }
-  }
-
-  vector<double> errors(paramList.getSize());
-  for (Int_t ivar=0; ivar<paramList.getSize(); ivar++) {
-    RooRealVar& rrv = static_cast<RooRealVar&>(fpf[fpf_idx[ivar]]);
-
-    double cenVal = rrv.getVal();
-    double minVal = rrv.getMin();
-    double maxVal = rrv.getMax();
-    double downVal = cenVal-fabs(rrv.getErrorLo());
-    double upVal = cenVal+fabs(rrv.getErrorHi());
-    if(upVal-downVal >= maxVal-minVal){
-      //Error bars bigger than variable range
-      downVal = minVal;
-      upVal = maxVal;
-    }else if(downVal < minVal){
-      upVal += minVal - downVal;
-      downVal = minVal;
-    }else if(upVal > maxVal){
-      downVal -= upVal - maxVal;
-      upVal = maxVal;
-    }
-
-    // Make Plus variation
-    static_cast<RooRealVar*>(paramList.at(ivar))->setVal(upVal);
-    double up = cloneFunc->getVal(nset);
-
-    // Make Minus variation
-    static_cast<RooRealVar*>(paramList.at(ivar))->setVal(downVal);
-    double down = cloneFunc->getVal(nset);
-
-    errors.at(ivar) = 0.5*(up-down);
-
-    static_cast<RooRealVar*>(paramList.at(ivar))->setVal(cenVal);
-  }
-
-  vector<double> right(errors.size());
-  for(size_t i = 0; i < right.size(); ++i){
-    right.at(i) = 0.;
-    for(size_t j = 0; j < errors.size(); ++j){
-      right.at(i) += f.correlation(paramList.at(i)->GetName(),paramList.at(j)->GetName())*errors.at(j);
-    }
-  }
-  double sum = 0.;
-  for(size_t i = 0; i < right.size(); ++i){
-    sum += errors.at(i)*right.at(i);
-  }
-
-  if(cloneFunc != nullptr){
-    delete cloneFunc;
-    cloneFunc = nullptr;
-  }
-  if(errorParams != nullptr){
-    delete errorParams;
-    errorParams = nullptr;
-  }
-  if(nset != nullptr){
-    delete nset;
-    nset = nullptr;
-  }
-
-  return sqrt(sum);
-}
-
 string PrettyBinName(string name){
   ReplaceAll(name, "r1_", "R1: ");
   ReplaceAll(name, "r2_", "R2: ");
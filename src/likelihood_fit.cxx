@@ -13,16 +13,22 @@
 #include "RooMinuit.h"
 #include "RooFitResult.h"
 
+#include "utilities.hpp"
+#include "compact_model.hpp"
+#include "compact_fitter.hpp"
+
 using namespace std;
 
 namespace{
   string file_path = "wspace_nosyst_nokappa_nor4_T1tttt_mGluino-1700_mLSP-100_xsecNom.root";
+  bool native = false;
 }
 
 void GetOptions(int argc, char *argv[]){
   while(true){
     static struct option long_options[] = {
       {"file", required_argument, 0, 'f'},
+      {"native", no_argument, 0, 0},
       {0, 0, 0, 0}
     };
 
@@ -39,7 +45,8 @@ void GetOptions(int argc, char *argv[]){
       break;
     case 0:
       optname = long_options[option_index].name;
-      if(false){
+      if(optname == "native"){
+        native = true;
       }else{
         printf("Bad option! Found option name %s\n", optname.c_str());
       }
@@ -53,6 +60,20 @@ void GetOptions(int argc, char *argv[]){
 int main(int argc, char *argv[]){
   GetOptions(argc, argv);
 
+  if(native){
+    CompactModel model(ChangeExtension(file_path, ".model"));
+    CompactFitter fitter(model, "model_b");
+    CompactFitter::Result result = fitter.Minimize();
+    cout << "NLL=" << result.nll << ", EDM=" << result.edm
+         << ", iterations=" << result.iterations << ", NLL calls=" << result.nll_calls
+         << (result.converged ? ", converged" : ", NOT converged") << endl;
+    for(size_t i = 0; i < result.names.size(); ++i){
+      cout << result.names.at(i) << " = " << result.values.at(i)
+           << " +- " << result.errors.at(i) << endl;
+    }
+    return result.converged ? 0 : 1;
+  }
+
   TFile in_file(file_path.c_str(), "read");
   RooWorkspace *w = static_cast<RooWorkspace*>(in_file.Get("w"));
   RooDataSet *data_obs = static_cast<RooDataSet*>(w->data("data_obs"));
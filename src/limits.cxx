@@ -0,0 +1,80 @@
+#include "limits.hpp"
+
+#include <cstdio>
+#include <cstdlib>
+
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <limits>
+
+#include <unistd.h>
+#include <getopt.h>
+
+#include "compact_model.hpp"
+#include "asymptotic_limits.hpp"
+#include "utilities.hpp"
+
+using namespace std;
+
+namespace{
+  string file_name = "";
+  string pdf_name = "model_s";
+  string poi_name = "r";
+}
+
+int main(int argc, char *argv[]){
+  GetOptions(argc, argv);
+  if(file_name == ""){
+    cout << "Usage: limits.exe -f wspace.root [-p model_s] [--poi r]" << endl;
+    return 1;
+  }
+
+  //The compact model written by WorkspaceGenerator next to the workspace
+  AsymptoticLimits limits(CompactModel(ChangeExtension(file_name, ".model")), pdf_name, poi_name);
+
+  //Same quantiles, in the same order, as the limit tree of combine -M Asymptotic
+  cout << setprecision(numeric_limits<double>::max_digits10);
+  for(const auto &quantile: {0.025, 0.16, 0.5, 0.84, 0.975}){
+    cout << "Expected limit " << quantile << ": "
+         << limits.ExpectedLimit(AsymptoticLimits::NormalQuantile(quantile)) << endl;
+  }
+  cout << "Observed limit: " << limits.ObservedLimit() << endl;
+}
+
+void GetOptions(int argc, char *argv[]){
+  while(true){
+    static struct option long_options[] = {
+      {"filename", required_argument, 0, 'f'},
+      {"pdf", required_argument, 0, 'p'},
+      {"poi", required_argument, 0, 0},
+      {0, 0, 0, 0}
+    };
+
+    char opt = -1;
+    int option_index;
+    opt = getopt_long(argc, argv, "f:p:", long_options, &option_index);
+    if( opt == -1) break;
+
+    string optname;
+    switch(opt){
+    case 'f':
+      file_name = optarg;
+      break;
+    case 'p':
+      pdf_name = optarg;
+      break;
+    case 0:
+      optname = long_options[option_index].name;
+      if(optname == "poi"){
+        poi_name = optarg;
+      }else{
+        printf("Bad option! Found option name %s\n", optname.c_str());
+      }
+      break;
+    default:
+      printf("Bad option! getopt_long returned character code 0%o\n", opt);
+      break;
+    }
+  }
+}
@@ -37,6 +37,9 @@ namespace{
   string himet("400");
   string mjthresh("400");
   unsigned n_toys = 0;
+  uint64_t toy_seed = 0;
+  bool fixed_toy_seed = false;
+  bool split_toys = false;
   string identifier = "";
 }
 
@@ -288,6 +291,8 @@ int main(int argc, char *argv[]){
   wgc.SetLuminosity(lumi);
   wgc.SetDoDilepton(false); // Applying dilep syst in text file
   wgc.SetDoSystematics(do_syst);
+  wgc.SetSplitToys(split_toys);
+  if(fixed_toy_seed) wgc.SetToySeed(toy_seed);
   wgc.AddToys(n_toys);
   ReplaceAll(outname, "_nc_", "_c_");
   wgc.WriteToFile(outname);
@@ -300,6 +305,8 @@ int main(int argc, char *argv[]){
   wgnc.SetLuminosity(lumi);
   wgnc.SetDoDilepton(false); // Applying dilep syst in text file
   wgnc.SetDoSystematics(do_syst);
+  wgnc.SetSplitToys(split_toys);
+  if(fixed_toy_seed) wgnc.SetToySeed(toy_seed);
   wgnc.AddToys(n_toys);
   ReplaceAll(outname, "_c_", "_nc_");
   wgnc.WriteToFile(outname);
@@ -319,6 +326,8 @@ void GetOptions(int argc, char *argv[]){
       {"method", required_argument, 0, 't'},
       {"use_r4", no_argument, 0, '4'},
       {"toys", required_argument, 0, 0},
+      {"toy_seed", required_argument, 0, 0},
+      {"split_toys", no_argument, 0, 0},
       {"sig_strength", required_argument, 0, 'g'},
       {"identifier", required_argument, 0, 'i'},
       {0, 0, 0, 0}
@@ -378,6 +387,11 @@ void GetOptions(int argc, char *argv[]){
         do_syst = false;
       }else if(optname == "toys"){
         n_toys = atoi(optarg);
+      }else if(optname == "toy_seed"){
+        toy_seed = stoul(optarg);
+        fixed_toy_seed = true;
+      }else if(optname == "split_toys"){
+        split_toys = true;
       }else{
         printf("Bad option! Found option name %s\n", optname.c_str());
       }
@@ -0,0 +1,166 @@
+#include "nll_kernel.hpp"
+
+#include <cmath>
+
+#include <limits>
+
+#if defined(__GNUC__) && defined(__x86_64__)
+#define NLL_KERNEL_AVX2 1
+#include <immintrin.h>
+#else
+#define NLL_KERNEL_AVX2 0
+#endif
+
+using namespace std;
+
+namespace{
+  const double log_sqrt_2pi = 0.5*log(2.*M_PI);
+
+#if NLL_KERNEL_AVX2
+  //Natural log of four positive, finite, normal doubles. Cephes' reduction to
+  //[sqrt(1/2), sqrt(2)) and rational approximation, good to a few ulp
+  __attribute__((target("avx2")))
+  __m256d Log4(__m256d x){
+    const __m256d one = _mm256_set1_pd(1.);
+    const __m256i bits = _mm256_castpd_si256(x);
+
+    //Exponent as a double, via the 2^52 trick, and mantissa in [0.5, 1)
+    __m256d e = _mm256_castsi256_pd(_mm256_or_si256(_mm256_srli_epi64(bits, 52),
+                                                    _mm256_set1_epi64x(0x4330000000000000)));
+    e = _mm256_sub_pd(e, _mm256_set1_pd(4503599627370496.+1022.));
+    __m256d m = _mm256_castsi256_pd(_mm256_or_si256(_mm256_and_si256(bits, _mm256_set1_epi64x(0x000fffffffffffff)),
+                                                    _mm256_set1_epi64x(0x3fe0000000000000)));
+
+    const __m256d small = _mm256_cmp_pd(m, _mm256_set1_pd(0.70710678118654752440), _CMP_LT_OQ);
+    e = _mm256_sub_pd(e, _mm256_and_pd(small, one));
+    m = _mm256_sub_pd(_mm256_add_pd(m, _mm256_and_pd(small, m)), one);
+
+    const __m256d z = _mm256_mul_pd(m, m);
+    __m256d p = _mm256_set1_pd(1.01875663804580931796E-4);
+    p = _mm256_add_pd(_mm256_mul_pd(p, m), _mm256_set1_pd(4.97494994976747001425E-1));
+    p = _mm256_add_pd(_mm256_mul_pd(p, m), _mm256_set1_pd(4.70579119878881725854E0));
+    p = _mm256_add_pd(_mm256_mul_pd(p, m), _mm256_set1_pd(1.44989225341610930846E1));
+    p = _mm256_add_pd(_mm256_mul_pd(p, m), _mm256_set1_pd(1.79368678507819816313E1));
+    p = _mm256_add_pd(_mm256_mul_pd(p, m), _mm256_set1_pd(7.70838733755885391666E0));
+    __m256d q = _mm256_add_pd(m, _mm256_set1_pd(1.12873587189167450590E1));
+    q = _mm256_add_pd(_mm256_mul_pd(q, m), _mm256_set1_pd(4.52279145837532221105E1));
+    q = _mm256_add_pd(_mm256_mul_pd(q, m), _mm256_set1_pd(8.29875266912776603211E1));
+    q = _mm256_add_pd(_mm256_mul_pd(q, m), _mm256_set1_pd(7.11544750618563894466E1));
+    q = _mm256_add_pd(_mm256_mul_pd(q, m), _mm256_set1_pd(2.31251620126765340583E1));
+
+    //log(2) is split in two so e*log(2) adds without rounding
+    __m256d y = _mm256_mul_pd(m, _mm256_div_pd(_mm256_mul_pd(z, p), q));
+    y = _mm256_sub_pd(y, _mm256_mul_pd(e, _mm256_set1_pd(2.121944400546905827679E-4)));
+    y = _mm256_sub_pd(y, _mm256_mul_pd(z, _mm256_set1_pd(0.5)));
+    return _mm256_add_pd(_mm256_add_pd(m, y), _mm256_mul_pd(e, _mm256_set1_pd(0.693359375)));
+  }
+
+  //Lanes with zero, negative, subnormal or non-finite values take the scalar path
+  __attribute__((target("avx2")))
+  bool AllNormal(__m256d x){
+    const __m256d ok = _mm256_and_pd(_mm256_cmp_pd(x, _mm256_set1_pd(numeric_limits<double>::min()), _CMP_GE_OQ),
+                                     _mm256_cmp_pd(x, _mm256_set1_pd(numeric_limits<double>::max()), _CMP_LE_OQ));
+    return _mm256_movemask_pd(ok) == 0xF;
+  }
+
+  __attribute__((target("avx2")))
+  double Sum4(__m256d x){
+    double lanes[4];
+    _mm256_storeu_pd(lanes, x);
+    return (lanes[0]+lanes[1])+(lanes[2]+lanes[3]);
+  }
+
+  __attribute__((target("avx2")))
+  double PoissonAVX2(const double *n, const double *log_factorial_n, const double *mu, size_t size){
+    __m256d sum = _mm256_setzero_pd();
+    double tail = 0.;
+    size_t i = 0;
+    for(; i+4 <= size; i += 4){
+      const __m256d mu4 = _mm256_loadu_pd(mu+i);
+      if(!AllNormal(mu4)){
+        for(size_t j = i; j < i+4; ++j) tail += NLLKernel::PoissonTerm(n[j], log_factorial_n[j], mu[j]);
+        continue;
+      }
+      const __m256d n4 = _mm256_loadu_pd(n+i);
+      const __m256d term = _mm256_sub_pd(_mm256_add_pd(mu4, _mm256_loadu_pd(log_factorial_n+i)),
+                                         _mm256_mul_pd(n4, Log4(mu4)));
+      sum = _mm256_add_pd(sum, term);
+    }
+    for(; i < size; ++i) tail += NLLKernel::PoissonTerm(n[i], log_factorial_n[i], mu[i]);
+    return Sum4(sum)+tail;
+  }
+
+  __attribute__((target("avx2")))
+  double GaussianAVX2(const double *x, const double *mean, const double *sigma, size_t size){
+    const __m256d half = _mm256_set1_pd(0.5);
+    const __m256d norm = _mm256_set1_pd(log_sqrt_2pi);
+    __m256d sum = _mm256_setzero_pd();
+    double tail = 0.;
+    size_t i = 0;
+    for(; i+4 <= size; i += 4){
+      const __m256d sigma4 = _mm256_loadu_pd(sigma+i);
+      if(!AllNormal(sigma4)){
+        for(size_t j = i; j < i+4; ++j) tail += NLLKernel::GaussianTerm(x[j], mean[j], sigma[j]);
+        continue;
+      }
+      const __m256d pull = _mm256_div_pd(_mm256_sub_pd(_mm256_loadu_pd(x+i), _mm256_loadu_pd(mean+i)), sigma4);
+      const __m256d term = _mm256_add_pd(_mm256_mul_pd(half, _mm256_mul_pd(pull, pull)),
+                                         _mm256_add_pd(Log4(sigma4), norm));
+      sum = _mm256_add_pd(sum, term);
+    }
+    for(; i < size; ++i) tail += NLLKernel::GaussianTerm(x[i], mean[i], sigma[i]);
+    return Sum4(sum)+tail;
+  }
+#endif
+}
+
+double NLLKernel::Poisson(const double *n, const double *log_factorial_n, const double *mu,
+                          size_t size){
+#if NLL_KERNEL_AVX2
+  if(HasAVX2()) return PoissonAVX2(n, log_factorial_n, mu, size);
+#endif
+  return PoissonScalar(n, log_factorial_n, mu, size);
+}
+
+double NLLKernel::Gaussian(const double *x, const double *mean, const double *sigma,
+                           size_t size){
+#if NLL_KERNEL_AVX2
+  if(HasAVX2()) return GaussianAVX2(x, mean, sigma, size);
+#endif
+  return GaussianScalar(x, mean, sigma, size);
+}
+
+double NLLKernel::PoissonScalar(const double *n, const double *log_factorial_n, const double *mu,
+                                size_t size){
+  double nll = 0.;
+  for(size_t i = 0; i < size; ++i) nll += PoissonTerm(n[i], log_factorial_n[i], mu[i]);
+  return nll;
+}
+
+double NLLKernel::GaussianScalar(const double *x, const double *mean, const double *sigma,
+                                 size_t size){
+  double nll = 0.;
+  for(size_t i = 0; i < size; ++i) nll += GaussianTerm(x[i], mean[i], sigma[i]);
+  return nll;
+}
+
+double NLLKernel::PoissonTerm(double n, double log_factorial_n, double mu){
+  //Matches RooPoisson without rounding and with negative means protected
+  if(mu < 0.) return -log(1e-3);
+  if(mu == 0.) return n == 0. ? 0. : numeric_limits<double>::infinity();
+  return mu-n*log(mu)+log_factorial_n;
+}
+
+double NLLKernel::GaussianTerm(double x, double mean, double sigma){
+  double pull = (x-mean)/sigma;
+  return 0.5*pull*pull+log(sigma)+log_sqrt_2pi;
+}
+
+bool NLLKernel::HasAVX2(){
+#if NLL_KERNEL_AVX2
+  static const bool has_avx2 = __builtin_cpu_supports("avx2");
+  return has_avx2;
+#else
+  return false;
+#endif
+}
@@ -1,10 +1,13 @@
 #include "plot_likelihood.hpp"
 
+#include <cmath>
+
 #include <iostream>
 #include <string>
 #include <stdexcept>
 #include <algorithm>
 #include <limits>
+#include <vector>
 
 #include <stdlib.h>
 #include <getopt.h>
@@ -22,6 +25,7 @@
 
 #include "utilities.hpp"
 #include "styles.hpp"
+#include "process_pool.hpp"
 
 using namespace std;
 
@@ -89,6 +93,9 @@ void PlotVars(RooWorkspace &w, bool bkg_only){
   if(nll == nullptr) return;
   RooMinuit m(*nll);
   m.migrad();
+
+  vector<RooRealVar*> vars;
+  vector<double> best, lows, highs;
   TIter iter(w.allVars().createIterator());
   int size = w.allVars().getSize();
   RooRealVar *arg = nullptr;
@@ -105,30 +112,56 @@ void PlotVars(RooWorkspace &w, bool bkg_only){
     double velo = arg->getErrorLo();
     double verr = arg->getError();
     cout << name << ": " << vmin << " " << (vval+velo) << " " << vval << " (" << verr << ") " << (vval+vehi) << " " << vmax << endl;
-    double low = max(vmin, vval+5*velo);
-    double high = min(vmax, vval+5*vehi);
-    TH1D h("", (";"+name+";-2 log(L)").c_str(), 11, low, high);
-    double minval=numeric_limits<double>::max();
-    for(int bin = 1; bin <= h.GetNbinsX(); ++bin){
-      arg->setVal(h.GetBinCenter(bin));
-      arg->setConstant(true);
+    vars.push_back(arg);
+    best.push_back(vval);
+    lows.push_back(max(vmin, vval+5*velo));
+    highs.push_back(min(vmax, vval+5*vehi));
+  }
+  iter.Reset();
+
+  //Every profile point is a conditional fit from the best fit. The fits run in forked
+  //workers, each with its own copy of the workspace and minimizer
+  const int num_bins = 11;
+  vector<ProcessPool::Task> tasks;
+  for(size_t ivar = 0; ivar < vars.size(); ++ivar){
+    double width = (highs.at(ivar)-lows.at(ivar))/num_bins;
+    for(int bin = 0; bin < num_bins; ++bin){
+      tasks.push_back({ivar, {lows.at(ivar)+(bin+0.5)*width}});
+    }
+  }
+  ProcessPool pool([&](const ProcessPool::Task &task){
+      RooRealVar *var = vars.at(task.index);
+      var->setVal(task.values.at(0));
+      var->setConstant(true);
       m.migrad();
       RooFitResult *f = m.save();
-      if(f == nullptr) continue;
-      double val = f->minNll();
+      double val = f == nullptr ? numeric_limits<double>::quiet_NaN() : f->minNll();
+      delete f;
+      var->setConstant(false);
+      for(size_t ivar = 0; ivar < vars.size(); ++ivar){
+        vars.at(ivar)->setVal(best.at(ivar));
+      }
+      return vector<double>(1, val);
+    });
+  vector<vector<double> > results = pool.Run(tasks);
+
+  for(size_t ivar = 0; ivar < vars.size(); ++ivar){
+    string name = vars.at(ivar)->GetName();
+    TH1D h("", (";"+name+";-2 log(L)").c_str(), num_bins, lows.at(ivar), highs.at(ivar));
+    double minval=numeric_limits<double>::max();
+    for(int bin = 1; bin <= h.GetNbinsX(); ++bin){
+      double val = results.at(ivar*num_bins+bin-1).at(0);
+      if(std::isnan(val)) continue;
       h.SetBinContent(bin, val);
       if(val<minval) minval = val;
     }
     for(int bin = 1; bin <= h.GetNbinsX(); ++bin){
       h.SetBinContent(bin, 2.*(h.GetBinContent(bin)-minval));
     }
-    arg->setVal(vval);
-    arg->setConstant(false);
     TCanvas c;
     h.Draw();
     c.Print((name+".pdf").c_str());
   }
-  iter.Reset();
 }
 
 vector<string> GetVarNames(const RooWorkspace &w){
@@ -2,10 +2,12 @@
 
 #include <string>
 #include <set>
+#include <vector>
 #include <initializer_list>
 #include <algorithm>
 
 #include "TChain.h"
+#include "TObjArray.h"
 
 #include "utilities.hpp"
 
@@ -76,13 +78,54 @@ long Process::GetEntries() const{
 }
 
 GammaParams Process::GetYield(const class Cut &cut) const{
-  double count, uncertainty;
-  ::GetCountAndUncertainty(*chain_, cut*cut_, count, uncertainty);
-  GammaParams gps;
-  gps.SetYieldAndUncertainty(count, uncertainty);
+  //Goes through the pruned, prefetching loop rather than TTree::Project
+  return GetYields(vector<class Cut>(1, cut)).front();
+}
+
+vector<GammaParams> Process::GetYields(const vector<class Cut> &cuts) const{
+  vector<class Cut> full_cuts(cuts.size());
+  for(size_t icut = 0; icut < cuts.size(); ++icut){
+    full_cuts.at(icut) = cuts.at(icut)*cut_;
+  }
+  vector<double> counts, uncertainties;
+  ::GetCountsAndUncertainties(*chain_, full_cuts, counts, uncertainties);
+  vector<GammaParams> gps(cuts.size());
+  for(size_t icut = 0; icut < cuts.size(); ++icut){
+    gps.at(icut).SetYieldAndUncertainty(counts.at(icut), uncertainties.at(icut));
+  }
   return gps;
 }
 
+vector<string> Process::ChainFiles() const{
+  vector<string> chain_files;
+  TObjArray *files = chain_->GetListOfFiles();
+  if(files == nullptr) return chain_files;
+  for(int ifile = 0; ifile < files->GetEntries(); ++ifile){
+    Append(chain_files, string(files->At(ifile)->GetTitle())+"/"+files->At(ifile)->GetName());
+  }
+  return chain_files;
+}
+
+void Process::GetSumsOfWeights(const string &chain_file,
+                               const vector<class Cut> &cuts,
+                               vector<double> &sumw,
+                               vector<double> &sumw2) const{
+  vector<class Cut> full_cuts(cuts.size());
+  for(size_t icut = 0; icut < cuts.size(); ++icut){
+    full_cuts.at(icut) = cuts.at(icut)*cut_;
+  }
+  ::GetSumsOfWeights(chain_file, full_cuts, sumw, sumw2);
+}
+
+void Process::GetColumns(const string &chain_file,
+                         const class Cut &selection,
+                         const vector<string> &expressions,
+                         vector<vector<double> > &columns) const{
+  TChain chain("tree", "tree");
+  chain.Add(chain_file.c_str());
+  ::GetColumns(chain, selection*cut_, expressions, columns);
+}
+
 const bool & Process::IsData() const{
   return is_data_;
 }
@@ -0,0 +1,245 @@
+#include "process_pool.hpp"
+
+#include <cerrno>
+#include <cstdio>
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <exception>
+#include <thread>
+
+#include <unistd.h>
+#include <poll.h>
+#include <signal.h>
+#include <sys/wait.h>
+
+#include "utilities.hpp"
+
+using namespace std;
+
+ProcessPool::ProcessPool(const Worker &worker):
+  workers_(),
+  old_sigpipe_(),
+  sigpipe_ignored_(false){
+  size_t num_workers = thread::hardware_concurrency();
+  if(num_workers > 2){
+    --num_workers;
+  }else{
+    num_workers = 1;
+  }
+  Fork(worker, num_workers);
+}
+
+ProcessPool::ProcessPool(const Worker &worker, size_t num_workers):
+  workers_(),
+  old_sigpipe_(),
+  sigpipe_ignored_(false){
+  Fork(worker, num_workers > 0 ? num_workers : 1);
+}
+
+ProcessPool::~ProcessPool(){
+  Stop(false);
+}
+
+size_t ProcessPool::Size() const{
+  return workers_.size();
+}
+
+vector<vector<double> > ProcessPool::Run(const vector<Task> &tasks){
+  if(workers_.size() == 0) ERROR("Process pool has no workers");
+  vector<vector<double> > results(tasks.size());
+  size_t next = 0, num_busy = 0;
+  for(auto &process: workers_){
+    if(next >= tasks.size()) break;
+    Send(process, next, tasks.at(next));
+    ++next;
+    ++num_busy;
+  }
+
+  //Each worker gets its next task as soon as it returns a result
+  vector<pollfd> fds(workers_.size());
+  while(num_busy > 0){
+    for(size_t i = 0; i < workers_.size(); ++i){
+      fds.at(i).fd = workers_.at(i).busy ? workers_.at(i).result_fd : -1;
+      fds.at(i).events = POLLIN;
+      fds.at(i).revents = 0;
+    }
+    if(poll(fds.data(), fds.size(), -1) < 0){
+      if(errno == EINTR) continue;
+      Stop(true);
+      ERROR("Could not poll worker processes");
+    }
+    for(size_t i = 0; i < workers_.size(); ++i){
+      if(fds.at(i).revents == 0) continue;
+      Process &process = workers_.at(i);
+      Header header;
+      if(!Read(process.result_fd, &header, sizeof(header)) || header.id >= tasks.size()){
+        Stop(true);
+        ERROR("Worker process "+to_string(process.pid)+" died");
+      }
+      if(header.tag == failed){
+        vector<char> message(header.size+1, '\0');
+        Read(process.result_fd, message.data(), header.size);
+        Stop(true);
+        ERROR("Task "+to_string(header.id)+" failed in worker process: "+string(message.data()));
+      }
+      vector<double> &result = results.at(header.id);
+      result.resize(header.size);
+      if(!Read(process.result_fd, result.data(), header.size*sizeof(double))){
+        Stop(true);
+        ERROR("Worker process "+to_string(process.pid)+" died");
+      }
+      process.busy = false;
+      --num_busy;
+      if(next < tasks.size()){
+        Send(process, next, tasks.at(next));
+        ++next;
+        ++num_busy;
+      }
+    }
+  }
+  return results;
+}
+
+void ProcessPool::Fork(const Worker &worker, size_t num_workers){
+  //A write to a dead worker must fail with EPIPE and reach the ERROR in Send instead of
+  //killing the parent, so SIGPIPE is ignored while the pool is alive
+  struct sigaction ignore;
+  ignore.sa_handler = SIG_IGN;
+  sigemptyset(&ignore.sa_mask);
+  ignore.sa_flags = 0;
+  if(sigaction(SIGPIPE, &ignore, &old_sigpipe_) != 0) ERROR("Could not ignore SIGPIPE");
+  sigpipe_ignored_ = true;
+
+  //Anything still buffered would be printed again by every worker
+  cout << flush;
+  cerr << flush;
+  fflush(nullptr);
+  for(size_t i = 0; i < num_workers; ++i){
+    int task_pipe[2], result_pipe[2];
+    if(pipe(task_pipe) != 0){
+      Stop(true);
+      ERROR("Could not create pipe for worker process");
+    }
+    if(pipe(result_pipe) != 0){
+      close(task_pipe[0]);
+      close(task_pipe[1]);
+      Stop(true);
+      ERROR("Could not create pipe for worker process");
+    }
+    pid_t pid = fork();
+    if(pid < 0){
+      close(task_pipe[0]);
+      close(task_pipe[1]);
+      close(result_pipe[0]);
+      close(result_pipe[1]);
+      Stop(true);
+      ERROR("Could not fork worker process");
+    }else if(pid == 0){
+      for(const auto &process: workers_){
+        close(process.task_fd);
+        close(process.result_fd);
+      }
+      close(task_pipe[1]);
+      close(result_pipe[0]);
+      Serve(worker, task_pipe[0], result_pipe[1]);
+    }
+    close(task_pipe[0]);
+    close(result_pipe[1]);
+    Process process;
+    process.pid = pid;
+    process.task_fd = task_pipe[1];
+    process.result_fd = result_pipe[0];
+    process.busy = false;
+    workers_.push_back(process);
+  }
+}
+
+void ProcessPool::Send(Process &process, uint64_t id, const Task &task){
+  Header header;
+  header.id = id;
+  header.tag = task.index;
+  header.size = task.values.size();
+  if(!Write(process.task_fd, &header, sizeof(header))
+     || !Write(process.task_fd, task.values.data(), task.values.size()*sizeof(double))){
+    Stop(true);
+    ERROR("Could not send task to worker process "+to_string(process.pid));
+  }
+  process.busy = true;
+}
+
+void ProcessPool::Stop(bool kill_workers){
+  //Workers exit when their task pipe closes
+  for(const auto &process: workers_){
+    if(kill_workers) kill(process.pid, SIGKILL);
+    close(process.task_fd);
+    close(process.result_fd);
+  }
+  for(const auto &process: workers_){
+    while(waitpid(process.pid, nullptr, 0) < 0 && errno == EINTR){
+    }
+  }
+  workers_.clear();
+  if(sigpipe_ignored_){
+    sigaction(SIGPIPE, &old_sigpipe_, nullptr);
+    sigpipe_ignored_ = false;
+  }
+}
+
+void ProcessPool::Serve(const Worker &worker, int task_fd, int result_fd){
+  //_exit skips the destructors and exit handlers the worker shares with its parent
+  Header header;
+  while(Read(task_fd, &header, sizeof(header))){
+    Task task;
+    task.index = header.tag;
+    task.values.resize(header.size);
+    if(!Read(task_fd, task.values.data(), header.size*sizeof(double))) _exit(1);
+    vector<double> result;
+    string message;
+    try{
+      result = worker(task);
+    }catch(const exception &e){
+      message = e.what();
+    }catch(...){
+      message = "unknown exception";
+    }
+    header.tag = message == "" ? ok : failed;
+    header.size = message == "" ? result.size() : message.size();
+    bool written = Write(result_fd, &header, sizeof(header));
+    if(message == ""){
+      written = written && Write(result_fd, result.data(), result.size()*sizeof(double));
+    }else{
+      written = written && Write(result_fd, message.data(), message.size());
+    }
+    if(!written) _exit(1);
+  }
+  cout << flush;
+  cerr << flush;
+  fflush(nullptr);
+  _exit(0);
+}
+
+bool ProcessPool::Write(int fd, const void *data, size_t size){
+  const char *buffer = static_cast<const char*>(data);
+  while(size > 0){
+    ssize_t num = write(fd, buffer, size);
+    if(num < 0 && errno == EINTR) continue;
+    if(num <= 0) return false;
+    buffer += num;
+    size -= num;
+  }
+  return true;
+}
+
+bool ProcessPool::Read(int fd, void *data, size_t size){
+  char *buffer = static_cast<char*>(data);
+  while(size > 0){
+    ssize_t num = read(fd, buffer, size);
+    if(num < 0 && errno == EINTR) continue;
+    if(num <= 0) return false;
+    buffer += num;
+    size -= num;
+  }
+  return true;
+}
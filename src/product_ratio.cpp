@@ -0,0 +1,42 @@
+#include "product_ratio.hpp"
+
+ClassImp(ProductRatio)
+
+ProductRatio::ProductRatio():
+  RooAbsReal(),
+  numerators_(),
+  denominators_(){
+}
+
+ProductRatio::ProductRatio(const char *name, const char *title,
+                           const RooArgList &numerators, const RooArgList &denominators):
+  RooAbsReal(name, title),
+  numerators_("numerators", "numerators", this),
+  denominators_("denominators", "denominators", this){
+  numerators_.add(numerators);
+  denominators_.add(denominators);
+}
+
+ProductRatio::ProductRatio(const ProductRatio &other, const char *name):
+  RooAbsReal(other, name),
+  numerators_("numerators", this, other.numerators_),
+  denominators_("denominators", this, other.denominators_){
+}
+
+ProductRatio::~ProductRatio(){
+}
+
+TObject * ProductRatio::clone(const char *new_name) const{
+  return new ProductRatio(*this, new_name);
+}
+
+Double_t ProductRatio::evaluate() const{
+  double numerator = 1., denominator = 1.;
+  for(int i = 0; i < numerators_.getSize(); ++i){
+    numerator *= static_cast<const RooAbsReal&>(numerators_[i]).getVal();
+  }
+  for(int i = 0; i < denominators_.getSize(); ++i){
+    denominator *= static_cast<const RooAbsReal&>(denominators_[i]).getVal();
+  }
+  return numerator/denominator;
+}
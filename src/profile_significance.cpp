@@ -0,0 +1,72 @@
+#include "profile_significance.hpp"
+
+#include <cmath>
+
+#include <string>
+#include <algorithm>
+
+#include "utilities.hpp"
+
+using namespace std;
+
+ProfileSignificance::ProfileSignificance(const CompactModel &model,
+                                         const string &pdf_name,
+                                         const string &poi_name):
+  model_(model),
+  pdf_name_(pdf_name),
+  poi_name_(poi_name),
+  poi_min_(-10.){
+  if(!(model_.GetNode(model_.Index(poi_name_)).flags & CompactModel::poi)){
+    ERROR(poi_name_+" is not a parameter of interest");
+  }
+}
+
+double ProfileSignificance::GetPOIMin() const{
+  return poi_min_;
+}
+
+ProfileSignificance & ProfileSignificance::SetPOIMin(double poi_min){
+  poi_min_ = poi_min;
+  return *this;
+}
+
+double ProfileSignificance::Observed() const{
+  CompactFitter fitter(UncappedModel(), pdf_name_);
+  return Significance(fitter, poi_name_);
+}
+
+double ProfileSignificance::Expected(double mu, bool postfit) const{
+  //Asimov data set with signal strength mu. The nuisances are the nominal ones, or with
+  //postfit (combine's --toysFrequentist) the ones fitted to the data at that mu
+  CompactModel asimov = UncappedModel();
+  size_t pdf = asimov.Index(pdf_name_);
+  if(postfit){
+    CompactFitter fitter(asimov, pdf_name_);
+    fitter.Fix(poi_name_, mu);
+    fitter.Minimize();
+    asimov = fitter.GetModel();
+  }
+  asimov.SetValue(poi_name_, mu);
+  asimov.SetToExpectation(pdf);
+  CompactFitter fitter(asimov, pdf_name_);
+  return Significance(fitter, poi_name_);
+}
+
+double ProfileSignificance::Significance(CompactFitter &fitter, const string &poi_name){
+  //The background-only fit starts from the unconditional minimum
+  size_t poi = fitter.GetModel().Index(poi_name);
+  fitter.Release(poi_name);
+  double nll_hat = fitter.Minimize().nll;
+  double mu_hat = fitter.GetModel().Value(poi);
+  fitter.Fix(poi_name, 0.);
+  double nll_null = fitter.Minimize().nll;
+  double z = sqrt(max(2.*(nll_null-nll_hat), 0.));
+  return mu_hat < 0. ? -z : z;
+}
+
+CompactModel ProfileSignificance::UncappedModel() const{
+  CompactModel model(model_);
+  size_t poi = model.Index(poi_name_);
+  model.SetRange(poi, min(poi_min_, model.GetNode(poi).min), model.GetNode(poi).max);
+  return model;
+}
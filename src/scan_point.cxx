@@ -19,12 +19,16 @@
 
 #include "utilities.hpp"
 #include "cross_sections.hpp"
+#include "compact_model.hpp"
+#include "asymptotic_limits.hpp"
+#include "profile_significance.hpp"
 
 using namespace std;
 
 namespace{
   string file_name = "";
   bool do_signif = false;
+  bool use_combine = true;
 }
 
 int main(int argc, char *argv[]){
@@ -47,38 +51,115 @@ int main(int argc, char *argv[]){
   else xsec::stopCrossSection(mglu, xsec, xsec_unc);
   string glu_lsp("mGluino-"+to_string(mglu)+"_mLSP-"+to_string(mlsp));
 
-  string workdir = MakeDir("scan_point_"+glu_lsp);
+  //Only combine needs a scratch folder; the native path reads the .model files in place
+  string workdir = use_combine ? MakeDir("scan_point_"+glu_lsp) : "";
   //string workdir = "scan_point_"+model+"_"+glu_lsp+"/";
   //gSystem->mkdir(workdir.c_str(), kTRUE);
  
-  ostringstream command;
-  string done = " < /dev/null &> /dev/null; ";
-  done = "; ";
   //Need to get modify these file names
   string up_file_name = file_name;   ReplaceAll(up_file_name, "xsecNom", "xsecUp");
   string down_file_name = file_name; ReplaceAll(down_file_name, "xsecNom", "xsecDown");
-  command
-    << "export origdir=$(pwd); "
-    << "cd ~/cmssw/CMSSW_7_4_14/src; "
-    << "eval `scramv1 runtime -sh`; "
-    << "cd $origdir; "
-    << "ln -s $(readlink -f " << file_name << ") " << workdir << done
-    << "ln -s $(readlink -f " << up_file_name << ") " << workdir << done
-    << "ln -s $(readlink -f " << down_file_name << ") " << workdir << done
-    << "cd " << workdir << done
-    << "combine -M Asymptotic " << GetBaseName(file_name) << done
-    << "combine -M Asymptotic --run observed --name Up " << GetBaseName(up_file_name) << done
-    << "combine -M Asymptotic --run observed --name Down " << GetBaseName(down_file_name) << done;
-  if(do_signif){
+
+  double obs = 0., obs_up = 0., obs_down = 0., exp = 0., exp_up = 0., exp_down = 0.;
+  double sig_obs = 0., sig_exp = 0.;
+  if(!use_combine){
+    //Limits computed in process from the compact models written next to the workspaces;
+    //opt-in until python/validate_native.py agrees with combine on stored workspaces
+    AsymptoticLimits limits(CompactModel(ChangeExtension(file_name, ".model")));
+    obs = limits.ObservedLimit();
+    exp = limits.ExpectedLimit(0.);
+    exp_up = limits.ExpectedLimit(1.);
+    exp_down = limits.ExpectedLimit(-1.);
+    obs_up = AsymptoticLimits(CompactModel(ChangeExtension(up_file_name, ".model"))).ObservedLimit();
+    obs_down = AsymptoticLimits(CompactModel(ChangeExtension(down_file_name, ".model"))).ObservedLimit();
+    if(do_signif){
+      ProfileSignificance signif(CompactModel(ChangeExtension(file_name, ".model")));
+      sig_obs = signif.Observed();
+      sig_exp = signif.Expected(1.);
+    }
+  }
+
+  if(use_combine){
+    ostringstream command;
+    string done = " < /dev/null &> /dev/null; ";
+    done = "; ";
     command
-      << "combine -M ProfileLikelihood --significance --expectSignal=1 --verbose=999999 --rMin=-10. --uncapped=1 " << GetBaseName(file_name)
-      << " < /dev/null &> signif_obs.log; "
-      << "combine -M ProfileLikelihood --significance --expectSignal=1 -t -1 --verbose=999999 --rMin=-10. --uncapped=1 " << GetBaseName(file_name)
-      << " < /dev/null &> signif_exp.log; ";
+      << "export origdir=$(pwd); "
+      << "cd ~/cmssw/CMSSW_7_4_14/src; "
+      << "eval `scramv1 runtime -sh`; "
+      << "cd $origdir; "
+      << "ln -s $(readlink -f " << file_name << ") " << workdir << done
+      << "ln -s $(readlink -f " << up_file_name << ") " << workdir << done
+      << "ln -s $(readlink -f " << down_file_name << ") " << workdir << done
+      << "cd " << workdir << done
+      << "combine -M Asymptotic " << GetBaseName(file_name) << done
+      << "combine -M Asymptotic --run observed --name Up " << GetBaseName(up_file_name) << done
+      << "combine -M Asymptotic --run observed --name Down " << GetBaseName(down_file_name) << done;
+    if(do_signif){
+      command
+        << "combine -M ProfileLikelihood --significance --expectSignal=1 --verbose=999999 --rMin=-10. --uncapped=1 " << GetBaseName(file_name)
+        << " < /dev/null &> signif_obs.log; "
+        << "combine -M ProfileLikelihood --significance --expectSignal=1 -t -1 --verbose=999999 --rMin=-10. --uncapped=1 " << GetBaseName(file_name)
+        << " < /dev/null &> signif_exp.log; ";
+    }
+    command << flush;
+    execute(command.str());
   }
-  command << flush;
-  execute(command.str());
-  
+
+  if(use_combine){
+    ReadCombineLimits(workdir, obs, obs_up, obs_down, exp, exp_up, exp_down);
+    if(do_signif){
+      sig_obs = GetSignif(workdir+"/signif_obs.log");
+      sig_exp = GetSignif(workdir+"/signif_exp.log");
+    }
+  }
+
+  if(use_combine) execute("rm -rf "+workdir);
+
+  cout
+    << setprecision(numeric_limits<double>::max_digits10)
+    << ' ' << mglu
+    << ' ' << mlsp
+    << ' ' << xsec
+    << ' ' << obs
+    << ' ' << obs_up
+    << ' ' << obs_down
+    << ' ' << exp
+    << ' ' << exp_up
+    << ' ' << exp_down;
+  if(do_signif){
+    cout
+      << ' ' << sig_obs
+      << ' ' << sig_exp;
+  }
+  cout << endl;
+
+  if(use_combine){
+    string txtname(workdir+"/limits_"+model+"_"+glu_lsp+".txt");
+    ofstream txtfile(txtname);
+    txtfile
+      << setprecision(numeric_limits<double>::max_digits10)
+      << ' ' << mglu
+      << ' ' << mlsp
+      << ' ' << xsec
+      << ' ' << obs
+      << ' ' << obs_up
+      << ' ' << obs_down
+      << ' ' << exp
+      << ' ' << exp_up
+      << ' ' << exp_down;
+    if(do_signif){
+      txtfile
+        << ' ' << sig_obs
+        << ' ' << sig_exp;
+    }
+    txtfile << endl;
+  }
+}
+
+void ReadCombineLimits(const string &workdir,
+                       double &obs, double &obs_up, double &obs_down,
+                       double &exp, double &exp_up, double &exp_down){
   string limits_file_name = workdir+"/higgsCombineTest.Asymptotic.mH120.root";
   TFile limits_file(limits_file_name.c_str(), "read");
   if(!limits_file.IsOpen()) ERROR("Could not open limits file "+limits_file_name);
@@ -89,13 +170,13 @@ int main(int argc, char *argv[]){
   int num_entries = tree->GetEntries();
   if(num_entries != 6) ERROR("Expected 6 tree entries. Saw "+to_string(num_entries));
   tree->GetEntry(1);
-  double exp_down = limit;
+  exp_down = limit;
   tree->GetEntry(2);
-  double exp = limit;
+  exp = limit;
   tree->GetEntry(3);
-  double exp_up = limit;
+  exp_up = limit;
   tree->GetEntry(5);
-  double obs = limit;
+  obs = limit;
   limits_file.Close();
 
   string up_limits_file_name = workdir+"/higgsCombineUp.Asymptotic.mH120.root";
@@ -107,7 +188,7 @@ int main(int argc, char *argv[]){
   num_entries = tree->GetEntries();
   if(num_entries != 1) ERROR("Expected 1 \"up\" tree entry. Saw "+to_string(num_entries));
   tree->GetEntry(0);
-  double obs_up = limit;
+  obs_up = limit;
   up_limits_file.Close();
 
   string down_limits_file_name = workdir+"/higgsCombineDown.Asymptotic.mH120.root";
@@ -119,54 +200,8 @@ int main(int argc, char *argv[]){
   num_entries = tree->GetEntries();
   if(num_entries != 1) ERROR("Expected 1 \"down\" tree entry. Saw "+to_string(num_entries));
   tree->GetEntry(0);
-  double obs_down = limit;
+  obs_down = limit;
   down_limits_file.Close();
-
-  double sig_obs, sig_exp;
-  if(do_signif){
-    sig_obs = GetSignif(workdir+"/signif_obs.log");
-    sig_exp = GetSignif(workdir+"/signif_exp.log");
-  }
-
-  execute("rm -rf "+workdir);
-
-  cout
-    << setprecision(numeric_limits<double>::max_digits10)
-    << ' ' << mglu
-    << ' ' << mlsp
-    << ' ' << xsec
-    << ' ' << obs
-    << ' ' << obs_up
-    << ' ' << obs_down
-    << ' ' << exp
-    << ' ' << exp_up
-    << ' ' << exp_down;
-  if(do_signif){
-    cout
-      << ' ' << sig_obs
-      << ' ' << sig_exp;
-  }
-  cout << endl;
-
-  string txtname(workdir+"/limits_"+model+"_"+glu_lsp+".txt");
-  ofstream txtfile(txtname);
-  txtfile
-    << setprecision(numeric_limits<double>::max_digits10)
-    << ' ' << mglu
-    << ' ' << mlsp
-    << ' ' << xsec
-    << ' ' << obs
-    << ' ' << obs_up
-    << ' ' << obs_down
-    << ' ' << exp
-    << ' ' << exp_up
-    << ' ' << exp_down;
-  if(do_signif){
-    txtfile
-      << ' ' << sig_obs
-      << ' ' << sig_exp;
-  }
-  txtfile << endl;
 }
 
 double GetSignif(const string &filename){
@@ -209,6 +244,7 @@ void GetOptions(int argc, char *argv[]){
     static struct option long_options[] = {
       {"filename", required_argument, 0, 'f'},
       {"signif", required_argument, 0, 's'},
+      {"native", no_argument, 0, 0},
       {0, 0, 0, 0}
     };
 
@@ -225,6 +261,14 @@ void GetOptions(int argc, char *argv[]){
     case 's':
       do_signif = true;
       break;
+    case 0:
+      optname = long_options[option_index].name;
+      if(optname == "native"){
+        use_combine = false;
+      }else{
+        printf("Bad option! Found option name %s\n", optname.c_str());
+      }
+      break;
     default:
       cerr << "Bad option! getopt_long returned character code " << static_cast<int>(opt) << endl;
       break;
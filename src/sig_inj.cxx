@@ -1,6 +1,7 @@
 #include "sig_inj.hpp"
 
 #include <cmath>
+#include <cstdint>
 
 #include <fstream>
 #include <iostream>
@@ -14,25 +15,22 @@
 #include <limits>
 #include <numeric>
 #include <functional>
+#include <random>
 
 #include <stdlib.h>
 #include <getopt.h>
 
-#include "TFile.h"
 #include "TGraphAsymmErrors.h"
 #include "TH1D.h"
 #include "TCanvas.h"
 #include "TF1.h"
 #include "TLine.h"
 
-#include "RooWorkspace.h"
-#include "RooRealVar.h"
-#include "RooArgList.h"
-#include "RooFitResult.h"
-
 #include "utilities.hpp"
 #include "styles.hpp"
 #include "thread_pool.hpp"
+#include "compact_model.hpp"
+#include "toy_fitter.hpp"
 
 using namespace std;
 
@@ -43,6 +41,7 @@ namespace{
   bool do_asymmetric_error = false;
   bool do_systematics = false;
   bool draw_only = false;
+  uint64_t toy_seed = random_device()();
 
   mutex global_mutex;
 }
@@ -79,28 +78,15 @@ int main(int argc, char *argv[]){
   vector<vector<double> > pulls_c(injections.size(), vector<double>(ntoys, -9876543210.));
 
   if(!draw_only){
+    //Each workspace is loaded once and its toys are fit in batches on the thread pool
     cout << "Extracting signal strength from toys..." << endl;
-    vector<vector<future<pair<double,double> > > > toyed_nc(ntoys);
-    vector<vector<future<pair<double,double> > > > toyed_c(ntoys);
-    for(int toy = 0; toy < ntoys; ++toy){
-      vector<future<pair<double,double> > > (injections.size()).swap(toyed_nc.at(toy));
-      vector<future<pair<double,double> > > (injections.size()).swap(toyed_c.at(toy));
-      for(size_t i = 0; i < injections.size(); ++i){
-        toyed_nc.at(toy).at(i) = thread_pool.Push(ExtractSignal, id_string, i, toy, true);
-        toyed_c.at(toy).at(i) = thread_pool.Push(ExtractSignal, id_string, i, toy, false);
-      }
-    }
-    for(int toy = 0; toy < ntoys; ++toy){
-      for(size_t i = 0; i < injections.size(); ++i){
-        auto res_nc = toyed_nc.at(toy).at(i).get();
-        yvals_nc.at(i).at(toy) = res_nc.first;
-        pulls_nc.at(i).at(toy) = res_nc.second;
-        auto res_c = toyed_c.at(toy).at(i).get();
-        yvals_c.at(i).at(toy) = res_c.first;
-        pulls_c.at(i).at(toy) = res_c.second;
-      }
+    mt19937_64 prng(toy_seed);
+    for(size_t i = 0; i < injections.size(); ++i){
+      uint64_t seed_nc = prng(), seed_c = prng();
+      ExtractSignal(id_string, i, true, seed_nc, thread_pool, yvals_nc.at(i), pulls_nc.at(i));
+      ExtractSignal(id_string, i, false, seed_c, thread_pool, yvals_c.at(i), pulls_c.at(i));
     }
-    execute("rm -f *_sig_inj_*.root");
+    execute("rm -f *_sig_inj_*.root *_sig_inj_*.model");
   }
 
   cout << "Generating plots..." << endl;
@@ -128,7 +114,7 @@ void InjectSignal(const string id_string, double inject, size_t index){
   }
   ostringstream oss;
   oss << "./run/make_workspace.exe --method m1bk"
-      << (do_systematics ? "" : " --no_syst") << " --lumi " << lumi << " --use_r4 --toys " << ntoys
+      << (do_systematics ? "" : " --no_syst") << " --lumi " << lumi << " --use_r4"
       << " --sig_strength " << inject << " --identifier sig_inj_" << id_string << "_" << index
       << " < /dev/null &> /dev/null" << flush;
   {
@@ -142,155 +128,44 @@ void InjectSignal(const string id_string, double inject, size_t index){
   }
 }
 
-pair<double, double> ExtractSignal(const string id_string, size_t index, size_t toy, bool is_nc){
-  {
-    lock_guard<mutex> lock(global_mutex);
-    cout << "Extracting signal given strength " << injections.at(index) << " in toy " << toy << endl;
-  }
-  ostringstream oss;
-  oss << "ls -rt m1bk*" << (is_nc ? "_nc_" : "_c_")
-      << "*sig_inj_" << id_string << "_" << index << ".root | tail -n 1" << flush;
-  string file_name = execute(oss.str());
-  while(file_name.back() == '\n' || file_name.back() == ' '){
-    file_name.pop_back();
-  }
-  oss.str("");
-  string workdir = MakeDir("sig_inj_");
+void ExtractSignal(const string id_string, size_t index, bool is_nc, uint64_t seed,
+                   ThreadPool &thread_pool, vector<double> &yvals, vector<double> &pulls){
+  vector<string> file_names = Glob(string("m1bk*")+(is_nc ? "_nc_" : "_c_")
+                                   +"*sig_inj_"+id_string+"_"+to_string(index)+".root");
+  if(file_names.size() == 0) ERROR("No workspace for injection "+to_string(injections.at(index)));
+  string file_name = file_names.back();
   {
     lock_guard<mutex> lock(global_mutex);
-    oss << "export origdir=$(pwd); "
-	<< "cd ~/cmssw/CMSSW_7_1_5/src; "
-	<< "eval `scramv1 runtime -sh` &> /dev/null; "
-	<< "cd $origdir; "
-	<< "cp " << file_name << ' ' << workdir << "; "
-	<< "cd " << workdir << "; "
-	<< "combine -M MaxLikelihoodFit --skipBOnlyFit --dataset data_obs_" << toy << " --preFitValue " << max(injections.at(index),0.01) << ' ' << file_name << " &> /dev/null; "
-	<< "cd $origdir; "
-	<< flush;
-    cout << "Executing " << oss.str() << endl;
+    cout << "Fitting " << ntoys << " toys of " << file_name << endl;
   }
-  string output = execute(oss.str());
-  {
-    lock_guard<mutex> lock(global_mutex);
-    TFile r_file((workdir+"/mlfit.root").c_str(),"read");
-    if(!r_file.IsOpen()) return pair<double, double>(-1., -1.);
-    RooFitResult *f = static_cast<RooFitResult*>(r_file.Get("fit_s"));
-    if(f == nullptr) return pair<double, double>(-1., -1.);
-    RooArgList pars = f->floatParsFinal();
-    for(int ipar = 0; ipar < pars.getSize(); ++ipar){
-      RooRealVar *var = static_cast<RooRealVar*>(pars.at(ipar));
-      if(var == nullptr) continue;
-      if(var->GetName() != string("r")) continue;
-      double val = var->getVal();
-      double delta = val - injections.at(index);
-      double ehi, elo;
-      if(do_asymmetric_error){
-	GetAsymError(*var, ehi, elo);
-      }else{
-	ehi = GetError(*var, *f);
-	elo = ehi;
-      }
-      double pull = 0.;
-      if(delta < 0.){
-	pull = -fabs(delta)/fabs(ehi);
-      }else{
-	pull = fabs(delta)/fabs(elo);
-      }
-      cout << "Extracted strength " << val << " + " << ehi << " - " << fabs(elo) << " given strength " << injections.at(index) << " in toy " << toy << ". pull=" << pull << endl;
-      r_file.Close();
-      execute("rm -rf "+workdir);
-      return pair<double, double>(val, pull);
-    }
-    execute("rm -rf "+workdir);
-    r_file.Close();
-  }
-  return pair<double, double>(-1., -1.);
-}
 
-double GetAsymError(const RooRealVar& var, double &ehi, double &elo){
-  if(var.hasAsymError()){
-    ehi = var.getAsymErrorHi();
-    elo = var.getAsymErrorLo();
-    double aehi = fabs(ehi);
-    double aelo = fabs(elo);
-    double delta = aehi - aelo;
-    return aelo + 0.5*delta;
-  }else if(var.hasError()){
-    ehi = var.getError();
-    elo = ehi;
-    return ehi;
-  }else{
-    ehi = 0.;
-    elo = 0.;
-    return 0.;
-  }
-}
+  ToyFitter fitter(CompactModel(ChangeExtension(file_name, ".model")));
+  fitter.SetSeed(seed)
+    .SetPreFitValue(max(injections.at(index), 0.01))
+    .SetAsymmetricErrors(do_asymmetric_error);
+  vector<ToyFitter::Result> results = fitter.Fit(ntoys, thread_pool);
 
-double GetError(const RooAbsReal &var,
-                const RooFitResult &f){
-  // Clone self for internal use
-  RooAbsReal* cloneFunc = static_cast<RooAbsReal*>(var.cloneTree());
-  RooArgSet* errorParams = cloneFunc->getObservables(f.floatParsFinal());
-  RooArgSet* nset = cloneFunc->getParameters(*errorParams);
-
-  // Make list of parameter instances of cloneFunc in order of error matrix
-  RooArgList paramList;
-  const RooArgList& fpf = f.floatParsFinal();
-  vector<int> fpf_idx;
-  for (int i=0; i<fpf.getSize(); i++) {
-    RooAbsArg* par = errorParams->find(fpf[i].GetName());
-    if (par) {
-      paramList.add(*par);
-      fpf_idx.push_back(i);
+  for(size_t toy = 0; toy < results.size(); ++toy){
+    const ToyFitter::Result &result = results.at(toy);
+    if(!result.converged){
+      yvals.at(toy) = -1.;
+      pulls.at(toy) = -1.;
+      continue;
     }
-  }
-
-  vector<double> errors(paramList.getSize());
-  for (Int_t ivar=0; ivar<paramList.getSize(); ivar++) {
-    RooRealVar& rrv = static_cast<RooRealVar&>(fpf[fpf_idx[ivar]]);
-
-    double cenVal = rrv.getVal();
-    double errVal = rrv.getError();
-
-    // Make Plus variation
-    static_cast<RooRealVar*>(paramList.at(ivar))->setVal(cenVal+0.5*errVal);
-    double up = cloneFunc->getVal(nset);
-
-    // Make Minus variation
-    static_cast<RooRealVar*>(paramList.at(ivar))->setVal(cenVal-0.5*errVal);
-    double down = cloneFunc->getVal(nset);
-
-    errors.at(ivar) = (up-down);
-
-    static_cast<RooRealVar*>(paramList.at(ivar))->setVal(cenVal);
-  }
-
-  vector<double> right(errors.size());
-  for(size_t i = 0; i < right.size(); ++i){
-    right.at(i) = 0.;
-    for(size_t j = 0; j < errors.size(); ++j){
-      right.at(i) += f.correlation(paramList.at(i)->GetName(),paramList.at(j)->GetName())*errors.at(j);
+    double val = result.value;
+    double delta = val - injections.at(index);
+    double ehi = result.error_up;
+    double elo = result.error_down;
+    double pull = 0.;
+    if(delta < 0.){
+      pull = -fabs(delta)/fabs(ehi);
+    }else{
+      pull = fabs(delta)/fabs(elo);
     }
+    cout << "Extracted strength " << val << " + " << ehi << " - " << fabs(elo) << " given strength " << injections.at(index) << " in toy " << toy << ". pull=" << pull << endl;
+    yvals.at(toy) = val;
+    pulls.at(toy) = pull;
   }
-  double sum = 0.;
-  for(size_t i = 0; i < right.size(); ++i){
-    sum += errors.at(i)*right.at(i);
-  }
-
-  if(cloneFunc != nullptr){
-    delete cloneFunc;
-    cloneFunc = nullptr;
-  }
-  if(errorParams != nullptr){
-    delete errorParams;
-    errorParams = nullptr;
-  }
-  if(nset != nullptr){
-    delete nset;
-    nset = nullptr;
-  }
-
-  return sqrt(sum);
 }
 
 void GetStats(const vector<double> &vals, double &mean, double &median,
@@ -386,6 +261,7 @@ void GetOptions(int argc, char *argv[]){
       {"asym", no_argument, 0, 'a'},
       {"syst", no_argument, 0, 's'},
       {"draw", no_argument, 0, 'd'},
+      {"toy_seed", required_argument, 0, 0},
       {0, 0, 0, 0}
     };
 
@@ -414,6 +290,14 @@ void GetOptions(int argc, char *argv[]){
     case 'd':
       draw_only = true;
       break;
+    case 0:
+      optname = long_options[option_index].name;
+      if(optname == "toy_seed"){
+        toy_seed = stoul(optarg);
+      }else{
+        printf("Bad option! Found option name %s\n", optname.c_str());
+      }
+      break;
     default:
       printf("Bad option! getopt_long returned character code 0%o\n", opt);
       break;
@@ -0,0 +1,89 @@
+#include "significance.hpp"
+
+#include <cstdio>
+#include <cstdlib>
+
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <limits>
+
+#include <unistd.h>
+#include <getopt.h>
+
+#include "compact_model.hpp"
+#include "profile_significance.hpp"
+#include "utilities.hpp"
+
+using namespace std;
+
+namespace{
+  string file_name = "";
+  string pdf_name = "model_s";
+  string poi_name = "r";
+  double expect_signal = 1.;
+  double r_min = -10.;
+  bool postfit = false;
+}
+
+int main(int argc, char *argv[]){
+  GetOptions(argc, argv);
+  if(file_name == ""){
+    cout << "Usage: significance.exe -f wspace.root [--expectSignal 1] [--r_min -10] [--postfit]" << endl;
+    return 1;
+  }
+
+  //The compact model written by WorkspaceGenerator next to the workspace
+  ProfileSignificance signif(CompactModel(ChangeExtension(file_name, ".model")), pdf_name, poi_name);
+  signif.SetPOIMin(r_min);
+
+  cout << setprecision(numeric_limits<double>::max_digits10);
+  cout << "Observed significance: " << signif.Observed() << endl;
+  cout << "Expected significance: " << signif.Expected(expect_signal, postfit) << endl;
+}
+
+void GetOptions(int argc, char *argv[]){
+  while(true){
+    static struct option long_options[] = {
+      {"filename", required_argument, 0, 'f'},
+      {"pdf", required_argument, 0, 'p'},
+      {"poi", required_argument, 0, 0},
+      {"expectSignal", required_argument, 0, 0},
+      {"r_min", required_argument, 0, 0},
+      {"postfit", no_argument, 0, 0},
+      {0, 0, 0, 0}
+    };
+
+    char opt = -1;
+    int option_index;
+    opt = getopt_long(argc, argv, "f:p:", long_options, &option_index);
+    if( opt == -1) break;
+
+    string optname;
+    switch(opt){
+    case 'f':
+      file_name = optarg;
+      break;
+    case 'p':
+      pdf_name = optarg;
+      break;
+    case 0:
+      optname = long_options[option_index].name;
+      if(optname == "poi"){
+        poi_name = optarg;
+      }else if(optname == "expectSignal"){
+        expect_signal = atof(optarg);
+      }else if(optname == "r_min"){
+        r_min = atof(optarg);
+      }else if(optname == "postfit"){
+        postfit = true;
+      }else{
+        printf("Bad option! Found option name %s\n", optname.c_str());
+      }
+      break;
+    default:
+      printf("Bad option! getopt_long returned character code 0%o\n", opt);
+      break;
+    }
+  }
+}
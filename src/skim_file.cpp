@@ -0,0 +1,133 @@
+#include "skim_file.hpp"
+
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <fstream>
+#include <algorithm>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "utilities.hpp"
+
+using namespace std;
+
+//Layout: magic, number of entries, number of columns, (name length, name) per column,
+//zero padding to 8 bytes, then each column as a contiguous array of doubles
+const char SkimFile::magic_[8] = {'R', 'A', '4', 'S', 'K', 'I', 'M', '1'};
+
+SkimFile::SkimFile(const string &file_name):
+  file_name_(file_name),
+  data_(nullptr),
+  size_(0),
+  num_entries_(0),
+  names_(),
+  columns_(nullptr){
+  int fd = open(file_name_.c_str(), O_RDONLY);
+  if(fd < 0) ERROR("Could not open skim file "+file_name_);
+  struct stat file_stat;
+  if(fstat(fd, &file_stat) != 0){
+    close(fd);
+    ERROR("Could not stat skim file "+file_name_);
+  }
+  size_ = file_stat.st_size;
+  data_ = mmap(nullptr, size_, PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+  if(data_ == MAP_FAILED){
+    data_ = nullptr;
+    ERROR("Could not map skim file "+file_name_);
+  }
+
+  const char *ptr = static_cast<const char *>(data_);
+  const char *end = ptr+size_;
+  uint64_t num_columns = 0;
+  if(size_ < sizeof(magic_)+2*sizeof(uint64_t)
+     || memcmp(ptr, magic_, sizeof(magic_)) != 0){
+    munmap(data_, size_);
+    ERROR("Bad header in skim file "+file_name_);
+  }
+  ptr += sizeof(magic_);
+  memcpy(&num_entries_, ptr, sizeof(uint64_t)); ptr += sizeof(uint64_t);
+  memcpy(&num_columns, ptr, sizeof(uint64_t)); ptr += sizeof(uint64_t);
+  for(uint64_t icol = 0; icol < num_columns; ++icol){
+    uint64_t length = 0;
+    if(ptr+sizeof(uint64_t) > end) break;
+    memcpy(&length, ptr, sizeof(uint64_t)); ptr += sizeof(uint64_t);
+    if(ptr+length > end) break;
+    names_.push_back(string(ptr, length));
+    ptr += length;
+  }
+  size_t offset = ptr-static_cast<const char *>(data_);
+  offset = (offset+sizeof(double)-1)/sizeof(double)*sizeof(double);
+  if(names_.size() != num_columns
+     || offset+num_columns*num_entries_*sizeof(double) != size_){
+    munmap(data_, size_);
+    ERROR("Truncated skim file "+file_name_);
+  }
+  columns_ = reinterpret_cast<const double *>(static_cast<const char *>(data_)+offset);
+  madvise(data_, size_, MADV_SEQUENTIAL);
+}
+
+SkimFile::~SkimFile(){
+  if(data_ != nullptr) munmap(data_, size_);
+}
+
+void SkimFile::Write(const string &file_name,
+                     const vector<string> &names,
+                     const vector<vector<double> > &columns){
+  if(names.size() != columns.size()) ERROR("Need one name per skim column");
+  uint64_t num_entries = columns.size() ? columns.front().size() : 0;
+  uint64_t num_columns = columns.size();
+  for(const auto &column: columns){
+    if(column.size() != num_entries) ERROR("Skim columns must have equal lengths");
+  }
+
+  //Write to a temporary file and rename so concurrent jobs never map a partial skim
+  string temp_name = file_name+".tmp"+to_string(getpid());
+  {
+    ofstream file(temp_name, ios::binary | ios::trunc);
+    if(!file) ERROR("Could not open "+temp_name+" for writing");
+    file.write(magic_, sizeof(magic_));
+    file.write(reinterpret_cast<const char *>(&num_entries), sizeof(uint64_t));
+    file.write(reinterpret_cast<const char *>(&num_columns), sizeof(uint64_t));
+    size_t offset = sizeof(magic_)+2*sizeof(uint64_t);
+    for(const auto &name: names){
+      uint64_t length = name.size();
+      file.write(reinterpret_cast<const char *>(&length), sizeof(uint64_t));
+      file.write(name.data(), length);
+      offset += sizeof(uint64_t)+length;
+    }
+    const char padding[sizeof(double)] = {0};
+    file.write(padding, (sizeof(double)-offset%sizeof(double))%sizeof(double));
+    for(const auto &column: columns){
+      file.write(reinterpret_cast<const char *>(column.data()), column.size()*sizeof(double));
+    }
+    if(!file) ERROR("Could not write skim file "+temp_name);
+  }
+  if(rename(temp_name.c_str(), file_name.c_str()) != 0){
+    remove(temp_name.c_str());
+    ERROR("Could not move skim file to "+file_name);
+  }
+}
+
+size_t SkimFile::NumEntries() const{
+  return num_entries_;
+}
+
+const vector<string> & SkimFile::Names() const{
+  return names_;
+}
+
+bool SkimFile::HasColumn(const string &name) const{
+  return find(names_.cbegin(), names_.cend(), name) != names_.cend();
+}
+
+const double * SkimFile::Column(const string &name) const{
+  auto icol = find(names_.cbegin(), names_.cend(), name);
+  if(icol == names_.cend()) ERROR("Skim file "+file_name_+" has no column "+name);
+  return columns_+(icol-names_.cbegin())*num_entries_;
+}
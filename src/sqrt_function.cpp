@@ -0,0 +1,31 @@
+#include "sqrt_function.hpp"
+
+#include <cmath>
+
+ClassImp(SqrtFunction)
+
+SqrtFunction::SqrtFunction():
+  RooAbsReal(),
+  x_(){
+}
+
+SqrtFunction::SqrtFunction(const char *name, const char *title, RooAbsReal &x):
+  RooAbsReal(name, title),
+  x_("x", "x", this, x){
+}
+
+SqrtFunction::SqrtFunction(const SqrtFunction &other, const char *name):
+  RooAbsReal(other, name),
+  x_("x", this, other.x_){
+}
+
+SqrtFunction::~SqrtFunction(){
+}
+
+TObject * SqrtFunction::clone(const char *new_name) const{
+  return new SqrtFunction(*this, new_name);
+}
+
+Double_t SqrtFunction::evaluate() const{
+  return std::sqrt(static_cast<double>(x_));
+}
@@ -0,0 +1,236 @@
+#include "systematics_database.hpp"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <fstream>
+#include <algorithm>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "utilities.hpp"
+
+using namespace std;
+
+//Layout: magic, number of strings, points and entries, (length, characters) per string,
+//zero padding to 8 bytes, the points sorted by mass, then the entries of all points
+const char SystematicsDatabase::magic_[8] = {'R', 'A', '4', 'S', 'Y', 'S', 'D', '1'};
+
+SystematicsDatabase::SystematicsDatabase(const string &file_name):
+  file_name_(file_name),
+  data_(nullptr),
+  size_(0),
+  strings_(),
+  points_(nullptr),
+  num_points_(0),
+  entries_(nullptr),
+  num_entries_(0){
+  int fd = open(file_name_.c_str(), O_RDONLY);
+  if(fd < 0) ERROR("Could not open systematics database "+file_name_);
+  struct stat file_stat;
+  if(fstat(fd, &file_stat) != 0){
+    close(fd);
+    ERROR("Could not stat systematics database "+file_name_);
+  }
+  size_ = file_stat.st_size;
+  data_ = mmap(nullptr, size_, PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+  if(data_ == MAP_FAILED){
+    data_ = nullptr;
+    ERROR("Could not map systematics database "+file_name_);
+  }
+
+  const char *ptr = static_cast<const char *>(data_);
+  const char *end = ptr+size_;
+  uint64_t num_strings = 0;
+  if(size_ < sizeof(magic_)+3*sizeof(uint64_t)
+     || memcmp(ptr, magic_, sizeof(magic_)) != 0){
+    munmap(data_, size_);
+    ERROR("Bad header in systematics database "+file_name_);
+  }
+  ptr += sizeof(magic_);
+  memcpy(&num_strings, ptr, sizeof(uint64_t)); ptr += sizeof(uint64_t);
+  memcpy(&num_points_, ptr, sizeof(uint64_t)); ptr += sizeof(uint64_t);
+  memcpy(&num_entries_, ptr, sizeof(uint64_t)); ptr += sizeof(uint64_t);
+  for(uint64_t istring = 0; istring < num_strings; ++istring){
+    uint64_t length = 0;
+    if(ptr+sizeof(uint64_t) > end) break;
+    memcpy(&length, ptr, sizeof(uint64_t)); ptr += sizeof(uint64_t);
+    if(ptr+length > end) break;
+    strings_.push_back(string(ptr, length));
+    ptr += length;
+  }
+  size_t offset = ptr-static_cast<const char *>(data_);
+  offset = (offset+sizeof(uint64_t)-1)/sizeof(uint64_t)*sizeof(uint64_t);
+  if(strings_.size() != num_strings
+     || offset+num_points_*sizeof(PointRecord)+num_entries_*sizeof(EntryRecord) != size_){
+    munmap(data_, size_);
+    ERROR("Truncated systematics database "+file_name_);
+  }
+  points_ = reinterpret_cast<const PointRecord *>(static_cast<const char *>(data_)+offset);
+  entries_ = reinterpret_cast<const EntryRecord *>(points_+num_points_);
+}
+
+SystematicsDatabase::~SystematicsDatabase(){
+  if(data_ != nullptr) munmap(data_, size_);
+}
+
+vector<SystematicsDatabase::Entry> SystematicsDatabase::ReadTextFile(const string &file_name){
+  vector<Entry> entries;
+  ifstream file(file_name);
+  string one_line;
+  string systematic;
+  vector<string> processes;
+  while(getline(file, one_line)){
+    CleanLine(one_line);
+    if(one_line == "") continue;
+    vector<string> line = Tokenize(one_line);
+    if(line.size() < 2){
+      string out;
+      for(const auto &word: line) out += word;
+      ERROR("Bad systematics line: "+out);
+    }
+    if(line.at(0) == "SYSTEMATIC"){
+      //The last PROCESSES list carries over into later SYSTEMATIC blocks until replaced
+      systematic = line.at(1);
+    }else if(line.at(0) == "PROCESSES"){
+      processes.clear();
+      for(size_t iword = 1; iword < line.size(); ++iword){
+        for(const auto &name: Tokenize(line.at(iword), ", ")){
+          processes.push_back(name);
+        }
+      }
+    }else{
+      if(systematic == "") ERROR("Bin "+line.at(0)+" in "+file_name+" precedes any SYSTEMATIC line");
+      string bin(line.at(0));
+      ReplaceAll(bin, " ", "");
+      ReplaceAll(bin, "\t", "");
+      entries.push_back(Entry{systematic, processes, bin, atof(line.at(1).c_str())});
+    }
+  }
+  return entries;
+}
+
+void SystematicsDatabase::Write(const string &file_name,
+                                const map<pair<int, int>, vector<Entry> > &points){
+  //Names and process lists repeat for every point and are stored once
+  vector<string> strings;
+  map<string, uint64_t> string_ids;
+  auto string_id = [&strings, &string_ids](const string &str) -> uint64_t{
+    auto id = string_ids.find(str);
+    if(id != string_ids.end()) return id->second;
+    string_ids[str] = strings.size();
+    strings.push_back(str);
+    return strings.size()-1;
+  };
+
+  vector<PointRecord> point_records;
+  vector<EntryRecord> entry_records;
+  for(const auto &point: points){
+    point_records.push_back(PointRecord{point.first.first, point.first.second,
+          entry_records.size(), point.second.size()});
+    for(const auto &entry: point.second){
+      string processes;
+      for(const auto &process: entry.processes){
+        if(processes != "") processes += ",";
+        processes += process;
+      }
+      entry_records.push_back(EntryRecord{string_id(entry.systematic), string_id(processes),
+            string_id(entry.bin), entry.value});
+    }
+  }
+
+  //Write to a temporary file and rename so concurrent jobs never map a partial database
+  string temp_name = file_name+".tmp"+to_string(getpid());
+  {
+    ofstream file(temp_name, ios::binary | ios::trunc);
+    if(!file) ERROR("Could not open "+temp_name+" for writing");
+    uint64_t num_strings = strings.size();
+    uint64_t num_points = point_records.size();
+    uint64_t num_entries = entry_records.size();
+    file.write(magic_, sizeof(magic_));
+    file.write(reinterpret_cast<const char *>(&num_strings), sizeof(uint64_t));
+    file.write(reinterpret_cast<const char *>(&num_points), sizeof(uint64_t));
+    file.write(reinterpret_cast<const char *>(&num_entries), sizeof(uint64_t));
+    size_t offset = sizeof(magic_)+3*sizeof(uint64_t);
+    for(const auto &str: strings){
+      uint64_t length = str.size();
+      file.write(reinterpret_cast<const char *>(&length), sizeof(uint64_t));
+      file.write(str.data(), length);
+      offset += sizeof(uint64_t)+length;
+    }
+    const char padding[sizeof(uint64_t)] = {0};
+    file.write(padding, (sizeof(uint64_t)-offset%sizeof(uint64_t))%sizeof(uint64_t));
+    file.write(reinterpret_cast<const char *>(point_records.data()),
+               point_records.size()*sizeof(PointRecord));
+    file.write(reinterpret_cast<const char *>(entry_records.data()),
+               entry_records.size()*sizeof(EntryRecord));
+    if(!file) ERROR("Could not write systematics database "+temp_name);
+  }
+  if(rename(temp_name.c_str(), file_name.c_str()) != 0){
+    remove(temp_name.c_str());
+    ERROR("Could not move systematics database to "+file_name);
+  }
+}
+
+size_t SystematicsDatabase::NumPoints() const{
+  return num_points_;
+}
+
+bool SystematicsDatabase::HasPoint(int mglu, int mlsp) const{
+  return FindPoint(mglu, mlsp) != nullptr;
+}
+
+vector<SystematicsDatabase::Entry> SystematicsDatabase::Entries(int mglu, int mlsp) const{
+  const PointRecord *point = FindPoint(mglu, mlsp);
+  if(point == nullptr){
+    ERROR("Systematics database "+file_name_+" has no point mGluino-"
+          +to_string(mglu)+"_mLSP-"+to_string(mlsp));
+  }
+  vector<Entry> entries;
+  for(const EntryRecord *entry = entries_+point->first;
+      entry != entries_+point->first+point->count;
+      ++entry){
+    if(entry->systematic >= strings_.size()
+       || entry->processes >= strings_.size()
+       || entry->bin >= strings_.size()){
+      ERROR("Corrupt entry in systematics database "+file_name_);
+    }
+    entries.push_back(Entry{strings_.at(entry->systematic),
+          Tokenize(strings_.at(entry->processes), ","),
+          strings_.at(entry->bin), entry->value});
+  }
+  return entries;
+}
+
+const SystematicsDatabase::PointRecord * SystematicsDatabase::FindPoint(int mglu, int mlsp) const{
+  auto point = lower_bound(points_, points_+num_points_, make_pair(mglu, mlsp),
+                           [](const PointRecord &p, const pair<int, int> &m){
+                             return make_pair(p.mglu, p.mlsp) < pair<int64_t, int64_t>(m.first, m.second);
+                           });
+  if(point == points_+num_points_ || point->mglu != mglu || point->mlsp != mlsp) return nullptr;
+  if(point->first+point->count > num_entries_){
+    ERROR("Corrupt point in systematics database "+file_name_);
+  }
+  return point;
+}
+
+void SystematicsDatabase::CleanLine(string &line){
+  ReplaceAll(line, "=", "");
+  string old = line;
+  do{
+    old = line;
+    ReplaceAll(line, "  ", " ");
+  } while (line != old);
+  while(line.size() > 0 && line[0] == ' '){
+    line = line.substr(1);
+  }
+  if(line.size() > 0 && line[0] == '#'){
+    line = "";
+  }
+}
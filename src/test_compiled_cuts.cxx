@@ -0,0 +1,86 @@
+#include <cstdlib>
+
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "TTree.h"
+#include "TTreeFormula.h"
+
+#include "cut.hpp"
+#include "compiled_cuts.hpp"
+
+using namespace std;
+
+namespace{
+  //Rows with zero denominators, where TTreeFormula evaluates x/0 to 0
+  vector<vector<double> > rows = {
+    {300., 0., 5.},
+    {0., 0., 3.},
+    {-50., 0., 8.},
+    {200., 100., 7.},
+    {400., 50., 9.},
+    {600., 100., 6.}
+  };
+
+  vector<string> cuts = {
+    "met/met_calo<5.",
+    "met>150&&met/met_calo<5.",
+    "met/met_calo<5.&&nj>=6",
+    "nj/met_calo>=0.",
+    "met/met_calo==0.",
+    "met/(met_calo-100.)>2.",
+    "met>150&&1./0.==0."
+  };
+}
+
+int main(){
+  vector<string> names = {"met", "met_calo", "nj"};
+  TTree tree("tree", "tree");
+  tree.SetDirectory(nullptr);
+  vector<float> values(names.size());
+  for(size_t ivar = 0; ivar < names.size(); ++ivar){
+    tree.Branch(names.at(ivar).c_str(), &values.at(ivar), (names.at(ivar)+"/F").c_str());
+  }
+  for(const auto &row: rows){
+    for(size_t ivar = 0; ivar < row.size(); ++ivar) values.at(ivar) = row.at(ivar);
+    tree.Fill();
+  }
+
+  vector<Cut> compiled_cuts;
+  for(const auto &cut: cuts) compiled_cuts.push_back(Cut(cut));
+  CompiledCuts compiled(compiled_cuts);
+
+  size_t num_bad = 0;
+  for(size_t icut = 0; icut < cuts.size(); ++icut){
+    TTreeFormula formula("formula", cuts.at(icut).c_str(), &tree);
+    for(size_t irow = 0; irow < rows.size(); ++irow){
+      tree.GetEntry(irow);
+      double expected = formula.EvalInstance();
+
+      vector<double> row_values;
+      for(const auto &variable: compiled.Variables()){
+        for(size_t ivar = 0; ivar < names.size(); ++ivar){
+          if(names.at(ivar) == variable) row_values.push_back(static_cast<float>(rows.at(irow).at(ivar)));
+        }
+      }
+      vector<const double *> columns;
+      for(const auto &value: row_values) columns.push_back(&value);
+      vector<double> sumw, sumw2;
+      compiled.AddSums(columns, 1, sumw, sumw2);
+
+      if(sumw.at(icut) != expected){
+        ++num_bad;
+        cout << "Mismatch for " << cuts.at(icut) << " on row " << irow
+             << ": compiled " << sumw.at(icut) << ", TTreeFormula " << expected << endl;
+      }
+    }
+  }
+
+  if(num_bad > 0){
+    cout << num_bad << " mismatches between compiled cuts and TTreeFormula" << endl;
+    return EXIT_FAILURE;
+  }
+  cout << "Compiled cuts agree with TTreeFormula on " << cuts.size()*rows.size() << " evaluations" << endl;
+  return EXIT_SUCCESS;
+}
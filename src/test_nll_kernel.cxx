@@ -0,0 +1,131 @@
+#include <cstdlib>
+#include <cmath>
+
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <random>
+#include <algorithm>
+#include <limits>
+
+#include "TFile.h"
+
+#include "RooWorkspace.h"
+#include "RooAbsPdf.h"
+#include "RooAbsReal.h"
+#include "RooDataSet.h"
+#include "RooRealVar.h"
+
+#include "nll_kernel.hpp"
+#include "compact_model.hpp"
+#include "utilities.hpp"
+
+using namespace std;
+
+namespace{
+  double kernel_tolerance = 1e-12;
+  double model_tolerance = 1e-6;
+  size_t num_points = 5;
+
+  double RelativeDifference(double a, double b){
+    double scale = max(max(fabs(a), fabs(b)), 1.);
+    return fabs(a-b)/scale;
+  }
+
+  //Compares the dispatched (AVX2 when available) sums with the scalar ones for every
+  //array length up to a few vector widths, so the remainder handling is covered too
+  bool CheckKernel(){
+    if(!NLLKernel::HasAVX2()){
+      cout << "CPU has no AVX2; the dispatched kernel is the scalar path" << endl;
+    }
+    mt19937 prng(12345);
+    uniform_real_distribution<double> mean_dist(0.1, 200.);
+    uniform_real_distribution<double> sigma_dist(0.1, 3.);
+    double max_diff = 0.;
+    for(size_t size = 0; size <= 67; ++size){
+      vector<double> n(size), log_factorial_n(size), mu(size), x(size), mean(size), sigma(size);
+      for(size_t i = 0; i < size; ++i){
+        mu.at(i) = mean_dist(prng);
+        n.at(i) = poisson_distribution<int>(mu.at(i))(prng);
+        log_factorial_n.at(i) = lgamma(n.at(i)+1.);
+        sigma.at(i) = sigma_dist(prng);
+        mean.at(i) = normal_distribution<double>(0., 1.)(prng);
+        x.at(i) = normal_distribution<double>(mean.at(i), sigma.at(i))(prng);
+      }
+      max_diff = max(max_diff, RelativeDifference(NLLKernel::Poisson(n.data(), log_factorial_n.data(), mu.data(), size),
+                                                  NLLKernel::PoissonScalar(n.data(), log_factorial_n.data(), mu.data(), size)));
+      max_diff = max(max_diff, RelativeDifference(NLLKernel::Gaussian(x.data(), mean.data(), sigma.data(), size),
+                                                  NLLKernel::GaussianScalar(x.data(), mean.data(), sigma.data(), size)));
+    }
+    cout << "Kernel vs scalar: max relative difference " << max_diff << endl;
+    return max_diff < kernel_tolerance;
+  }
+
+  //Moves every floating parameter of both models to the same points and compares the
+  //change in NLL from the first point, which removes the models' different constants
+  bool CheckModel(const string &file_name, const string &pdf_name){
+    TFile file(file_name.c_str(), "read");
+    RooWorkspace *w = static_cast<RooWorkspace*>(file.Get("w"));
+    if(w == nullptr) ERROR("No workspace in "+file_name);
+    RooAbsPdf *pdf = w->pdf(pdf_name.c_str());
+    RooDataSet *data = static_cast<RooDataSet*>(w->data("data_obs"));
+    if(pdf == nullptr || data == nullptr) ERROR("No "+pdf_name+" or data_obs in "+file_name);
+    RooAbsReal *roo_nll = pdf->createNLL(*data);
+
+    CompactModel model(ChangeExtension(file_name, ".model"));
+    vector<size_t> params = model.Variables(CompactModel::floating);
+    vector<double> start;
+    for(const auto &param: params) Append(start, model.Value(param));
+
+    mt19937 prng(54321);
+    uniform_real_distribution<double> shift(-1., 1.);
+    double roo_ref = 0., compact_ref = 0., max_diff = 0.;
+    for(size_t point = 0; point < num_points; ++point){
+      for(size_t iparam = 0; iparam < params.size(); ++iparam){
+        size_t param = params.at(iparam);
+        const CompactModel::Node &node = model.GetNode(param);
+        double value = start.at(iparam);
+        if(point > 0){
+          double width = 0.02*point*(node.max-node.min);
+          value = min(max(value+width*shift(prng), node.min), node.max);
+        }
+        model.SetValue(param, value);
+        RooRealVar *var = w->var(model.Name(param).c_str());
+        if(var == nullptr) ERROR("No variable "+model.Name(param)+" in "+file_name);
+        var->setVal(value);
+      }
+      double roo = roo_nll->getVal();
+      double compact = model.NLL(pdf_name);
+      if(point == 0){
+        roo_ref = roo;
+        compact_ref = compact;
+      }
+      double diff = fabs((roo-roo_ref)-(compact-compact_ref));
+      max_diff = max(max_diff, diff);
+      cout << "Point " << point << ": RooFit delta NLL " << roo-roo_ref
+           << ", CompactModel delta NLL " << compact-compact_ref << endl;
+    }
+    delete roo_nll;
+    cout << "CompactModel vs RooFit: max delta NLL difference " << max_diff << endl;
+    return max_diff < model_tolerance;
+  }
+}
+
+int main(int argc, char *argv[]){
+  if(argc > 3){
+    cerr << "Usage: test_nll_kernel.exe [wspace.root [pdf_name]]" << endl;
+    return EXIT_FAILURE;
+  }
+  cout << setprecision(numeric_limits<double>::max_digits10);
+
+  bool pass = CheckKernel();
+  if(argc > 1){
+    pass = CheckModel(argv[1], argc > 2 ? argv[2] : "model_s") && pass;
+  }else{
+    cout << "No workspace given; skipping the comparison with RooFit" << endl;
+  }
+
+  cout << (pass ? "PASS" : "FAIL") << endl;
+  return pass ? EXIT_SUCCESS : EXIT_FAILURE;
+}
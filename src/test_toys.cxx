@@ -0,0 +1,65 @@
+#include <cstdlib>
+
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "TFile.h"
+
+#include "RooWorkspace.h"
+#include "RooDataSet.h"
+#include "RooArgSet.h"
+
+#include "compact_model.hpp"
+#include "toy_fitter.hpp"
+#include "utilities.hpp"
+
+using namespace std;
+
+//Checks that every row of a workspace's data_toys, made with wspace_sig.exe --toys N
+//--toy_seed S, is the toy ToyFitter::GenerateToy draws for S and the row's toy index
+int main(int argc, char *argv[]){
+  if(argc != 3){
+    cerr << "Usage: test_toys.exe wspace.root toy_seed" << endl;
+    return EXIT_FAILURE;
+  }
+  string file_name = argv[1];
+  uint64_t seed = stoull(argv[2]);
+
+  TFile file(file_name.c_str(), "read");
+  RooWorkspace *w = static_cast<RooWorkspace*>(file.Get("w"));
+  if(w == nullptr) ERROR("No workspace in "+file_name);
+  RooDataSet *toys = static_cast<RooDataSet*>(w->data("data_toys"));
+  if(toys == nullptr) ERROR("No data_toys in "+file_name);
+
+  CompactModel model(ChangeExtension(file_name, ".model"));
+  vector<string> names;
+  for(const auto &obs: model.Variables(CompactModel::observable)){
+    names.push_back(model.Name(obs));
+  }
+  names = ToyFitter::ToyObservables(names);
+  vector<double> rates;
+  for(const auto &name: names) rates.push_back(model.Value(model.Index(name)));
+
+  size_t num_bad = 0;
+  for(int row = 0; row < toys->numEntries(); ++row){
+    const RooArgSet *values = toys->get(row);
+    uint64_t toy = static_cast<uint64_t>(values->getRealValue("toy"));
+    vector<double> expected = ToyFitter::GenerateToy(seed, toy, rates);
+    for(size_t iobs = 0; iobs < names.size(); ++iobs){
+      double stored = values->getRealValue(names.at(iobs).c_str());
+      if(stored != expected.at(iobs)){
+        ++num_bad;
+        cout << "Toy " << toy << ", " << names.at(iobs) << ": stored " << stored
+             << ", ToyFitter " << expected.at(iobs) << endl;
+      }
+    }
+  }
+
+  if(num_bad > 0){
+    cout << num_bad << " toy yields differ between data_toys and ToyFitter" << endl;
+    return EXIT_FAILURE;
+  }
+  cout << "All " << toys->numEntries() << " toys in data_toys match ToyFitter" << endl;
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,199 @@
+#include "toy_fitter.hpp"
+
+#include <cmath>
+
+#include <string>
+#include <vector>
+#include <random>
+#include <future>
+#include <algorithm>
+
+#include "utilities.hpp"
+
+using namespace std;
+
+ToyFitter::ToyFitter(const CompactModel &model,
+                     const string &pdf_name,
+                     const string &poi_name):
+  model_(model),
+  pdf_name_(pdf_name),
+  poi_name_(poi_name),
+  seed_(0),
+  pre_fit_value_(0.),
+  asymmetric_errors_(false),
+  observables_(),
+  rates_(){
+  size_t poi = model_.Index(poi_name_);
+  if(!(model_.GetNode(poi).flags & CompactModel::poi)){
+    ERROR(poi_name_+" is not a parameter of interest");
+  }
+  pre_fit_value_ = model_.Value(poi);
+  random_device r;
+  seed_ = (static_cast<uint64_t>(r()) << 32) | r();
+
+  vector<string> names;
+  for(const auto &obs: model_.Variables(CompactModel::observable)){
+    names.push_back(model_.Name(obs));
+  }
+  for(const auto &name: ToyObservables(names)){
+    observables_.push_back(model_.Index(name));
+    rates_.push_back(model_.Value(observables_.back()));
+  }
+}
+
+uint64_t ToyFitter::GetSeed() const{
+  return seed_;
+}
+
+ToyFitter & ToyFitter::SetSeed(uint64_t seed){
+  seed_ = seed;
+  return *this;
+}
+
+double ToyFitter::GetPreFitValue() const{
+  return pre_fit_value_;
+}
+
+ToyFitter & ToyFitter::SetPreFitValue(double pre_fit_value){
+  pre_fit_value_ = pre_fit_value;
+  return *this;
+}
+
+bool ToyFitter::GetAsymmetricErrors() const{
+  return asymmetric_errors_;
+}
+
+ToyFitter & ToyFitter::SetAsymmetricErrors(bool asymmetric_errors){
+  asymmetric_errors_ = asymmetric_errors;
+  return *this;
+}
+
+vector<ToyFitter::Result> ToyFitter::Fit(size_t num_toys, ThreadPool &pool) const{
+  //One batch of consecutive toys per thread, so each thread clones the model once
+  size_t num_threads = max(pool.Size(), static_cast<size_t>(1));
+  size_t toys_per_task = max((num_toys+num_threads-1)/num_threads, static_cast<size_t>(1));
+  vector<future<vector<Result> > > futures;
+  for(size_t first = 0; first < num_toys; first += toys_per_task){
+    size_t num_task = min(toys_per_task, num_toys-first);
+    futures.push_back(pool.Push([this, first, num_task](){return Fit(first, num_task);}));
+  }
+  vector<Result> results;
+  results.reserve(num_toys);
+  for(auto &task: futures){
+    for(const auto &result: task.get()){
+      results.push_back(result);
+    }
+  }
+  return results;
+}
+
+vector<ToyFitter::Result> ToyFitter::Fit(size_t first_toy, size_t num_toys) const{
+  CompactFitter fitter(model_, pdf_name_);
+  CompactModel &model = fitter.GetModel();
+  model.SetValue(poi_name_, pre_fit_value_);
+  const vector<size_t> &params = fitter.Parameters();
+  size_t ipoi = find(params.cbegin(), params.cend(), model.Index(poi_name_)) - params.cbegin();
+  if(ipoi >= params.size()) ERROR(poi_name_+" is not floating in "+pdf_name_);
+  vector<double> start(params.size());
+  for(size_t i = 0; i < params.size(); ++i) start.at(i) = model.Value(params.at(i));
+
+  //Each toy starts from the previous toy's best fit, which is close to its own
+  vector<Result> results(num_toys);
+  for(size_t itoy = 0; itoy < num_toys; ++itoy){
+    vector<double> toy = GenerateToy(seed_, first_toy+itoy, rates_);
+    for(size_t iobs = 0; iobs < observables_.size(); ++iobs){
+      model.SetValue(observables_.at(iobs), toy.at(iobs));
+    }
+    CompactFitter::Result fit = fitter.Minimize();
+    Result &result = results.at(itoy);
+    result.value = fit.values.at(ipoi);
+    result.error_up = fit.errors.at(ipoi);
+    result.error_down = fit.errors.at(ipoi);
+    result.converged = fit.converged;
+    if(fit.converged && asymmetric_errors_){
+      ProfileErrors(fitter, fit.nll, result);
+    }else if(!fit.converged){
+      for(size_t i = 0; i < params.size(); ++i) model.SetValue(params.at(i), start.at(i));
+    }
+  }
+  return results;
+}
+
+vector<double> ToyFitter::GenerateToy(uint64_t seed, uint64_t toy,
+                                      const vector<double> &rates){
+  //Each toy draws from its own stream keyed by (seed, toy index)
+  seed_seq ss{static_cast<uint32_t>(seed), static_cast<uint32_t>(seed >> 32),
+      static_cast<uint32_t>(toy), static_cast<uint32_t>(toy >> 32)};
+  mt19937_64 prng(ss);
+  vector<double> values(rates.size(), 0.);
+  for(size_t iobs = 0; iobs < rates.size(); ++iobs){
+    if(rates.at(iobs) <= 0.) continue;
+    poisson_distribution<> dist(rates.at(iobs));
+    values.at(iobs) = dist(prng);
+  }
+  return values;
+}
+
+vector<string> ToyFitter::ToyObservables(vector<string> observables){
+  //The MC statistics observables keep their values; the others are drawn in name order,
+  //independent of the order in which the model or workspace lists them
+  observables.erase(remove_if(observables.begin(), observables.end(), [](const string &name){
+        return Contains(name, "nobsmc");
+      }), observables.end());
+  sort(observables.begin(), observables.end());
+  return observables;
+}
+
+void ToyFitter::ProfileErrors(const CompactFitter &fitter, double nll_hat, Result &result) const{
+  //MINOS-style errors where the profiled 2*delta NLL crosses 1. The scans run on copies
+  //so the fitter stays at the best fit for the next toy
+  double step = result.error_up > 0. && std::isfinite(result.error_up) ? result.error_up : 1.;
+  CompactFitter scan(fitter);
+  result.error_up = FindCrossing(scan, nll_hat, step);
+  scan = fitter;
+  result.error_down = FindCrossing(scan, nll_hat, -step);
+}
+
+double ToyFitter::FindCrossing(CompactFitter &fitter, double nll_hat, double step) const{
+  const CompactModel &model = fitter.GetModel();
+  size_t poi = model.Index(poi_name_);
+  double mu_hat = model.Value(poi);
+  double bound = step > 0. ? model.GetNode(poi).max : model.GetNode(poi).min;
+  double max_dist = fabs(bound-mu_hat);
+  double dir = step > 0. ? 1. : -1.;
+  auto f = [&](double dist){
+    fitter.Fix(poi_name_, mu_hat+dir*dist);
+    return 2.*(fitter.Minimize().nll-nll_hat)-1.;
+  };
+
+  //Bracket by doubling the distance, stopping at the POI's bound
+  double lo = 0., f_lo = -1.;
+  double hi = min(fabs(step), max_dist), f_hi = f(hi);
+  while(f_hi < 0.){
+    if(hi >= max_dist) return max_dist;
+    lo = hi;
+    f_lo = f_hi;
+    hi = min(2.*hi, max_dist);
+    f_hi = f(hi);
+  }
+
+  //Illinois steps
+  int side = 0;
+  for(size_t iteration = 0; iteration < 100 && hi-lo > 1e-3*hi; ++iteration){
+    double mid = f_hi != f_lo ? (lo*f_hi-hi*f_lo)/(f_hi-f_lo) : 0.5*(lo+hi);
+    double f_mid = f(mid);
+    if(f_mid == 0.) return mid;
+    if(f_mid < 0.){
+      lo = mid;
+      f_lo = f_mid;
+      if(side == 1) f_hi *= 0.5;
+      side = 1;
+    }else{
+      hi = mid;
+      f_hi = f_mid;
+      if(side == -1) f_lo *= 0.5;
+      side = -1;
+    }
+  }
+  return f_hi != f_lo ? (lo*f_hi-hi*f_lo)/(f_hi-f_lo) : 0.5*(lo+hi);
+}
@@ -5,19 +5,168 @@
 #include <stdlib.h>
 #include <unistd.h>
 
+#include <cmath>
+#include <cstdint>
 #include <string>
 #include <vector>
 #include <memory>
+#include <mutex>
+#include <sstream>
+#include <iomanip>
+#include <stdexcept>
+#include <set>
+#include <future>
+#include <algorithm>
+#include <cctype>
 
 #include <unistd.h>
+#include <glob.h>
+#include <sys/stat.h>
+#include <fcntl.h>
 
 #include "TTree.h"
+#include "TChain.h"
+#include "TObjArray.h"
+#include "TBranch.h"
+#include "TLeaf.h"
 #include "TH1D.h"
+#include "TTreeFormula.h"
 
 #include "RooWorkspace.h"
 
+#include "compiled_cuts.hpp"
+#include "cut_expression.hpp"
+
 using namespace std;
 
+namespace{
+  //Formula parsing goes through the interpreter, so only one thread at a time
+  mutex formula_mutex;
+
+  //Scalar branch read into a buffer of its native type and converted to double
+  class BoundBranch{
+  public:
+    enum class Type{float_t, double_t, int_t, uint_t, bool_t, long64_t, ulong64_t,
+        short_t, ushort_t, char_t, uchar_t};
+
+    explicit BoundBranch(const string &type_name){
+      if(type_name == "Float_t") type_ = Type::float_t;
+      else if(type_name == "Double_t") type_ = Type::double_t;
+      else if(type_name == "Int_t") type_ = Type::int_t;
+      else if(type_name == "UInt_t") type_ = Type::uint_t;
+      else if(type_name == "Bool_t") type_ = Type::bool_t;
+      else if(type_name == "Long64_t") type_ = Type::long64_t;
+      else if(type_name == "ULong64_t") type_ = Type::ulong64_t;
+      else if(type_name == "Short_t") type_ = Type::short_t;
+      else if(type_name == "UShort_t") type_ = Type::ushort_t;
+      else if(type_name == "Char_t") type_ = Type::char_t;
+      else if(type_name == "UChar_t") type_ = Type::uchar_t;
+      else ERROR("Cannot bind leaf of type "+type_name);
+    }
+
+    void * Address(){
+      return &value_;
+    }
+
+    TBranch *& Branch(){
+      return branch_;
+    }
+
+    double Value() const{
+      switch(type_){
+      case Type::float_t: return value_.f;
+      case Type::double_t: return value_.d;
+      case Type::int_t: return value_.i;
+      case Type::uint_t: return value_.ui;
+      case Type::bool_t: return value_.b;
+      case Type::long64_t: return value_.l;
+      case Type::ulong64_t: return value_.ul;
+      case Type::short_t: return value_.s;
+      case Type::ushort_t: return value_.us;
+      case Type::char_t: return value_.c;
+      case Type::uchar_t: return value_.uc;
+      default: return 0.;
+      }
+    }
+
+  private:
+    Type type_;
+    union{
+      Float_t f; Double_t d; Int_t i; UInt_t ui; Bool_t b; Long64_t l; ULong64_t ul;
+      Short_t s; UShort_t us; Char_t c; UChar_t uc;
+    } value_;
+    TBranch *branch_ = nullptr;
+  };
+
+  future<void> PrefetchNextFile(TTree &tree){
+    TChain *chain = dynamic_cast<TChain *>(&tree);
+    if(chain == nullptr || chain->GetListOfFiles() == nullptr) return future<void>();
+    TObject *next = chain->GetListOfFiles()->At(chain->GetTreeNumber()+1);
+    if(next == nullptr) return future<void>();
+    return async(launch::async, PrefetchFile, string(next->GetTitle()));
+  }
+
+  void GetCompiledSums(TTree &tree,
+                       const CompiledCuts &compiled,
+                       vector<double> &sumw,
+                       vector<double> &sumw2){
+    //Throws before touching any branch address if a variable is not a plain scalar leaf
+    const vector<string> &variables = compiled.Variables();
+    Long64_t num_entries = tree.GetEntries();
+    if(num_entries > 0 && tree.LoadTree(0) < 0) num_entries = 0;
+    vector<BoundBranch> branches;
+    for(const auto &variable: variables){
+      TLeaf *leaf = tree.GetLeaf(variable.c_str());
+      if(leaf == nullptr) ERROR("No scalar leaf "+variable);
+      if(leaf->GetLen() != 1 || leaf->GetLeafCount() != nullptr) ERROR("Leaf "+variable+" is an array");
+      branches.push_back(BoundBranch(leaf->GetTypeName()));
+    }
+    for(size_t ivar = 0; ivar < variables.size(); ++ivar){
+      tree.SetBranchAddress(variables.at(ivar).c_str(),
+                            branches.at(ivar).Address(),
+                            &branches.at(ivar).Branch());
+    }
+
+    size_t batch = CompiledCuts::batch_size_;
+    vector<vector<double> > columns(variables.size(), vector<double>(batch));
+    vector<const double *> bound;
+    for(const auto &column: columns) bound.push_back(column.data());
+    sumw.assign(compiled.NumCuts(), 0.);
+    sumw2.assign(compiled.NumCuts(), 0.);
+    int tree_num = -1;
+    future<void> prefetch;
+    Long64_t entry = 0;
+    while(entry < num_entries){
+      size_t num_rows = 0;
+      for(; num_rows < batch && entry < num_entries; ++num_rows, ++entry){
+        Long64_t local = tree.LoadTree(entry);
+        if(local < 0){
+          num_entries = entry;
+          break;
+        }
+        if(tree.GetTreeNumber() != tree_num){
+          tree_num = tree.GetTreeNumber();
+          prefetch = PrefetchNextFile(tree);
+        }
+        for(size_t ivar = 0; ivar < branches.size(); ++ivar){
+          branches[ivar].Branch()->GetEntry(local);
+          columns[ivar][num_rows] = branches[ivar].Value();
+        }
+      }
+      compiled.AddSums(bound, num_rows, sumw, sumw2);
+    }
+    tree.ResetBranchAddresses();
+  }
+}
+
+void PrefetchFile(const string &file_name){
+  //Ask the kernel to start reading the whole file so it is in the page cache when needed
+  int fd = open(file_name.c_str(), O_RDONLY);
+  if(fd < 0) return;
+  posix_fadvise(fd, 0, 0, POSIX_FADV_WILLNEED);
+  close(fd);
+}
+
 void parseMasses(const string &prs, int &mglu, int &mlsp){
   mglu = stoi(prs.substr(prs.find("ino-")+4,prs.find("_mLSP")-prs.find("ino-")-4));
   mlsp = stoi(prs.substr(prs.find("LSP-")+4,prs.find("_Tune")-prs.find("LSP-")-4));
@@ -84,6 +233,211 @@ void GetCountAndUncertainty(TTree &tree,
   count=temp.IntegralAndError(0,2,uncertainty);
 }
 
+void GetSumsOfWeights(TTree &tree,
+                      const vector<Cut> &cuts,
+                      vector<double> &sumw,
+                      vector<double> &sumw2){
+  //Same sums as GetCountAndUncertainty, but all cuts are filled in a single pass over the tree
+  PruneBranches(tree, CutVariables(cuts));
+  try{
+    CompiledCuts compiled(cuts);
+    GetCompiledSums(tree, compiled, sumw, sumw2);
+    return;
+  }catch(const runtime_error &){
+    //Functions, arrays and other syntax the compiler does not handle go through TTreeFormula
+  }
+
+  sumw.assign(cuts.size(), 0.);
+  sumw2.assign(cuts.size(), 0.);
+  vector<unique_ptr<TTreeFormula> > formulas(cuts.size());
+  {
+    lock_guard<mutex> lock(formula_mutex);
+    for(size_t icut = 0; icut < cuts.size(); ++icut){
+      formulas.at(icut).reset(new TTreeFormula(("cut"+to_string(icut)).c_str(),
+                                               static_cast<const char *>(cuts.at(icut)),
+                                               &tree));
+    }
+  }
+
+  int tree_num = -1;
+  future<void> prefetch;
+  Long64_t num_entries = tree.GetEntries();
+  for(Long64_t entry = 0; entry < num_entries; ++entry){
+    if(tree.LoadTree(entry) < 0) break;
+    if(tree.GetTreeNumber() != tree_num){
+      tree_num = tree.GetTreeNumber();
+      for(auto &formula: formulas) formula->UpdateFormulaLeaves();
+      prefetch = PrefetchNextFile(tree);
+    }
+    for(size_t icut = 0; icut < formulas.size(); ++icut){
+      TTreeFormula &formula = *formulas.at(icut);
+      int num_instances = formula.GetNdata();
+      for(int instance = 0; instance < num_instances; ++instance){
+        double w = formula.EvalInstance(instance);
+        if(w == 0.) continue;
+        sumw.at(icut) += w;
+        sumw2.at(icut) += w*w;
+      }
+    }
+  }
+}
+
+void GetSumsOfWeights(const string &chain_file,
+                      const vector<Cut> &cuts,
+                      vector<double> &sumw,
+                      vector<double> &sumw2){
+  //Uses its own chain so that several files can be processed concurrently
+  TChain chain("tree", "tree");
+  chain.Add(chain_file.c_str());
+  GetSumsOfWeights(chain, cuts, sumw, sumw2);
+}
+
+void GetCountsAndUncertainties(TTree &tree,
+                               const vector<Cut> &cuts,
+                               vector<double> &counts,
+                               vector<double> &uncertainties){
+  vector<double> sumw2;
+  GetSumsOfWeights(tree, cuts, counts, sumw2);
+  uncertainties.resize(cuts.size());
+  for(size_t icut = 0; icut < cuts.size(); ++icut){
+    uncertainties.at(icut) = sqrt(sumw2.at(icut));
+  }
+}
+
+void GetColumns(TTree &tree,
+                const Cut &selection,
+                const vector<string> &expressions,
+                vector<vector<double> > &columns){
+  vector<Cut> used(1, selection);
+  for(const auto &expression: expressions) used.push_back(Cut(expression));
+  PruneBranches(tree, CutVariables(used));
+  columns.assign(expressions.size(), vector<double>());
+  unique_ptr<TTreeFormula> select;
+  vector<unique_ptr<TTreeFormula> > formulas(expressions.size());
+  {
+    lock_guard<mutex> lock(formula_mutex);
+    select.reset(new TTreeFormula("selection", static_cast<const char *>(selection), &tree));
+    for(size_t iexpr = 0; iexpr < expressions.size(); ++iexpr){
+      formulas.at(iexpr).reset(new TTreeFormula(("column"+to_string(iexpr)).c_str(),
+                                                expressions.at(iexpr).c_str(),
+                                                &tree));
+    }
+  }
+
+  int tree_num = -1;
+  future<void> prefetch;
+  Long64_t num_entries = tree.GetEntries();
+  for(Long64_t entry = 0; entry < num_entries; ++entry){
+    if(tree.LoadTree(entry) < 0) break;
+    if(tree.GetTreeNumber() != tree_num){
+      tree_num = tree.GetTreeNumber();
+      select->UpdateFormulaLeaves();
+      for(auto &formula: formulas) formula->UpdateFormulaLeaves();
+      prefetch = PrefetchNextFile(tree);
+    }
+    if(select->GetNdata() < 1 || select->EvalInstance(0) == 0.) continue;
+    for(size_t iexpr = 0; iexpr < formulas.size(); ++iexpr){
+      if(formulas.at(iexpr)->GetNdata() != 1){
+        ERROR("Column "+expressions.at(iexpr)+" is not a scalar");
+      }
+      columns.at(iexpr).push_back(formulas.at(iexpr)->EvalInstance(0));
+    }
+  }
+}
+
+set<vector<double> > GetDistinctValues(TTree &tree,
+                                       const vector<string> &expressions){
+  vector<Cut> used;
+  for(const auto &expression: expressions) used.push_back(Cut(expression));
+  PruneBranches(tree, CutVariables(used));
+  vector<unique_ptr<TTreeFormula> > formulas(expressions.size());
+  {
+    lock_guard<mutex> lock(formula_mutex);
+    for(size_t iexpr = 0; iexpr < expressions.size(); ++iexpr){
+      formulas.at(iexpr).reset(new TTreeFormula(("value"+to_string(iexpr)).c_str(),
+                                                expressions.at(iexpr).c_str(),
+                                                &tree));
+    }
+  }
+
+  set<vector<double> > values;
+  vector<double> row(expressions.size());
+  int tree_num = -1;
+  future<void> prefetch;
+  Long64_t num_entries = tree.GetEntries();
+  for(Long64_t entry = 0; entry < num_entries; ++entry){
+    if(tree.LoadTree(entry) < 0) break;
+    if(tree.GetTreeNumber() != tree_num){
+      tree_num = tree.GetTreeNumber();
+      for(auto &formula: formulas) formula->UpdateFormulaLeaves();
+      prefetch = PrefetchNextFile(tree);
+    }
+    for(size_t iexpr = 0; iexpr < formulas.size(); ++iexpr){
+      if(formulas.at(iexpr)->GetNdata() != 1){
+        ERROR("Value "+expressions.at(iexpr)+" is not a scalar");
+      }
+      row.at(iexpr) = formulas.at(iexpr)->EvalInstance(0);
+    }
+    values.insert(row);
+  }
+  return values;
+}
+
+vector<string> CutVariables(const vector<Cut> &cuts){
+  set<string> variables;
+  for(const auto &cut: cuts){
+    try{
+      for(const auto &variable: CutExpression(cut).Variables()){
+        Append(variables, variable);
+      }
+    }catch(const runtime_error &){
+      //Not parseable (functions, arrays, ...), so take every identifier as a candidate branch
+      string str = static_cast<const char *>(cut);
+      for(size_t pos = 0; pos < str.size();){
+        if(isalpha(str.at(pos)) || str.at(pos) == '_'){
+          size_t end = pos;
+          while(end < str.size() && (isalnum(str.at(end)) || str.at(end) == '_')) ++end;
+          Append(variables, str.substr(pos, end-pos));
+          pos = end;
+        }else if(isdigit(str.at(pos)) || str.at(pos) == '.'){
+          while(pos < str.size() && (isalnum(str.at(pos)) || str.at(pos) == '.')) ++pos;
+        }else{
+          ++pos;
+        }
+      }
+    }
+  }
+  return vector<string>(variables.cbegin(), variables.cend());
+}
+
+void PruneBranches(TTree &tree, const vector<string> &variables){
+  //Only decompress the branches the cuts read, and size the cache to hold just those
+  if(tree.LoadTree(0) < 0) return;
+  set<string> branches;
+  for(const auto &variable: variables){
+    TBranch *branch = tree.GetBranch(variable.c_str());
+    if(branch == nullptr){
+      TLeaf *leaf = tree.GetLeaf(variable.c_str());
+      if(leaf != nullptr) branch = leaf->GetBranch();
+    }
+    if(branch != nullptr) Append(branches, string(branch->GetName()));
+  }
+
+  Long64_t zip_bytes = 0;
+  tree.SetBranchStatus("*", false);
+  for(const auto &branch: branches){
+    tree.SetBranchStatus(branch.c_str(), true);
+    zip_bytes += tree.GetBranch(branch.c_str())->GetZipBytes();
+  }
+
+  const Long64_t min_cache = 1 << 20, max_cache = 1 << 26;
+  tree.SetCacheSize(max(min_cache, min(max_cache, zip_bytes)));
+  for(const auto &branch: branches){
+    tree.AddBranchToCache(branch.c_str(), true);
+  }
+  tree.StopCacheLearningPhase();
+}
+
 string execute(const string &cmd){
   FILE *pipe = popen(cmd.c_str(), "r");
   if(!pipe) ERROR("Could not open pipe.");
@@ -133,3 +487,42 @@ string MakeDir(string prefix){
   delete[] dir_name;
   return prefix;
 }
+
+string HashString(const string &str){
+  //64-bit FNV-1a: stable across compilers and runs, unlike std::hash
+  uint64_t hash = 14695981039346656037UL;
+  for(const auto &c: str){
+    hash ^= static_cast<unsigned char>(c);
+    hash *= 1099511628211UL;
+  }
+  ostringstream oss;
+  oss << hex << setw(16) << setfill('0') << hash << flush;
+  return oss.str();
+}
+
+vector<string> Glob(const string &pattern){
+  vector<string> paths;
+  glob_t glob_result;
+  if(glob(pattern.c_str(), 0, nullptr, &glob_result) == 0){
+    for(size_t ipath = 0; ipath < glob_result.gl_pathc; ++ipath){
+      paths.push_back(glob_result.gl_pathv[ipath]);
+    }
+  }
+  globfree(&glob_result);
+  return paths;
+}
+
+string FileSignature(const string &pattern){
+  //Expands a TChain-style pattern (dir/*.root/tree) and lists each file with its size and mtime
+  string path = pattern;
+  auto pos = path.rfind(".root");
+  if(pos != string::npos) path = path.substr(0, pos+5);
+  ostringstream oss;
+  for(const auto &file_name: Glob(path)){
+    struct stat file_stat;
+    if(stat(file_name.c_str(), &file_stat) != 0) continue;
+    oss << file_name << ':' << file_stat.st_size << ':' << file_stat.st_mtime << ';';
+  }
+  oss << flush;
+  return oss.str();
+}
@@ -4,25 +4,42 @@
 #include <iomanip>
 #include <sstream>
 #include <fstream>
-#include <array>
 #include <algorithm>
 #include <numeric>
+#include <limits>
+#include <future>
+#include <functional>
+#include <unordered_map>
+
+#include <climits>
+#include <unistd.h>
 
 #include "TDirectory.h"
 
 #include "RooPoisson.h"
+#include "RooGaussian.h"
 #include "RooDataSet.h"
 #include "RooRealVar.h"
+#include "RooConstVar.h"
+#include "RooProduct.h"
+#include "RooAddition.h"
+#include "RooFormulaVar.h"
+#include "RooProdPdf.h"
+#include "RooGlobalFunc.h"
 
 #include "RooStats/ModelConfig.h"
 
 #include "utilities.hpp"
+#include "product_ratio.hpp"
+#include "exp_product.hpp"
+#include "sqrt_function.hpp"
+#include "barlow_beeston_poisson.hpp"
+#include "thread_pool.hpp"
+#include "toy_fitter.hpp"
 
 using namespace std;
 
 YieldManager WorkspaceGenerator::yields_ = YieldManager(4.);
-mt19937_64 WorkspaceGenerator::prng_ = WorkspaceGenerator::InitializePRNG();
-poisson_distribution<> WorkspaceGenerator::dist_(1.);
 
 WorkspaceGenerator::WorkspaceGenerator(const Cut &baseline,
                                        const set<Block> &blocks,
@@ -38,9 +55,9 @@ WorkspaceGenerator::WorkspaceGenerator(const Cut &baseline,
   injection_(),
   inject_other_signal_(false),
   blocks_(blocks),
-  obs_vals_(),
-  obs_gens_(),
   systematics_file_(systematics_file),
+  systematics_db_(),
+  systematics_point_(0, 0),
   use_r4_(use_r4),
   sig_strength_(sig_strength),
   sig_xsec_f_(sig_xsec_f),
@@ -58,15 +75,37 @@ WorkspaceGenerator::WorkspaceGenerator(const Cut &baseline,
   do_dilepton_(false),
   do_mc_kappa_correction_(true),
   num_toys_(0),
+  toy_seed_(RandomSeed()),
+  split_toys_(false),
   gaus_approx_(true),
-  w_is_valid_(false){
+  compiled_functions_(true),
+  barlow_beeston_lite_(false),
+  w_is_valid_(false),
+  nodes_(),
+  node_servers_(),
+  node_types_(),
+  node_index_(),
+  num_clients_(),
+  pending_servers_(),
+  template_is_valid_(false),
+  template_size_(0),
+  template_systematics_(),
+  template_glob_observables_(),
+  template_nuisances_(),
+  template_syst_names_(){
   w_.cd();
 }
 
+WorkspaceGenerator::~WorkspaceGenerator(){
+  ClearNodes();
+}
+
 void WorkspaceGenerator::WriteToFile(const string &file_name){
   if(print_level_ >= PrintLevel::everything) DBG(file_name);
   if(!w_is_valid_) UpdateWorkspace();
   w_.writeToFile(file_name.c_str());
+  string compact_name = ChangeExtension(file_name, ".model");
+  MakeCompactModel().Write(compact_name);
   if(print_level_ >= PrintLevel::everything){
     DBG("");
     w_.Print();
@@ -75,7 +114,8 @@ void WorkspaceGenerator::WriteToFile(const string &file_name){
     cout << *this << endl;
   }
   if(print_level_ >= PrintLevel::important){
-    cout << endl << "Wrote workspace to file " << file_name << endl<< endl;
+    cout << endl << "Wrote workspace to file " << file_name
+         << " and compact model to " << compact_name << endl<< endl;
   }
 }
 
@@ -87,6 +127,7 @@ WorkspaceGenerator & WorkspaceGenerator::SetLuminosity(double luminosity){
   if(luminosity != luminosity_){
     luminosity_ = luminosity;
     w_is_valid_ = false;
+    template_is_valid_ = false;
   }
   return *this;
 }
@@ -99,6 +140,7 @@ WorkspaceGenerator & WorkspaceGenerator::SetDoSystematics(bool do_systematics){
   if(do_systematics != do_systematics_){
     do_systematics_ = do_systematics;
     w_is_valid_ = false;
+    template_is_valid_ = false;
   }
   return *this;
 }
@@ -111,6 +153,7 @@ WorkspaceGenerator & WorkspaceGenerator::SetDoDilepton(bool do_dilepton){
   if(do_dilepton != do_dilepton_){
     do_dilepton_ = do_dilepton;
     w_is_valid_ = false;
+    template_is_valid_ = false;
   }
   return *this;
 }
@@ -132,6 +175,7 @@ WorkspaceGenerator & WorkspaceGenerator::SetKappaCorrected(bool do_kappa_correct
   if(do_mc_kappa_correction_ != do_kappa_correction){
     do_mc_kappa_correction_ = do_kappa_correction;
     w_is_valid_ = false;
+    template_is_valid_ = false;
   }
   return *this;
 }
@@ -143,17 +187,97 @@ double WorkspaceGenerator::GetRMax() const{
 WorkspaceGenerator & WorkspaceGenerator::SetRMax(double rmax){
   if(rmax != rmax_){
     rmax_ = rmax;
+    //Only the range of the POI changes, so an existing workspace is kept
+    RooRealVar *r = w_is_valid_ ? w_.var("r") : nullptr;
+    if(r != nullptr) r->setMax(rmax_);
+    else w_is_valid_ = false;
+  }
+  return *this;
+}
+
+const Process & WorkspaceGenerator::GetSignal() const{
+  return signal_;
+}
+
+WorkspaceGenerator & WorkspaceGenerator::SetSignal(const Process &signal){
+  if(!(signal == signal_) || signal.Name() != signal_.Name()){
+    signal_ = signal;
+    w_is_valid_ = false;
+  }
+  return *this;
+}
+
+const string & WorkspaceGenerator::GetSystematicsFile() const{
+  return systematics_file_;
+}
+
+WorkspaceGenerator & WorkspaceGenerator::SetSystematicsFile(const string &systematics_file){
+  if(systematics_file != systematics_file_ || systematics_db_){
+    systematics_file_ = systematics_file;
+    systematics_db_.reset();
+    w_is_valid_ = false;
+  }
+  return *this;
+}
+
+WorkspaceGenerator & WorkspaceGenerator::SetSystematicsDatabase(const shared_ptr<const SystematicsDatabase> &database,
+                                                                int mglu, int mlsp){
+  if(database != systematics_db_ || make_pair(mglu, mlsp) != systematics_point_){
+    systematics_file_ = "";
+    systematics_db_ = database;
+    systematics_point_ = make_pair(mglu, mlsp);
     w_is_valid_ = false;
   }
   return *this;
 }
 
+double WorkspaceGenerator::GetSignalXSecFactor() const{
+  return sig_xsec_f_;
+}
+
+WorkspaceGenerator & WorkspaceGenerator::SetSignalXSecFactor(double sig_xsec_f){
+  if(sig_xsec_f != sig_xsec_f_){
+    sig_xsec_f_ = sig_xsec_f;
+    if(w_is_valid_) UpdateSignalWeights();
+  }
+  return *this;
+}
+
 bool WorkspaceGenerator::UseGausApprox() const{
   return gaus_approx_;
 }
 
 WorkspaceGenerator & WorkspaceGenerator::UseGausApprox(bool use_gaus_approx){
-  gaus_approx_ = use_gaus_approx;
+  if(use_gaus_approx != gaus_approx_){
+    gaus_approx_ = use_gaus_approx;
+    template_is_valid_ = false;
+  }
+  return *this;
+}
+
+bool WorkspaceGenerator::UseCompiledFunctions() const{
+  return compiled_functions_;
+}
+
+WorkspaceGenerator & WorkspaceGenerator::UseCompiledFunctions(bool use_compiled_functions){
+  if(use_compiled_functions != compiled_functions_){
+    compiled_functions_ = use_compiled_functions;
+    w_is_valid_ = false;
+    template_is_valid_ = false;
+  }
+  return *this;
+}
+
+bool WorkspaceGenerator::UseBarlowBeestonLite() const{
+  return barlow_beeston_lite_;
+}
+
+WorkspaceGenerator & WorkspaceGenerator::UseBarlowBeestonLite(bool use_barlow_beeston_lite){
+  if(use_barlow_beeston_lite != barlow_beeston_lite_){
+    barlow_beeston_lite_ = use_barlow_beeston_lite;
+    w_is_valid_ = false;
+    template_is_valid_ = false;
+  }
   return *this;
 }
 
@@ -179,20 +303,92 @@ size_t WorkspaceGenerator::AddToys(size_t num_toys){
   if(num_toys == 0) return num_toys_;
   const RooArgSet *obs_orig = w_.set("observables");
   if(obs_orig == nullptr) ERROR("Could not get observables list for toy generation");
-  RooArgSet obs(*obs_orig);
-  SetupToys(obs);
-  for(size_t itoy = num_toys_; itoy < num_toys_+num_toys; ++itoy){
-    GenerateToys(obs);
-    RooDataSet data_new(("data_obs_"+to_string(itoy)).c_str(), ("data_obs_"+to_string(itoy)).c_str(), obs);
-    data_new.add(obs);
-    w_.import(data_new);
-  }
-  ResetToys(obs);
+
+  vector<string> names;
+  TIterator *iter_ptr = obs_orig->createIterator();
+  if(iter_ptr == nullptr) ERROR("Could not generator iterator to set up toys");
+  for(; iter_ptr != nullptr && *(*iter_ptr) != nullptr; iter_ptr->Next()){
+    RooRealVar *arg = static_cast<RooRealVar*>(*(*iter_ptr));
+    if(arg == nullptr) continue;
+    names.push_back(arg->GetName());
+  }
+  delete iter_ptr;
+
+  //Same observables in the same order as ToyFitter, so both draw the same toys
+  RooArgSet obs;
+  vector<RooRealVar*> vars;
+  vector<double> rates;
+  for(const auto &name: ToyFitter::ToyObservables(names)){
+    RooRealVar *arg = w_.var(name.c_str());
+    if(arg == nullptr) ERROR("Could not find observable "+name);
+    obs.add(*arg);
+    vars.push_back(arg);
+    rates.push_back(arg->getVal());
+  }
+
+  //Each toy draws from its own stream keyed by (seed, toy index), so the toys do not
+  //depend on how they are split across threads
+  const size_t toys_per_task = 64;
+  size_t num_threads = YieldManager::NumThreads();
+  unique_ptr<ThreadPool> pool(num_threads > 0 ? new ThreadPool(num_threads) : new ThreadPool());
+  vector<future<vector<vector<double> > > > futures;
+  for(size_t first = num_toys_; first < num_toys_+num_toys; first += toys_per_task){
+    size_t num_task = min(toys_per_task, num_toys_+num_toys-first);
+    futures.push_back(pool->Push(GenerateToys, toy_seed_, first, num_task, cref(rates)));
+  }
+
+  //All toys are stored in one dataset with one row per toy; the "toy" column gives its index
+  RooRealVar toy("toy", "toy", 0., 0., numeric_limits<double>::max());
+  RooArgSet toy_vars(obs);
+  toy_vars.add(toy);
+  RooDataSet data_toys("data_toys", "data_toys", toy_vars);
+  size_t itoy = num_toys_;
+  for(auto &task: futures){
+    for(const auto &values: task.get()){
+      for(size_t iobs = 0; iobs < vars.size(); ++iobs){
+        vars.at(iobs)->setVal(values.at(iobs));
+      }
+      toy.setVal(itoy);
+      data_toys.add(toy_vars);
+      if(split_toys_){
+        RooDataSet data_new(("data_obs_"+to_string(itoy)).c_str(), ("data_obs_"+to_string(itoy)).c_str(), obs);
+        data_new.add(obs);
+        w_.import(data_new);
+      }
+      ++itoy;
+    }
+  }
+  for(size_t iobs = 0; iobs < vars.size(); ++iobs){
+    vars.at(iobs)->setVal(rates.at(iobs));
+  }
+
+  RooDataSet *old_toys = static_cast<RooDataSet*>(w_.data("data_toys"));
+  if(old_toys == nullptr){
+    w_.import(data_toys);
+  }else{
+    old_toys->append(data_toys);
+  }
   num_toys_ += num_toys;
   return num_toys_;
 }
 
+uint64_t WorkspaceGenerator::GetToySeed() const{
+  return toy_seed_;
+}
+
+WorkspaceGenerator & WorkspaceGenerator::SetToySeed(uint64_t toy_seed){
+  toy_seed_ = toy_seed;
+  return *this;
+}
+
+bool WorkspaceGenerator::GetSplitToys() const{
+  return split_toys_;
+}
 
+WorkspaceGenerator & WorkspaceGenerator::SetSplitToys(bool split_toys){
+  split_toys_ = split_toys;
+  return *this;
+}
 
 const Process & WorkspaceGenerator::GetInjectionModel() const{
   if(inject_other_signal_){
@@ -205,6 +401,7 @@ const Process & WorkspaceGenerator::GetInjectionModel() const{
 WorkspaceGenerator & WorkspaceGenerator::SetInjectionModel(const Process &injection){
   inject_other_signal_ = true;
   injection_ = injection;
+  template_is_valid_ = false;
   return *this;
 }
 
@@ -214,68 +411,35 @@ bool WorkspaceGenerator::GetDefaultInjectionModel() const{
 
 WorkspaceGenerator & WorkspaceGenerator::SetDefaultInjectionModel(){
   inject_other_signal_ = false;
+  template_is_valid_ = false;
   return *this;
 }
 
-void WorkspaceGenerator::SetupToys(const RooArgSet &obs){
-  if(print_level_ >= PrintLevel::everything) DBG("");
-  obs_vals_.clear();
-  obs_gens_.clear();
-  TIterator *iter_ptr = obs.createIterator();
-  if(iter_ptr == nullptr) ERROR("Could not generator iterator to set up toys");
-  for(; iter_ptr != nullptr && *(*iter_ptr) != nullptr; iter_ptr->Next()){
-    RooAbsReal *arg = static_cast<RooAbsReal*>(*(*iter_ptr));
-    if(arg == nullptr) continue;
-    string name = arg->GetName();
-    if(Contains(name,"nobsmc")) continue;
-    double value = arg->getVal();
-    obs_vals_[name] = value;
-    obs_gens_[name] = poisson_distribution<>(value);
-  }
-  iter_ptr->Reset();
+uint64_t WorkspaceGenerator::RandomSeed(){
+  random_device r;
+  return (static_cast<uint64_t>(r()) << 32) | r();
 }
 
-void WorkspaceGenerator::GenerateToys(RooArgSet &obs){
-  if(print_level_ >= PrintLevel::everything) DBG("");
-  TIterator *iter_ptr = obs.createIterator();
-  if(iter_ptr == nullptr) ERROR("Could not generator iterator to set up toys");
-  for(; iter_ptr != nullptr && *(*iter_ptr) != nullptr; iter_ptr->Next()){
-    RooRealVar *arg = static_cast<RooRealVar*>(*(*iter_ptr));
-    if(arg == nullptr) continue;
-    string name = arg->GetName();
-    if(Contains(name,"nobsmc")) continue;
-    arg->setVal(obs_gens_[name](prng_));
-  }
-  iter_ptr->Reset();
+string WorkspaceGenerator::SourceDirectory(){
+  //Executables are built in run/, so the sources are found relative to the executable
+  //rather than the working directory
+  char path[PATH_MAX];
+  ssize_t size = readlink("/proc/self/exe", path, sizeof(path)-1);
+  if(size <= 0) ERROR("Could not locate the running executable");
+  string exe(path, size);
+  string run_dir = exe.substr(0, exe.rfind('/'));
+  return run_dir.substr(0, run_dir.rfind('/'));
 }
 
-void WorkspaceGenerator::ResetToys(RooArgSet &obs){
-  if(print_level_ >= PrintLevel::everything) DBG("");
-  TIterator *iter_ptr = obs.createIterator();
-  if(iter_ptr == nullptr) ERROR("Could not generator iterator to set up toys");
-  for(; iter_ptr != nullptr && *(*iter_ptr) != nullptr; iter_ptr->Next()){
-    RooRealVar *arg = static_cast<RooRealVar*>(*(*iter_ptr));
-    if(arg == nullptr) continue;
-    string name = arg->GetName();
-    if(Contains(name,"nobsmc")) continue;
-    double value = obs_vals_.at(name);
-    arg->setVal(value);
+vector<vector<double> > WorkspaceGenerator::GenerateToys(uint64_t seed,
+                                                         size_t first_toy,
+                                                         size_t num_toys,
+                                                         const vector<double> &rates){
+  vector<vector<double> > toys(num_toys, vector<double>(rates.size()));
+  for(size_t itoy = 0; itoy < num_toys; ++itoy){
+    toys.at(itoy) = ToyFitter::GenerateToy(seed, first_toy+itoy, rates);
   }
-  iter_ptr->Reset();
-}
-
-mt19937_64 WorkspaceGenerator::InitializePRNG(){
-  array<int, 128> sd;
-  random_device r;
-  generate_n(sd.begin(), sd.size(), ref(r));
-  seed_seq ss(begin(sd), end(sd));
-  return mt19937_64(ss);
-}
-
-int WorkspaceGenerator::GetPoisson(double rate){
-  using param_t = decltype(dist_)::param_type;
-  dist_.param(param_t{rate});
-  return dist_(prng_);
+  return toys;
 }
 
 void WorkspaceGenerator::UpdateWorkspace(){
@@ -287,6 +451,7 @@ void WorkspaceGenerator::UpdateWorkspace(){
   w_ = RooWorkspace("w");
   w_.SetName("w");
   w_.cd();
+  num_toys_ = 0;
 
   if(do_dilepton_){
     AddDileptonSystematic();
@@ -294,131 +459,244 @@ void WorkspaceGenerator::UpdateWorkspace(){
   if(do_systematics_){
     ReadSystematicsFile();
   }
-  AddPOI();
-  AddSystematicsGenerators();
+  ComputeYields();
+
+  //Only the signal nodes are rebuilt when the background and data model still applies;
+  //injected signal makes the data themselves depend on the signal
+  set<FreeSystematic> background_systematics = BackgroundSystematics();
+  if(template_is_valid_ && background_systematics == template_systematics_
+     && (sig_strength_ == 0. || inject_other_signal_)){
+    RestoreTemplate();
+  }else{
+    BuildTemplate();
+    template_systematics_ = background_systematics;
+  }
+
+  AddProcessSystematicsGenerators(set<Process>{signal_});
+  for(const auto &block: blocks_){
+    AddMCYields(block, set<Process>{signal_});
+    AddMCPdfs(block, set<Process>{signal_});
+    AddMCPdfProduct(block);
+    AddSignalPredictions(block);
+    AddAltPdfs(block);
+  }
+
+  // AddDummyNuisance();
+  AddFullPdf();
+  ImportNodes();
+  if(compiled_functions_){
+    //Ship the source of the compiled functions so the workspace can be read without
+    //libStatFunctions.so; RooFit compiles it on the fly when needed
+    static bool import_dirs_added = false;
+    if(!import_dirs_added){
+      string source_dir = SourceDirectory();
+      RooWorkspace::addClassDeclImportDir((source_dir+"/inc/").c_str());
+      RooWorkspace::addClassImplImportDir((source_dir+"/src/").c_str());
+      import_dirs_added = true;
+    }
+    if(!w_.importClassCode()){
+      ERROR("Could not import the class code of the compiled functions from "+SourceDirectory());
+    }
+  }
+  AddParameterSets();
+  AddModels();
+
+  w_is_valid_ = true;
+}
 
+void WorkspaceGenerator::BuildTemplate(){
+  if(print_level_ >= PrintLevel::everything) DBG("");
+  ClearNodes();
+  poi_.clear();
+  observables_.clear();
+  glob_observables_.clear();
+  nuisances_.clear();
+  systematics_.clear();
+
+  AddPOI();
+  AddBinSystematicsGenerators();
+  AddProcessSystematicsGenerators(backgrounds_);
   for(const auto &block: blocks_){
     AddData(block);
-    AddMCYields(block);
-    AddMCPdfs(block);
+    AddMCYields(block, backgrounds_);
+    AddMCPdfs(block, backgrounds_);
     AddMCProcessSums(block);
     AddBackgroundFractions(block);
     AddABCDParameters(block);
     AddRawBackgroundPredictions(block);
     if(do_mc_kappa_correction_) AddKappas(block);
     AddFullBackgroundPredictions(block);
-    AddSignalPredictions(block);
-    AddPdfs(block);
+    AddNullPdfs(block);
     AddDebug(block);
   }
 
-  // AddDummyNuisance();
-  AddFullPdf();
-  AddParameterSets();
-  AddModels();
+  template_size_ = nodes_.size();
+  template_glob_observables_ = glob_observables_;
+  template_nuisances_ = nuisances_;
+  template_syst_names_ = systematics_;
+  template_is_valid_ = true;
+}
 
-  w_is_valid_ = true;
+void WorkspaceGenerator::RestoreTemplate(){
+  if(print_level_ >= PrintLevel::everything) DBG("");
+  while(nodes_.size() > template_size_) RemoveLastNode();
+  glob_observables_ = template_glob_observables_;
+  nuisances_ = template_nuisances_;
+  systematics_ = template_syst_names_;
+  static_cast<RooRealVar*>(node_index_.at("r"))->setMax(rmax_);
 }
 
-void WorkspaceGenerator::AddPOI(){
+set<FreeSystematic> WorkspaceGenerator::BackgroundSystematics() const{
+  set<FreeSystematic> systs;
+  for(const auto &syst: free_systematics_){
+    FreeSystematic bkg_syst(syst.Name());
+    for(const auto &block: blocks_){
+      for(const auto &vbin: block.Bins()){
+        for(const auto &bin: vbin){
+          for(const auto &bkg: backgrounds_){
+            if(syst.HasEntry(bin, bkg)) bkg_syst.Strength(bin, bkg) = syst.Strength(bin, bkg);
+          }
+        }
+      }
+    }
+    Append(systs, bkg_syst);
+  }
+  return systs;
+}
+
+void WorkspaceGenerator::UpdateSignalWeights(){
+  if(print_level_ >= PrintLevel::everything) DBG(sig_xsec_f_);
+  //The cross section factor only enters the signal MC weights; the data, toys and the
+  //rest of the model are unchanged, so e.g. the Up/Down variants need no rebuild
+  auto all_prcs = backgrounds_;
+  Append(all_prcs, signal_);
+  for(const auto &block: blocks_){
+    for(const auto &vbin: block.Bins()){
+      for(const auto &bin: vbin){
+        for(const auto &prc: all_prcs){
+          if(!Contains(prc.Name(), "sig")) continue;
+          string name = "wmc_BLK_"+block.Name()+"_BIN_"+bin.Name()+"_PRC_"+prc.Name();
+          RooRealVar *wmc = w_.var(name.c_str());
+          if(wmc == nullptr) ERROR("Could not find "+name+" in workspace");
+          wmc->setVal(sig_xsec_f_*GetYield(bin, prc).Weight());
+        }
+      }
+    }
+    if(!barlow_beeston_lite_) continue;
+    for(size_t irow = 0; irow < block.Bins().size(); ++irow){
+      for(size_t icol = 0; icol < block.Bins().at(irow).size(); ++icol){
+        string name = "mcunc_alt_BLK_"+block.Name()+"_BIN_"+block.Bins().at(irow).at(icol).Name();
+        RooRealVar *mcunc = w_.var(name.c_str());
+        if(mcunc == nullptr) ERROR("Could not find "+name+" in workspace");
+        mcunc->setVal(TotalMCUncertainty(block, irow, icol));
+      }
+    }
+  }
+}
+
+void WorkspaceGenerator::ComputeYields() const{
   if(print_level_ >= PrintLevel::everything) DBG("");
-  w_.factory(("r[1.,0.,"+to_string(rmax_)+"]").c_str());
-  Append(poi_, "r");
+  yields_.Luminosity() = luminosity_;
+  yields_.ComputeYields(YieldKeys());
 }
 
-void WorkspaceGenerator::ReadSystematicsFile(){
-  if(systematics_file_ == "") return;
-  ifstream file(systematics_file_);
-  vector<string> lines;
-  string one_line;
-  while(getline(file, one_line)){
-    CleanLine(one_line);
-    if(one_line != ""){
-      lines.push_back(one_line);
+set<YieldKey> WorkspaceGenerator::YieldKeys() const{
+  set<YieldKey> keys;
+  auto all_prcs = backgrounds_;
+  Append(all_prcs, signal_);
+  if(inject_other_signal_) Append(all_prcs, injection_);
+  for(const auto &block: blocks_){
+    for(const auto &vbin: block.Bins()){
+      for(const auto &bin: vbin){
+        for(const auto &prc: all_prcs){
+          Append(keys, YieldKey(bin, prc, baseline_));
+        }
+        if(!bin.Blind()){
+          Append(keys, YieldKey(bin, data_, baseline_));
+        }
+      }
     }
   }
+  return keys;
+}
+
+void WorkspaceGenerator::AddPOI(){
+  if(print_level_ >= PrintLevel::everything) DBG("");
+  AddVar("r", 1., 0., rmax_);
+  Append(poi_, "r");
+}
 
-  vector<vector<string> > words;
-  for(const auto &line: lines){
-    vector<string> these_words = Tokenize(line);
-    words.push_back(these_words);
+void WorkspaceGenerator::ReadSystematicsFile(){
+  free_systematics_.clear();
+  vector<SystematicsDatabase::Entry> entries;
+  if(systematics_db_){
+    entries = systematics_db_->Entries(systematics_point_.first, systematics_point_.second);
+  }else if(systematics_file_ != ""){
+    entries = SystematicsDatabase::ReadTextFile(systematics_file_);
+  }else{
+    return;
   }
 
   auto all_prc = backgrounds_;
   Append(all_prc, signal_);
-  string syst_name;
-  auto process_list = all_prc;
-  process_list.clear();
+  unordered_map<string, vector<const Process*> > processes_by_name;
+  for(const auto &prc: all_prc){
+    processes_by_name[prc.Name()].push_back(&prc);
+  }
+  unordered_map<string, vector<const Bin*> > bins_by_name;
+  for(const auto &block: blocks_){
+    for(const auto &vbin: block.Bins()){
+      for(const auto &bin: vbin){
+        bins_by_name[bin.Name()].push_back(&bin);
+      }
+    }
+  }
 
-  free_systematics_.clear();
   FreeSystematic this_systematic("BADBADBADBADBADBADBADBADBAD");
   bool ready = false;
-  for(const auto &line: words){
-    if(line.size() < 2){
-      string out;
-      for(const auto &word: line) out += word;
-      ERROR("Bad systematics line: "+out);
-    }
-    if(line.at(0) == "SYSTEMATIC"){
+  for(const auto &entry: entries){
+    if(!ready || entry.systematic != this_systematic.Name()){
       if(ready){
         Append(free_systematics_, this_systematic);
       }
-      this_systematic = FreeSystematic(line.at(1));
+      this_systematic = FreeSystematic(entry.systematic);
       ready = true;
-    }else if(line[0] == "PROCESSES"){
-      process_list.clear();
-      for(size_t iword = 1; iword < line.size(); ++iword){
-        bool found = false;
-        vector<string> names = Tokenize(line.at(iword), ", ");
-        for(const auto &name: names){
-          for(const auto &prc: all_prc){
-            if(name == prc.Name()){
-              Append(process_list, prc);
-              found = true;
-            }
-          }
-          if(!found){
-            ERROR("Systematic "+this_systematic.Name()
-                                +" could not be applied to process "+line.at(iword));
-          }
-        }
+    }
+
+    vector<const Process*> process_list;
+    for(const auto &name: entry.processes){
+      auto prcs = processes_by_name.find(name);
+      if(prcs == processes_by_name.end()){
+        ERROR("Systematic "+this_systematic.Name()
+              +" could not be applied to process "+name);
       }
-    }else{
-      bool found = false;
-      string clean_line(line.at(0));
-      ReplaceAll(clean_line, " ", "");
-      ReplaceAll(clean_line, "\t", "");
-      for(const auto &block: blocks_){
-        for(const auto &vbin: block.Bins()){
-          for(const auto &bin: vbin){
-            if(bin.Name() != clean_line) continue;
-            for(const auto &prc: process_list){
-              float syst(atof(line.at(1).c_str()));
-              if(isnan(syst)){
-                DBG("Systematic " << this_systematic.Name() << " is NaN for bin "
-                  << bin.Name() << ", process " << prc.Name());
-                syst = 0.;
-              }
-              if(isinf(syst)){
-                DBG("Systematic " << this_systematic.Name() << " is infinite for bin "
-                  << bin.Name() << ", process " << prc.Name());
-                if(syst>0.){
-                  syst = 1.;
-                }else{
-                  syst = -1.;
-                }
-              }
-              if(syst>=0) this_systematic.Strength(bin, prc) = log(1+syst);
-              else this_systematic.Strength(bin, prc) = -log(1+fabs(syst));
-              found = true;
-            }
+      process_list.insert(process_list.end(), prcs->second.cbegin(), prcs->second.cend());
+    }
+    auto bins = bins_by_name.find(entry.bin);
+    if(bins == bins_by_name.end() || process_list.empty()){
+      ERROR("Systematic "+this_systematic.Name()
+            +" could not be applied to bin "+entry.bin);
+    }
 
+    for(const auto &bin: bins->second){
+      for(const auto &prc: process_list){
+        float syst(entry.value);
+        if(isnan(syst)){
+          DBG("Systematic " << this_systematic.Name() << " is NaN for bin "
+              << bin->Name() << ", process " << prc->Name());
+          syst = 0.;
+        }
+        if(isinf(syst)){
+          DBG("Systematic " << this_systematic.Name() << " is infinite for bin "
+              << bin->Name() << ", process " << prc->Name());
+          if(syst>0.){
+            syst = 1.;
+          }else{
+            syst = -1.;
           }
         }
-      }
-      if(!found){
-        ERROR("Systematic "+this_systematic.Name()
-                            +" could not be applied to bin "+line.at(0));
+        if(syst>=0) this_systematic.Strength(*bin, *prc) = log(1+syst);
+        else this_systematic.Strength(*bin, *prc) = -log(1+fabs(syst));
       }
     }
   }
@@ -427,21 +705,6 @@ void WorkspaceGenerator::ReadSystematicsFile(){
   }
 }
 
-void WorkspaceGenerator::CleanLine(string &line){
-  ReplaceAll(line, "=", "");
-  string old = line;
-  do{
-    old = line;
-    ReplaceAll(line, "  ", " ");
-  } while (line != old);
-  while(line.size() > 0 && line[0] == ' '){
-    line = line.substr(1);
-  }
-  if(line.size() > 0 && line[0] == '#'){
-    line = "";
-  }
-}
-
 void WorkspaceGenerator::AddDileptonSystematic(){
   if(print_level_ >= PrintLevel::everything) DBG("");
 
@@ -517,7 +780,7 @@ void WorkspaceGenerator::MakeDileptonBin(const Bin &bin, Bin &dilep_bin, Cut &di
   dilep_cut.RmCutOn("mt");
 }
 
-void WorkspaceGenerator::AddSystematicsGenerators(){
+void WorkspaceGenerator::AddBinSystematicsGenerators(){
   if(print_level_ >= PrintLevel::everything) DBG("");
   for(const auto &block: blocks_){
     for(const auto &vbin: block.Bins()){
@@ -525,49 +788,35 @@ void WorkspaceGenerator::AddSystematicsGenerators(){
         for(const auto &syst: bin.Systematics()){
           AddSystematicGenerator(syst.Name());
           string full_name = syst.Name()+"_BLK_"+block.Name()+"_BIN_"+bin.Name();
-          ostringstream oss;
-          oss << "strength_" << full_name << "[" << syst.Strength() << "]" << flush;
-          w_.factory(oss.str().c_str());
-          oss.str("");
-          oss << "expr::" << full_name
-              << "('exp(@0*@1)',strength_" << full_name << "," << syst.Name() << ")" << flush;
-          w_.factory(oss.str().c_str());
+          AddVar("strength_"+full_name, syst.Strength());
+          AddExpProduct(full_name, {"strength_"+full_name, syst.Name()});
         }
       }
     }
   }
+}
 
-  auto all_prcs = backgrounds_;
-  Append(all_prcs, signal_);
-  for(const auto &bkg: all_prcs){
+void WorkspaceGenerator::AddProcessSystematicsGenerators(const set<Process> &processes){
+  if(print_level_ >= PrintLevel::everything) DBG("");
+  for(const auto &bkg: processes){
     for(const auto &syst: bkg.Systematics()){
       AddSystematicGenerator(syst.Name());
       string full_name = syst.Name()+"_PRC_"+bkg.Name();
-      ostringstream oss;
-      oss << "strength_" << full_name << "[" << syst.Strength() << "]" << flush;
-      w_.factory(oss.str().c_str());
-      oss.str("");
-      oss << "expr::" << full_name
-          << "('exp(@0*@1)',strength_" << full_name << "," << syst.Name() << ")" << flush;
-      w_.factory(oss.str().c_str());
+      AddVar("strength_"+full_name, syst.Strength());
+      AddExpProduct(full_name, {"strength_"+full_name, syst.Name()});
     }
   }
 
   for(const auto &syst: free_systematics_){
-    AddSystematicGenerator(syst.Name());
     for(const auto &block: blocks_){
       for(const auto &vbin: block.Bins()){
         for(const auto &bin: vbin){
-          for(const auto &prc: all_prcs){
+          for(const auto &prc: processes){
             if(!syst.HasEntry(bin, prc)) continue;
+            AddSystematicGenerator(syst.Name());
             string full_name = syst.Name()+"_BIN_"+bin.Name()+"_PRC_"+prc.Name();
-            ostringstream oss;
-            oss << "strength_" << full_name << "[" << syst.Strength(bin, prc) << "]" << flush;
-            w_.factory(oss.str().c_str());
-            oss.str("");
-            oss << "expr::" << full_name
-                << "('exp(@0*@1)',strength_" << full_name << "," << syst.Name() << ")" << flush;
-            w_.factory(oss.str().c_str());
+            AddVar("strength_"+full_name, syst.Strength(bin, prc));
+            AddExpProduct(full_name, {"strength_"+full_name, syst.Name()});
           }
         }
       }
@@ -578,13 +827,12 @@ void WorkspaceGenerator::AddSystematicsGenerators(){
 void WorkspaceGenerator::AddSystematicGenerator(const string &name){
   if(print_level_ >= PrintLevel::everything) DBG(name);
   if(systematics_.find(name) != systematics_.end()) return;
-  ostringstream oss;
-  oss.str("");
-  oss << name << "_0" << flush;
-  Append(glob_observables_, oss.str());
-  oss << "[0.]" << flush;
-  w_.factory(oss.str().c_str());
-  w_.factory(("RooGaussian::constraint_"+name+"("+name+"[0.,-10.,10.],"+name+"_0,1.)").c_str());
+  Append(glob_observables_, name+"_0");
+  AddVar(name+"_0", 0.);
+  AddVar(name, 0., -10., 10.);
+  AddNode(new RooGaussian(("constraint_"+name).c_str(), ("constraint_"+name).c_str(),
+                          Node(name), Node(name+"_0"), RooFit::RooConst(1.)),
+          CompactModel::NodeType::gaussian, 1.);
   Append(nuisances_, name);
   Append(systematics_, name);
 }
@@ -608,14 +856,11 @@ void WorkspaceGenerator::AddData(const Block &block){
         gps = GetYield(bin, data_);
       }
 
-      ostringstream oss;
-      oss << "nobs_BLK_" << block.Name()
-          << "_BIN_" << bin.Name() << flush;
+      string name = "nobs_BLK_"+block.Name()+"_BIN_"+bin.Name();
       if(use_r4_ || !Contains(bin.Name(), "4")){
-        Append(observables_, oss.str());
+        Append(observables_, name);
       } //attn
-      oss << "[" << gps.Yield() << "]" << flush;
-      w_.factory(oss.str().c_str());
+      AddVar(name, gps.Yield());
     }
   }
 }
@@ -624,11 +869,10 @@ void WorkspaceGenerator::AddBackgroundFractions(const Block &block){
   if(print_level_ >= PrintLevel::everything) DBG(block);
   for(const auto &vbin: block.Bins()){
     for(const auto &bin: vbin){
+      string bb_name = "BLK_"+block.Name()+"_BIN_"+bin.Name();
       for(const auto &bkg: backgrounds_){
-        string var = "expr::frac_BIN_"+bin.Name()+"_PRC_"+bkg.Name()
-          +"('@0/@1',ymc_BLK_"+block.Name()+"_BIN_"+bin.Name()+"_PRC_"+bkg.Name()
-          +",ymc_BLK_"+block.Name()+"_BIN_"+bin.Name()+")";
-        w_.factory(var.c_str());
+        AddRatio("frac_BIN_"+bin.Name()+"_PRC_"+bkg.Name(),
+                 {"ymc_"+bb_name+"_PRC_"+bkg.Name()}, {"ymc_"+bb_name});
       }
     }
   }
@@ -638,49 +882,29 @@ void WorkspaceGenerator::AddABCDParameters(const Block &block){
   if(print_level_ >= PrintLevel::everything) DBG(block);
   BlockYields by(block, backgrounds_, baseline_, yields_);
 
-  ostringstream rxss, ryss;
-  rxss << "sum::rxnorm_BLK_" << block.Name() << "(1.,";
-  ryss << "sum::rynorm_BLK_" << block.Name() << "(1.,";
-  ostringstream oss;
-  oss << "norm_BLK_" << block.Name() << flush;
-  // Append(nuisances_, oss.str());
-  oss << "[" << max(1., 0.8*by.Total().Yield()) << ",0.,"
-      << max(5.*by.Total().Yield(), 20.) << "]" << flush;
-  w_.factory(oss.str().c_str());
+  string blk_name = "_BLK_"+block.Name();
+  // Append(nuisances_, "norm"+blk_name);
+  AddVar("norm"+blk_name, max(1., 0.8*by.Total().Yield()), 0., max(5.*by.Total().Yield(), 20.));
+  vector<string> ry_list;
   for(size_t irow = 0; irow < by.RowSums().size(); ++irow){
     if(irow == by.MaxRow()) continue;
-    oss.str("");
-    oss << "ry" << (irow+1) << (by.MaxRow()+1) << "_BLK_" << block.Name() << flush;
-    ryss << "," << oss.str();
-    // Append(nuisances_, oss.str());
-    oss << "[" << by.RowSums().at(irow).Yield()/by.RowSums().at(by.MaxRow()).Yield()
-        << ",0.,10.]" << flush;
-    w_.factory(oss.str().c_str());
-  }
-  ryss << ")" << flush;
-  w_.factory(ryss.str().c_str());
+    string name = "ry"+to_string(irow+1)+to_string(by.MaxRow()+1)+blk_name;
+    Append(ry_list, name);
+    // Append(nuisances_, name);
+    AddVar(name, by.RowSums().at(irow).Yield()/by.RowSums().at(by.MaxRow()).Yield(), 0., 10.);
+  }
+  AddSum("rynorm"+blk_name, ry_list, 1.);
+  vector<string> rx_list;
   for(size_t icol = 0; icol < by.ColSums().size(); ++icol){
     if(icol == by.MaxCol()) continue;
-    oss.str("");
-    oss << "rx" << (icol+1) << (by.MaxCol()+1) << "_BLK_" << block.Name() << flush;
-    rxss << "," << oss.str();
-    // Append(nuisances_, oss.str()); /
-    oss << "[" << by.ColSums().at(icol).Yield()/by.ColSums().at(by.MaxCol()).Yield()
-        << ",0.,10.]" << flush;
-    w_.factory(oss.str().c_str());
-  }
-  rxss << ")" << flush;
-  w_.factory(rxss.str().c_str());
-  oss.str("");
-  oss << "prod::rnorm_BLK_" << block.Name()
-      << "(rxnorm_BLK_" << block.Name()
-      << ",rynorm_BLK_" << block.Name() << ")" << flush;
-  w_.factory(oss.str().c_str());
-  oss.str("");
-  oss << "expr::rscale_BLK_" << block.Name()
-      << "('@0/@1',norm_BLK_" << block.Name()
-      << ",rnorm_BLK_" << block.Name() << ")" << flush;
-  w_.factory(oss.str().c_str());
+    string name = "rx"+to_string(icol+1)+to_string(by.MaxCol()+1)+blk_name;
+    Append(rx_list, name);
+    // Append(nuisances_, name);
+    AddVar(name, by.ColSums().at(icol).Yield()/by.ColSums().at(by.MaxCol()).Yield(), 0., 10.);
+  }
+  AddSum("rxnorm"+blk_name, rx_list, 1.);
+  AddProduct("rnorm"+blk_name, {"rxnorm"+blk_name, "rynorm"+blk_name});
+  AddRatio("rscale"+blk_name, {"norm"+blk_name}, {"rnorm"+blk_name});
 }
 
 void WorkspaceGenerator::AddRawBackgroundPredictions(const Block &block){
@@ -696,38 +920,27 @@ void WorkspaceGenerator::AddRawBackgroundPredictions(const Block &block){
       for(const auto &bkg: backgrounds_){
         string prod_name = "rate_"+bb_name+"_PRC_"+bkg.Name();
         Append(prod_list, prod_name);
-        string factory_string = "prod::"+prod_name+"(rscale_BLK_"+block.Name();
+        vector<string> factors(1, "rscale_BLK_"+block.Name());
         if(icol != max_col){
-          ostringstream oss;
-          oss << ",rx" << (icol+1) << (max_col+1) << "_BLK_" << block.Name() << flush;
-          factory_string += oss.str();
+          Append(factors, "rx"+to_string(icol+1)+to_string(max_col+1)+"_BLK_"+block.Name());
         }
         if(irow != max_row){
-          ostringstream oss;
-          oss << ",ry" << (irow+1) << (max_row+1) << "_BLK_" << block.Name() << flush;
-          factory_string += oss.str();
+          Append(factors, "ry"+to_string(irow+1)+to_string(max_row+1)+"_BLK_"+block.Name());
         }
-        factory_string += (",frac_BIN_"+bin.Name()+"_PRC_"+bkg.Name());
+        Append(factors, "frac_BIN_"+bin.Name()+"_PRC_"+bkg.Name());
         if(do_systematics_){
           for(const auto &syst: bkg.Systematics()){
-            factory_string += (","+syst.Name()+"_PRC_"+bkg.Name());
+            Append(factors, syst.Name()+"_PRC_"+bkg.Name());
           }
           for(const auto &syst: free_systematics_){
             if(syst.HasEntry(bin, bkg)){
-              factory_string += (","+syst.Name()+"_BIN_"+bin.Name()+"_PRC_"+bkg.Name());
+              Append(factors, syst.Name()+"_BIN_"+bin.Name()+"_PRC_"+bkg.Name());
             }
           }
         }
-        factory_string += ")";
-        w_.factory(factory_string.c_str());
+        AddProduct(prod_name, factors);
       }
-      string factory_string="sum::nbkg_raw_"+bb_name+"(";
-      for(auto prod = prod_list.cbegin(); prod != prod_list.cend(); ++prod){
-        if(prod != prod_list.cbegin()) factory_string += ",";
-        factory_string += *prod;
-      }
-      factory_string += ")";
-      w_.factory(factory_string.c_str());
+      AddSum("nbkg_raw_"+bb_name, prod_list);
     }
   }
 }
@@ -741,82 +954,70 @@ void WorkspaceGenerator::AddKappas(const Block &block){
   AddMCKappa(block);
 }
 
-void WorkspaceGenerator::AddMCYields(const Block & block){
+void WorkspaceGenerator::AddMCYields(const Block & block, const set<Process> &processes){
   if(print_level_ >= PrintLevel::everything) DBG(block);
   for(const auto &vbin: block.Bins()){
     for(const auto &bin: vbin){
       string bb_name = "BLK_"+block.Name()+"_BIN_"+bin.Name();
-      ostringstream oss;
-      auto all_prcs = backgrounds_;
-      Append(all_prcs, signal_);
-      for(const auto &bkg: all_prcs){
+      for(const auto &bkg: processes){
         GammaParams gp = GetYield(bin, bkg);
         if(Contains(bkg.Name(), "sig")) gp *= sig_xsec_f_;
         string bbp_name = bb_name + "_PRC_"+bkg.Name();
-        oss.str("");
-        oss << "nobsmc_" << bbp_name << flush;
-        Append(glob_observables_, oss.str());
-        oss << "[" << gp.NEffective() << "]" << flush;
-        w_.factory(oss.str().c_str());
-        oss.str("");
-        oss << "nmc_" << bbp_name << flush;
-        Append(nuisances_, oss.str());
-        oss << "[" << gp.NEffective()
-            << ",0.," << max(5.*gp.NEffective(), 20.) << "]" << flush;
-        w_.factory(oss.str().c_str());
-        oss.str("");
-        oss << "wmc_" << bbp_name << "[" << gp.Weight() << "]" << flush;
-        w_.factory(oss.str().c_str());
-        oss.str("");
-        oss << "prod::ymc_" << bbp_name
-            << "(nmc_" << bbp_name
-            << ",wmc_" << bbp_name << ")" << flush;
-        w_.factory(oss.str().c_str());
+        if(barlow_beeston_lite_){
+          //MC statistics are profiled per bin in the data terms instead
+          AddVar("nmc_"+bbp_name, gp.NEffective());
+        }else{
+          Append(glob_observables_, "nobsmc_"+bbp_name);
+          AddVar("nobsmc_"+bbp_name, gp.NEffective());
+          Append(nuisances_, "nmc_"+bbp_name);
+          AddVar("nmc_"+bbp_name, gp.NEffective(), 0., max(5.*gp.NEffective(), 20.));
+        }
+        AddVar("wmc_"+bbp_name, gp.Weight());
+        AddProduct("ymc_"+bbp_name, {"nmc_"+bbp_name, "wmc_"+bbp_name});
       }
-      oss.str("");
     }
   }
 }
 
-void WorkspaceGenerator::AddMCPdfs(const Block &block){
+void WorkspaceGenerator::AddMCPdfs(const Block &block, const set<Process> &processes){
   if(print_level_ >= PrintLevel::everything) DBG(block);
-  bool first = true;
-  string factory_string = "PROD::pdf_mc_"+block.Name()+"(";
+  if(barlow_beeston_lite_) return;
   for(const auto &vbin: block.Bins()){
     for(const auto &bin: vbin){
-      auto all_prcs = backgrounds_;
-      Append(all_prcs, signal_);
-      for(const auto &bkg: all_prcs){
+      for(const auto &bkg: processes){
         string bbp_name = "BLK_"+block.Name()+"_BIN_"+bin.Name()+"_PRC_"+bkg.Name();
         AddPoisson("pdf_mc_"+bbp_name, "nobsmc_"+bbp_name, "nmc_"+bbp_name, gaus_approx_);
-        if(first) first = false;
-        else factory_string += ",";
-        factory_string += "pdf_mc_"+bbp_name;
       }
     }
   }
-  factory_string += ")";
-  w_.factory(factory_string.c_str());
+}
+
+void WorkspaceGenerator::AddMCPdfProduct(const Block &block){
+  if(print_level_ >= PrintLevel::everything) DBG(block);
+  if(barlow_beeston_lite_) return;
+  vector<string> pdf_list;
+  auto all_prcs = backgrounds_;
+  Append(all_prcs, signal_);
+  for(const auto &vbin: block.Bins()){
+    for(const auto &bin: vbin){
+      for(const auto &bkg: all_prcs){
+        Append(pdf_list, "pdf_mc_BLK_"+block.Name()+"_BIN_"+bin.Name()+"_PRC_"+bkg.Name());
+      }
+    }
+  }
+  AddPdfProduct("pdf_mc_"+block.Name(), pdf_list);
 }
 
 void WorkspaceGenerator::AddMCProcessSums(const Block &block){
   if(print_level_ >= PrintLevel::everything) DBG(block);
   for(const auto &vbin: block.Bins()){
     for(const auto &bin: vbin){
-      ostringstream oss;
       string bb_name = "BLK_"+block.Name()+"_BIN_"+bin.Name();
-      oss << "sum::ymc_" << bb_name << "(";
-      if(backgrounds_.size() > 0){
-        auto bkg = backgrounds_.cbegin();
-        string name = "ymc_"+bb_name+"_PRC_"+bkg->Name();
-        oss << name;
-        for(++bkg; bkg != backgrounds_.cend(); ++bkg){
-          name = "ymc_"+bb_name+"_PRC_"+bkg->Name();
-          oss << "," << name;
-        }
+      vector<string> terms;
+      for(const auto &bkg: backgrounds_){
+        Append(terms, "ymc_"+bb_name+"_PRC_"+bkg.Name());
       }
-      oss << ")" << flush;
-      w_.factory(oss.str().c_str());
+      AddSum("ymc_"+bb_name, terms);
     }
   }
 }
@@ -824,15 +1025,11 @@ void WorkspaceGenerator::AddMCProcessSums(const Block &block){
 void WorkspaceGenerator::AddMCRowSums(const Block &block){
   if(print_level_ >= PrintLevel::everything) DBG(block);
   for(size_t irow = 0; irow < block.Bins().size(); ++irow){
-    ostringstream oss;
-    oss << "sum::rowmc" << (irow+1) << "_BLK_" << block.Name() << "(";
-    auto bin = block.Bins().at(irow).cbegin();
-    oss << "ymc_BLK_" << block.Name() << "_BIN_" << bin->Name();
-    for(++bin; bin != block.Bins().at(irow).cend(); ++bin){
-      oss << ",ymc_BLK_" << block.Name() << "_BIN_" << bin->Name();
+    vector<string> terms;
+    for(const auto &bin: block.Bins().at(irow)){
+      Append(terms, "ymc_BLK_"+block.Name()+"_BIN_"+bin.Name());
     }
-    oss << ")" << flush;
-    w_.factory(oss.str().c_str());
+    AddSum("rowmc"+to_string(irow+1)+"_BLK_"+block.Name(), terms);
   }
 }
 
@@ -840,33 +1037,24 @@ void WorkspaceGenerator::AddMCColSums(const Block &block){
   if(print_level_ >= PrintLevel::everything) DBG(block);
   if(block.Bins().size() > 0 && block.Bins().at(0).size() > 0){
     for(size_t icol = 0; icol < block.Bins().at(0).size(); ++icol){
-      ostringstream oss;
-      oss << "sum::colmc" << (icol+1) << "_BLK_" << block.Name() << "(";
-      size_t irow = 0;
-      oss << "ymc_BLK_" << block.Name() << "_BIN_" << block.Bins().at(irow).at(icol).Name();
-      for(irow = 1; irow < block.Bins().size(); ++irow){
+      vector<string> terms;
+      for(size_t irow = 0; irow < block.Bins().size(); ++irow){
         if(icol < block.Bins().at(irow).size()){
-          oss << ",ymc_BLK_" << block.Name() << "_BIN_" << block.Bins().at(irow).at(icol).Name();
+          Append(terms, "ymc_BLK_"+block.Name()+"_BIN_"+block.Bins().at(irow).at(icol).Name());
         }
       }
-      oss << ")" << flush;;
-      w_.factory(oss.str().c_str());
+      AddSum("colmc"+to_string(icol+1)+"_BLK_"+block.Name(), terms);
     }
   }
 }
 
 void WorkspaceGenerator::AddMCTotal(const Block &block){
   if(print_level_ >= PrintLevel::everything) DBG(block);
-  ostringstream oss;
-  oss << "sum::totmc_BLK_" << block.Name() << "(";
-  if(block.Bins().size() > 0){
-    oss << "rowmc1_BLK_" << block.Name();
-    for(size_t irow = 1; irow < block.Bins().size(); ++irow){
-      oss << ",rowmc" << (irow+1) << "_BLK_" << block.Name();
-    }
+  vector<string> terms;
+  for(size_t irow = 0; irow < block.Bins().size(); ++irow){
+    Append(terms, "rowmc"+to_string(irow+1)+"_BLK_"+block.Name());
   }
-  oss << ")" << flush;
-  w_.factory(oss.str().c_str());
+  AddSum("totmc_BLK_"+block.Name(), terms);
 }
 
 void WorkspaceGenerator::AddMCPrediction(const Block &block){
@@ -874,12 +1062,10 @@ void WorkspaceGenerator::AddMCPrediction(const Block &block){
   for(size_t irow = 0; irow < block.Bins().size(); ++irow){
     for(size_t icol = 0; icol < block.Bins().at(irow).size(); ++icol){
       const Bin &bin = block.Bins().at(irow).at(icol);
-      ostringstream oss;
-      oss << "expr::predmc_BLK_" << block.Name() << "_BIN_" << bin.Name() << "("
-          << "'(@0*@1)/@2',rowmc" << (irow+1) << "_BLK_" << block.Name()
-          << ",colmc" << (icol+1) << "_BLK_" << block.Name()
-          << ",totmc_BLK_" << block.Name() << ")" << flush;
-      w_.factory(oss.str().c_str());
+      AddRatio("predmc_BLK_"+block.Name()+"_BIN_"+bin.Name(),
+               {"rowmc"+to_string(irow+1)+"_BLK_"+block.Name(),
+                   "colmc"+to_string(icol+1)+"_BLK_"+block.Name()},
+               {"totmc_BLK_"+block.Name()});
     }
   }
 }
@@ -890,12 +1076,7 @@ void WorkspaceGenerator::AddMCKappa(const Block &block){
     for(size_t icol = 0; icol < block.Bins().at(irow).size(); ++icol){
       const Bin &bin = block.Bins().at(irow).at(icol);
       string bb_name = "BLK_"+block.Name()+"_BIN_"+bin.Name();
-      ostringstream oss;
-      oss << "expr::kappamc_" << bb_name << "("
-          << "'@0/@1',ymc_" << bb_name
-          << ",predmc_" << bb_name
-          << ")" << flush;
-      w_.factory(oss.str().c_str());
+      AddRatio("kappamc_"+bb_name, {"ymc_"+bb_name}, {"predmc_"+bb_name});
     }
   }
 }
@@ -905,26 +1086,23 @@ void WorkspaceGenerator::AddFullBackgroundPredictions(const Block &block){
   for(const auto &vbin: block.Bins()){
     for(const auto &bin: vbin){
       string bb_name = "BLK_"+block.Name()+"_BIN_"+bin.Name();
-      ostringstream oss;
-      oss << "prod::nbkg_" << bb_name << "("
-          << "nbkg_raw_" << bb_name;
+      vector<string> factors(1, "nbkg_raw_"+bb_name);
       for(const auto &syst: bin.Systematics()){
         if(do_systematics_ && syst.Name().substr(0,6) != "dilep_"){
-          oss << "," << syst.Name() << "_" << bb_name;
+          Append(factors, syst.Name()+"_"+bb_name);
         }
       }
       if(do_systematics_){
         for(const auto &prc: backgrounds_){
           for(const auto &syst: prc.Systematics()){
-            oss << "," << syst.Name() << "_BIN_" << bin.Name() << "_PRC_" << prc.Name();
+            Append(factors, syst.Name()+"_BIN_"+bin.Name()+"_PRC_"+prc.Name());
           }
         }
       }
       if(do_mc_kappa_correction_){
-        oss << ",kappamc_" << bb_name;
+        Append(factors, "kappamc_"+bb_name);
       }
-      oss << ")" << flush;
-      w_.factory(oss.str().c_str());
+      AddProduct("nbkg_"+bb_name, factors);
     }
   }
 }
@@ -933,54 +1111,118 @@ void WorkspaceGenerator::AddSignalPredictions(const Block &block){
   if(print_level_ >= PrintLevel::everything) DBG(block);
   for(const auto &vbin: block.Bins()){
     for(const auto &bin: vbin){
-      ostringstream oss;
-      oss.str("");
-      oss << "prod::nsig_BLK_" << block.Name()
-          << "_BIN_" << bin.Name()
-          << "(r,"
-          << "ymc_BLK_" << block.Name()
-          << "_BIN_" << bin.Name()
-          << "_PRC_" << signal_.Name();
+      vector<string> factors{"r", "ymc_BLK_"+block.Name()+"_BIN_"+bin.Name()+"_PRC_"+signal_.Name()};
       if(do_systematics_){
         for(const auto &syst: signal_.Systematics()){
-          oss << "," << syst.Name() << "_BIN_" << bin.Name() << "_PRC_" << signal_.Name();
+          Append(factors, syst.Name()+"_BIN_"+bin.Name()+"_PRC_"+signal_.Name());
         }
         for(const auto &syst: free_systematics_){
           if(!syst.HasEntry(bin, signal_)) continue;
-          oss << "," << syst.Name() << "_BIN_" << bin.Name() << "_PRC_" << signal_.Name();
+          Append(factors, syst.Name()+"_BIN_"+bin.Name()+"_PRC_"+signal_.Name());
         }
       }
-      oss << ")" << flush;
-      w_.factory(oss.str().c_str());
+      AddProduct("nsig_BLK_"+block.Name()+"_BIN_"+bin.Name(), factors);
     }
   }
 }
 
-void WorkspaceGenerator::AddPdfs(const Block &block){
+void WorkspaceGenerator::AddNullPdfs(const Block &block){
   if(print_level_ >= PrintLevel::everything) DBG(block);
-  string null_list = "", alt_list = "";
-  bool is_first = true;
-  for(const auto &vbin: block.Bins()){
-    for(const auto &bin: vbin){
-      if(!is_first){
-        null_list += ",";
-        alt_list += ",";
+  vector<string> null_list;
+  for(size_t irow = 0; irow < block.Bins().size(); ++irow){
+    for(size_t icol = 0; icol < block.Bins().at(irow).size(); ++icol){
+      string bb_name = "_BLK_"+block.Name() +"_BIN_"+block.Bins().at(irow).at(icol).Name();
+      if(use_r4_ || !Contains(bb_name, "4")){
+        Append(null_list, "pdf_null"+bb_name);
+        if(barlow_beeston_lite_){
+          AddVar("mcunc_null"+bb_name, BackgroundMCUncertainty(block, irow, icol));
+          AddNode(new BarlowBeestonPoisson(("pdf_null"+bb_name).c_str(), ("pdf_null"+bb_name).c_str(),
+                                           Node("nobs"+bb_name), Node("nbkg"+bb_name),
+                                           Node("mcunc_null"+bb_name)),
+                  CompactModel::NodeType::barlow_beeston);
+        }else{
+          AddPoisson("pdf_null"+bb_name, "nobs"+bb_name, "nbkg"+bb_name, false);
+        }
       }
-      string bb_name = "_BLK_"+block.Name() +"_BIN_"+bin.Name();
-      string null_name = "pdf_null"+bb_name;
-      string alt_name = "pdf_alt"+bb_name;
-      w_.factory(("sum::nexp"+bb_name+"(nbkg"+bb_name+",nsig"+bb_name+")").c_str());
+    }
+  }
+  AddPdfProduct("pdf_null_BLK_"+block.Name(), null_list);
+}
+
+void WorkspaceGenerator::AddAltPdfs(const Block &block){
+  if(print_level_ >= PrintLevel::everything) DBG(block);
+  vector<string> alt_list;
+  for(size_t irow = 0; irow < block.Bins().size(); ++irow){
+    for(size_t icol = 0; icol < block.Bins().at(irow).size(); ++icol){
+      string bb_name = "_BLK_"+block.Name() +"_BIN_"+block.Bins().at(irow).at(icol).Name();
+      AddSum("nexp"+bb_name, {"nbkg"+bb_name, "nsig"+bb_name});
       if(use_r4_ || !Contains(bb_name, "4")){
-        null_list += null_name;
-        alt_list += alt_name;
-        AddPoisson("pdf_null"+bb_name, "nobs"+bb_name, "nbkg"+bb_name, false);
-        AddPoisson("pdf_alt"+bb_name, "nobs"+bb_name, "nexp"+bb_name, false);
-        is_first = false;
+        Append(alt_list, "pdf_alt"+bb_name);
+        if(barlow_beeston_lite_){
+          AddVar("mcunc_alt"+bb_name, TotalMCUncertainty(block, irow, icol));
+          AddNode(new BarlowBeestonPoisson(("pdf_alt"+bb_name).c_str(), ("pdf_alt"+bb_name).c_str(),
+                                           Node("nobs"+bb_name), Node("nexp"+bb_name),
+                                           Node("mcunc_alt"+bb_name)),
+                  CompactModel::NodeType::barlow_beeston);
+        }else{
+          AddPoisson("pdf_alt"+bb_name, "nobs"+bb_name, "nexp"+bb_name, false);
+        }
       }
     }
   }
-  w_.factory(("PROD:pdf_null_BLK_"+block.Name()+"("+null_list+")").c_str());
-  w_.factory(("PROD:pdf_alt_BLK_"+block.Name()+"("+alt_list+")").c_str());
+  AddPdfProduct("pdf_alt_BLK_"+block.Name(), alt_list);
+}
+
+double WorkspaceGenerator::BackgroundMCUncertainty(const Block &block, size_t irow, size_t icol) const{
+  //The MC only enters the background prediction through kappamc = ymc*tot/(row*col), so
+  //its relative uncertainty follows from the MC uncertainty of every bin in the block
+  if(!do_mc_kappa_correction_) return 0.;
+  const auto &bins = block.Bins();
+  vector<vector<double> > yields(bins.size()), variances(bins.size());
+  vector<double> rows(bins.size(), 0.), cols;
+  double tot = 0.;
+  for(size_t ir = 0; ir < bins.size(); ++ir){
+    for(size_t ic = 0; ic < bins.at(ir).size(); ++ic){
+      double yield = 0., variance = 0.;
+      for(const auto &bkg: backgrounds_){
+        GammaParams gp = GetYield(bins.at(ir).at(ic), bkg);
+        yield += gp.Yield();
+        variance += gp.Uncertainty()*gp.Uncertainty();
+      }
+      yields.at(ir).push_back(yield);
+      variances.at(ir).push_back(variance);
+      if(cols.size() <= ic) cols.resize(ic+1, 0.);
+      rows.at(ir) += yield;
+      cols.at(ic) += yield;
+      tot += yield;
+    }
+  }
+  if(yields.at(irow).at(icol) <= 0. || rows.at(irow) <= 0. || cols.at(icol) <= 0.) return 0.;
+
+  double rel_var = 0.;
+  for(size_t ir = 0; ir < bins.size(); ++ir){
+    for(size_t ic = 0; ic < bins.at(ir).size(); ++ic){
+      double deriv = 1./tot;
+      if(ir == irow && ic == icol) deriv += 1./yields.at(ir).at(ic);
+      if(ir == irow) deriv -= 1./rows.at(ir);
+      if(ic == icol) deriv -= 1./cols.at(ic);
+      rel_var += deriv*deriv*variances.at(ir).at(ic);
+    }
+  }
+  return sqrt(rel_var);
+}
+
+double WorkspaceGenerator::TotalMCUncertainty(const Block &block, size_t irow, size_t icol) const{
+  //Relative MC uncertainty of background plus nominal signal, used for the signal+background pdf
+  const Bin &bin = block.Bins().at(irow).at(icol);
+  double bkg = 0.;
+  for(const auto &prc: backgrounds_){
+    bkg += GetYield(bin, prc).Yield();
+  }
+  GammaParams sig = GetYield(bin, signal_);
+  if(Contains(signal_.Name(), "sig")) sig *= sig_xsec_f_;
+  if(bkg+sig.Yield() <= 0.) return 0.;
+  return hypot(BackgroundMCUncertainty(block, irow, icol)*bkg, sig.Uncertainty())/(bkg+sig.Yield());
 }
 
 void WorkspaceGenerator::AddDebug(const Block &block){
@@ -992,39 +1234,41 @@ void WorkspaceGenerator::AddDebug(const Block &block){
       const auto &r2 = "BLK_"+block.Name()+"_BIN_"+bins.at(0).at(ix).Name();
       const auto &r3 = "BLK_"+block.Name()+"_BIN_"+bins.at(iy).at(0).Name();
       const auto &r4 = "BLK_"+block.Name()+"_BIN_"+bins.at(iy).at(ix).Name();
-      w_.factory(("expr::syskappa_"+r4+"('(@0*@1)/(@2*@3)',nbkg_"+r4+",nbkg_"+r1+",nbkg_"+r2+",nbkg_"+r3+")").c_str());
-      w_.factory(("expr::nosyskappa_"+r4+"('(@0*@1)/(@2*@3)',ymc_"+r4+",ymc_"+r1+",ymc_"+r2+",ymc_"+r3+")").c_str());
+      AddRatio("syskappa_"+r4, {"nbkg_"+r4, "nbkg_"+r1}, {"nbkg_"+r2, "nbkg_"+r3});
+      AddRatio("nosyskappa_"+r4, {"ymc_"+r4, "ymc_"+r1}, {"ymc_"+r2, "ymc_"+r3});
     }
   }
 }
 
 void WorkspaceGenerator::AddDummyNuisance(){
-  w_.factory("RooGaussian::pdf_dummy_nuisance(dummy_nuisance[0.,-10.,10.],0.,1.)");
+  AddVar("dummy_nuisance", 0., -10., 10.);
+  AddNode(new RooGaussian("pdf_dummy_nuisance", "pdf_dummy_nuisance", Node("dummy_nuisance"),
+                          RooFit::RooConst(0.), RooFit::RooConst(1.)),
+          CompactModel::NodeType::unsupported);
   Append(nuisances_, "dummy_nuisance");
 }
 
 void WorkspaceGenerator::AddFullPdf(){
   if(print_level_ >= PrintLevel::everything) DBG("");
-  string null_list = "";//"pdf_dummy_nuisance";
-  string alt_list = "";//"pdf_dummy_nuisance";
-  bool is_first = true;
+  vector<string> null_list;//{"pdf_dummy_nuisance"};
+  vector<string> alt_list;//{"pdf_dummy_nuisance"};
   for(const auto &block: blocks_){
-    null_list += (is_first ? "pdf_null_BLK_" : ",pdf_null_BLK_") +block.Name();
-    alt_list += (is_first ? "pdf_alt_BLK_" : ",pdf_alt_BLK_" ) +block.Name();
-    is_first = false;
+    Append(null_list, "pdf_null_BLK_"+block.Name());
+    Append(alt_list, "pdf_alt_BLK_"+block.Name());
   }
   if(do_systematics_ || do_dilepton_){
     for(const auto &syst: systematics_){
-      null_list += (",constraint_"+syst);
-      alt_list += (",constraint_"+syst);
+      Append(null_list, "constraint_"+syst);
+      Append(alt_list, "constraint_"+syst);
     }
   }
   for(const auto & block: blocks_){
-    null_list += (",pdf_mc_"+block.Name());
-    alt_list += (",pdf_mc_"+block.Name());
+    if(barlow_beeston_lite_) break;
+    Append(null_list, "pdf_mc_"+block.Name());
+    Append(alt_list, "pdf_mc_"+block.Name());
   }
-  w_.factory(("PROD::model_b("+null_list+")").c_str());
-  w_.factory(("PROD::model_s("+alt_list+")").c_str());
+  AddPdfProduct("model_b", null_list);
+  AddPdfProduct("model_s", alt_list);
 }
 
 void WorkspaceGenerator::AddParameterSets(){
@@ -1078,21 +1322,174 @@ void WorkspaceGenerator::AddPoisson(const string &pdf_name,
                                     const string &n_name,
                                     const string &mu_name,
                                     bool allow_approx){
-  RooAbsReal *v_mu = w_.var(mu_name.c_str());
-  if(!v_mu) v_mu = w_.function(mu_name.c_str());
-  if(!v_mu) v_mu = w_.var(n_name.c_str());
-  if(!v_mu) v_mu = w_.function(n_name.c_str());
-  double mu = v_mu->getVal();
-  if(mu <= 50. || !allow_approx){
-    w_.factory(("RooPoisson::"+pdf_name+"("+n_name+","+mu_name+")").c_str());
-    (static_cast<RooPoisson*>(w_.pdf(pdf_name.c_str())))->setNoRounding();
-    (static_cast<RooPoisson*>(w_.pdf(pdf_name.c_str())))->protectNegativeMean();
+  auto mu = node_index_.find(mu_name);
+  if(mu == node_index_.end()) ERROR("Model has no node "+mu_name);
+  if(mu->second->getVal() <= 50. || !allow_approx){
+    RooPoisson *pdf = new RooPoisson(pdf_name.c_str(), pdf_name.c_str(), Node(n_name), Node(mu_name), true);
+    pdf->protectNegativeMean(true);
+    AddNode(pdf, CompactModel::NodeType::poisson);
   }else{
-    w_.factory(("expr::sqrt_"+mu_name+"('sqrt(@0)',"+mu_name+")").c_str());
-    w_.factory(("RooGaussian::"+pdf_name+"("+n_name+","+mu_name+",sqrt_"+mu_name+")").c_str());
+    AddSqrt("sqrt_"+mu_name, mu_name);
+    AddNode(new RooGaussian(pdf_name.c_str(), pdf_name.c_str(),
+                            Node(n_name), Node(mu_name), Node("sqrt_"+mu_name)),
+            CompactModel::NodeType::gaussian);
   }
 }
 
+RooAbsReal & WorkspaceGenerator::AddNode(RooAbsReal *node, CompactModel::NodeType type, double param){
+  //Like the factory, a second node with an existing name is dropped in favor of the first
+  unique_ptr<RooAbsReal> owned(node);
+  vector<string> servers;
+  servers.swap(pending_servers_);
+  auto existing = node_index_.find(owned->GetName());
+  if(existing != node_index_.end()) return *existing->second;
+  for(const auto &server: servers) ++num_clients_[server];
+  node_index_[owned->GetName()] = owned.get();
+  nodes_.push_back(move(owned));
+  node_servers_.push_back(servers);
+  node_types_.push_back(make_pair(type, param));
+  return *nodes_.back();
+}
+
+RooRealVar & WorkspaceGenerator::AddVar(const string &name, double value){
+  return static_cast<RooRealVar&>(AddNode(new RooRealVar(name.c_str(), name.c_str(), value),
+                                              CompactModel::NodeType::variable));
+}
+
+RooRealVar & WorkspaceGenerator::AddVar(const string &name, double value, double min, double max){
+  return static_cast<RooRealVar&>(AddNode(new RooRealVar(name.c_str(), name.c_str(), value, min, max),
+                                              CompactModel::NodeType::variable));
+}
+
+RooAbsReal & WorkspaceGenerator::AddProduct(const string &name, const vector<string> &factors){
+  return AddNode(new RooProduct(name.c_str(), name.c_str(), NodeList(factors)),
+                 CompactModel::NodeType::product);
+}
+
+RooAbsReal & WorkspaceGenerator::AddSum(const string &name, const vector<string> &terms,
+                                        double offset){
+  RooArgList list;
+  if(offset != 0.) list.add(RooFit::RooConst(offset));
+  list.add(NodeList(terms));
+  return AddNode(new RooAddition(name.c_str(), name.c_str(), list),
+                 CompactModel::NodeType::sum, offset);
+}
+
+RooAbsReal & WorkspaceGenerator::AddFormula(const string &name, const string &formula,
+                                            const vector<string> &arguments){
+  return AddNode(new RooFormulaVar(name.c_str(), name.c_str(), formula.c_str(), NodeList(arguments)),
+                 CompactModel::NodeType::unsupported);
+}
+
+RooAbsReal & WorkspaceGenerator::AddRatio(const string &name,
+                                          const vector<string> &numerators,
+                                          const vector<string> &denominators){
+  if(compiled_functions_){
+    return AddNode(new ProductRatio(name.c_str(), name.c_str(),
+                                    NodeList(numerators), NodeList(denominators)),
+                   CompactModel::NodeType::ratio, numerators.size());
+  }
+  string numerator, denominator;
+  for(size_t i = 0; i < numerators.size(); ++i){
+    numerator += (i ? "*@" : "@")+to_string(i);
+  }
+  for(size_t i = 0; i < denominators.size(); ++i){
+    denominator += (i ? "*@" : "@")+to_string(numerators.size()+i);
+  }
+  vector<string> arguments(numerators);
+  arguments.insert(arguments.end(), denominators.cbegin(), denominators.cend());
+  return AddFormula(name, "("+numerator+")/("+denominator+")", arguments);
+}
+
+RooAbsReal & WorkspaceGenerator::AddExpProduct(const string &name, const vector<string> &factors){
+  if(compiled_functions_){
+    return AddNode(new ExpProduct(name.c_str(), name.c_str(), NodeList(factors)),
+                   CompactModel::NodeType::exp_product);
+  }
+  string product;
+  for(size_t i = 0; i < factors.size(); ++i){
+    product += (i ? "*@" : "@")+to_string(i);
+  }
+  return AddFormula(name, "exp("+product+")", factors);
+}
+
+RooAbsReal & WorkspaceGenerator::AddSqrt(const string &name, const string &argument){
+  if(compiled_functions_){
+    return AddNode(new SqrtFunction(name.c_str(), name.c_str(), Node(argument)),
+                   CompactModel::NodeType::sqrt);
+  }
+  return AddFormula(name, "sqrt(@0)", {argument});
+}
+
+RooAbsReal & WorkspaceGenerator::AddPdfProduct(const string &name, const vector<string> &pdfs){
+  return AddNode(new RooProdPdf(name.c_str(), name.c_str(), NodeList(pdfs)),
+                 CompactModel::NodeType::pdf_product);
+}
+
+RooAbsReal & WorkspaceGenerator::Node(const string &name){
+  //Every node looked up is a server of the next node added
+  auto node = node_index_.find(name);
+  if(node == node_index_.end()) ERROR("Model has no node "+name);
+  Append(pending_servers_, name);
+  return *node->second;
+}
+
+RooArgList WorkspaceGenerator::NodeList(const vector<string> &names){
+  RooArgList list;
+  for(const auto &name: names) list.add(Node(name));
+  return list;
+}
+
+void WorkspaceGenerator::ImportNodes(){
+  //Importing the nodes no other node uses brings in the whole model, with shared
+  //sub-models recycled rather than imported twice
+  for(const auto &node: nodes_){
+    auto num_clients = num_clients_.find(node->GetName());
+    if(num_clients != num_clients_.end() && num_clients->second > 0) continue;
+    w_.import(*node, RooFit::RecycleConflictNodes(), RooFit::Silence());
+  }
+}
+
+CompactModel WorkspaceGenerator::MakeCompactModel() const{
+  //Variables are read back from the workspace, where signal updates are applied
+  CompactModel model;
+  for(size_t inode = 0; inode < nodes_.size(); ++inode){
+    const string name = nodes_.at(inode)->GetName();
+    const auto &type = node_types_.at(inode);
+    if(type.first != CompactModel::NodeType::variable){
+      model.AddNode(name, type.first, 0, node_servers_.at(inode), type.second);
+      continue;
+    }
+    const RooRealVar *var = w_.var(name.c_str());
+    if(var == nullptr) ERROR("Workspace has no variable "+name);
+    uint32_t flags = 0;
+    if(!var->isConstant()) flags |= CompactModel::floating;
+    if(poi_.find(name) != poi_.end()) flags |= CompactModel::poi;
+    if(nuisances_.find(name) != nuisances_.end()) flags |= CompactModel::nuisance;
+    if(observables_.find(name) != observables_.end()) flags |= CompactModel::observable;
+    if(glob_observables_.find(name) != glob_observables_.end()) flags |= CompactModel::global_observable;
+    model.AddNode(name, type.first, flags, node_servers_.at(inode),
+                  var->getVal(), var->getMin(), var->getMax());
+  }
+  return model;
+}
+
+void WorkspaceGenerator::RemoveLastNode(){
+  for(const auto &server: node_servers_.back()) --num_clients_.at(server);
+  node_index_.erase(nodes_.back()->GetName());
+  node_servers_.pop_back();
+  node_types_.pop_back();
+  nodes_.pop_back();
+}
+
+void WorkspaceGenerator::ClearNodes(){
+  //Clients are deleted before the nodes they depend on
+  while(!nodes_.empty()) RemoveLastNode();
+  num_clients_.clear();
+  pending_servers_.clear();
+  template_is_valid_ = false;
+}
+
 ostream & operator<<(ostream& stream, const WorkspaceGenerator &wg){
   for(const auto &block: wg.blocks_){
     for(const auto &vbin: block.Bins()){
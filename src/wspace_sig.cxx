@@ -5,15 +5,18 @@
 #include <sstream>
 #include <initializer_list>
 #include <vector>
+#include <memory>
 #include <string>
 #include <stdlib.h>
 #include <ctime>
+#include <cmath>
 #include <sys/stat.h>
 
 #include <unistd.h>
 #include <getopt.h>
 
 #include "TString.h"
+#include "TChain.h"
 #include "TSystem.h"
 #include "TDirectory.h"
 
@@ -25,6 +28,8 @@
 #include "cross_sections.hpp"
 
 #include "workspace_generator.hpp"
+#include "yield_manager.hpp"
+#include "systematics_database.hpp"
 
 using namespace std;
 
@@ -46,6 +51,9 @@ namespace{
   string lowmjthresh("250");
   string mjthresh("400");
   unsigned n_toys = 0;
+  uint64_t toy_seed = 0;
+  bool fixed_toy_seed = false;
+  bool split_toys = false;
   string sigfile = "";
   string injfile = "";
   bool inject_other_model = false;
@@ -54,6 +62,28 @@ namespace{
   string outfolder = "out/";
   bool nom_only = false;
   bool use_pois = false;
+  string yield_cache = "";
+  string sys_db = "";
+  bool formula_nodes = false;
+  bool bb_lite = false;
+  string skim_dir = "";
+  string scan = "";
+  string merged = "";
+
+  struct MassPoint{
+    string file;
+    int mglu, mlsp;
+    Process signal;
+  };
+
+  Process SignalProcess(const string &file);
+  Process MergedSignalProcess(const vector<string> &files, int mglu, int mlsp);
+  void ConfigureGenerator(WorkspaceGenerator &wg, double rmax, const Process &injection);
+  void MakeWorkspaces(const MassPoint &point,
+                      WorkspaceGenerator &wg,
+                      const Process &injection,
+                      const shared_ptr<const SystematicsDatabase> &database,
+                      const string &hostname);
 }
 //nbm = Sum$(jets_csv>CSVM&&jets_pt>30&&!jets_islep)
 int main(int argc, char *argv[]){
@@ -61,8 +91,8 @@ int main(int argc, char *argv[]){
   time(&begtime);
   cout << fixed << setprecision(2);
   GetOptions(argc, argv);
-  if(sigfile==""){
-    cout<<endl<<"You need to specify the input file with -f. Exiting"<<endl<<endl;
+  if(sigfile=="" && scan=="" && merged==""){
+    cout<<endl<<"You need to specify the input file with -f, a folder with --scan, or merged files with --merged. Exiting"<<endl<<endl;
     return 1;
   }
   string midjets = to_string(atoi(hijets.c_str())-1);
@@ -107,9 +137,6 @@ int main(int argc, char *argv[]){
 	  foldermc+"/*QCD_HT*0_Tune*.root/tree",
 	  foldermc+"/*QCD_HT*Inf_Tune*.root/tree"}
     },stitch_cuts};
-  Process signal{"signal", {
-      {sigfile+"/tree"}
-    },"stitch", false, true};
   Process injection{"injection", {
       {injfile+"/tree"}
     },"stitch", false, true};
@@ -322,109 +349,73 @@ int main(int argc, char *argv[]){
   }
 
 
-  //// Parsing the gluino and LSP masses
-  int mglu, mlsp;
-  parseMasses(sigfile, mglu, mlsp);
-  string glu_lsp("mGluino-"+to_string(mglu)+"_mLSP-"+to_string(mlsp));
-  
-  //// Creating workspaces for the Nominal, uncert Up, and uncert Down signal cross sections
-  Cut *pbaseline(&baseline1b);
-  set<Block> *pblocks(&blocks_1bk);
-  string model = "T1tttt";
-  
-  string sysfolder = "/net/cms2/cms2r0/babymaker/sys/2017_02_22/T1tttt_fakePU/";
-  //Protect default
-  if(binning=="nominal" && lumi < 3) sysfolder = "/net/cms2/cms2r0/babymaker/sys/2016_01_11/scan/";
-  
-  if(Contains(hostname, "lxplus")) sysfolder = "txt/systematics/";
-  if(Contains(sigfile, "T5tttt")) {
-    sysfolder = "/net/cms2/cms2r0/babymaker/sys/2017_02_22/T5tttt_fakePU/";
-    model = "T5tttt";
-  }
-  if(Contains(sigfile, "T2tt")) {
-    sysfolder = "/net/cms2/cms2r0/babymaker/sys/2016_02_09/T2tt/";
-    model = "T2tt";
+  //// Mass points: the single -f file, every SMS file matched by --scan, or every
+  //// (mgluino, mlsp) pair found in the merged files given with --merged
+  vector<MassPoint> points;
+  if(merged != ""){
+    vector<string> mergedfiles = Glob(merged);
+    TChain chain("tree", "tree");
+    for(const auto &file: mergedfiles) chain.Add(file.c_str());
+    for(const auto &masses: GetDistinctValues(chain, {"mgluino", "mlsp"})){
+      int mglu = lround(masses.at(0)), mlsp = lround(masses.at(1));
+      points.push_back(MassPoint{mergedfiles.front(), mglu, mlsp, MergedSignalProcess(mergedfiles, mglu, mlsp)});
+    }
+    cout<<"found "<<points.size()<<" mass points in "<<mergedfiles.size()<<" merged files"<<endl;
+    if(points.size() == 0) return 1;
+  }else{
+    vector<string> sigfiles;
+    if(scan == ""){
+      sigfiles.push_back(sigfile);
+    }else{
+      string pattern = scan;
+      struct stat scan_stat;
+      if(stat(scan.c_str(), &scan_stat) == 0 && S_ISDIR(scan_stat.st_mode)) pattern = scan+"/*SMS*.root";
+      sigfiles = Glob(pattern);
+      cout<<"scanning "<<sigfiles.size()<<" mass points in "<<pattern<<endl;
+      if(sigfiles.size() == 0) return 1;
+    }
+    for(const auto &file: sigfiles){
+      int mglu, mlsp;
+      parseMasses(file, mglu, mlsp);
+      points.push_back(MassPoint{file, mglu, mlsp, SignalProcess(file)});
+    }
   }
-  if(Contains(sigfile, "T6ttWW")) {
-    sysfolder = "/net/cms2/cms2r0/babymaker/sys/2016_02_09/T6ttWW/";
-    model = "T6ttWW";
+
+  gSystem->mkdir(outfolder.c_str(), kTRUE);
+  if(yield_cache != ""){
+    cout<<"yield cache is "<<yield_cache<<endl;
+    YieldManager::CacheFile(yield_cache);
   }
-  cout<<"sysfolder is "<<sysfolder<<endl;
-  
-  //  string sysfile(sysfolder+"sys_SMS-"+model+"_"+glu_lsp+"_"+to_string(lumi)+"ifb");
-  string sysfile(sysfolder+"sys_SMS-"+model+"_"+glu_lsp+"_35.9ifb");
-  if(binning!="alternate") sysfile+="_nominal.txt";
-  
-  if(binning=="nominal" && lumi < 3) sysfile = sysfolder+"sys_SMS-"+model+"_"+glu_lsp+".txt";
-  if(dummy_syst) sysfile = dummy_syst_file;
-  cout<<"sysfile is "<<sysfile<<endl;
-  // If systematic file does not exist, use m1bk_nc for tests
-  struct stat buffer;   
-  if(stat (sysfile.c_str(), &buffer) != 0) {
-    cout<<endl<<"WARNING: "<<sysfile<<" does not exist. Using ";
-    sysfile = "txt/systematics/m1bk_nc.txt";
-    cout<<sysfile<<" instead"<<endl<<endl;
+  if(skim_dir != ""){
+    cout<<"skim folder is "<<skim_dir<<endl;
+    gSystem->mkdir(skim_dir.c_str(), kTRUE);
+    YieldManager::SkimDir(skim_dir);
   }
-  
-  // Cross sections
-  float xsec, xsec_unc;
-  if(model=="T1tttt" || model=="T5tttt") xsec::signalCrossSection(mglu, xsec, xsec_unc);
-  else xsec::stopCrossSection(mglu, xsec, xsec_unc);
-  double rmax = 20.;
-  if(mglu <= 1500 && mlsp <= 800){
-    rmax = 5.;
-    if(mglu <= 1200 && mlsp <= 550){
-      rmax = 1.25;
-      if(mglu <= 900 && mlsp <= 350){
-	rmax = 0.5;
-      }
+
+  if(points.size() > 1){
+    //Background and data yields are shared by every mass point, so compute them once,
+    //together with all signal yields, letting the thread pool read every chain at once.
+    //Points from merged files share their files and are filled in a single pass
+    set<YieldKey> keys;
+    for(const auto &point: points){
+      WorkspaceGenerator wg(baseline1b, blocks_1bk, backgrounds, point.signal, data);
+      if(inject_other_model) wg.SetInjectionModel(injection);
+      for(const auto &key: wg.YieldKeys()) Append(keys, key);
     }
+    cout<<"Computing "<<keys.size()<<" yields for "<<points.size()<<" mass points"<<endl;
+    YieldManager(lumi).ComputeYields(keys);
   }
-  
-  gSystem->mkdir(outfolder.c_str(), kTRUE);
-  string outname(outfolder+"/wspace_"+model+"_"+glu_lsp+"_xsecNom.root");
-  if(!use_r4) ReplaceAll(outname, "wspace_","wspace_nor4_");
-  if(no_kappa) ReplaceAll(outname, "wspace_","wspace_nokappa_");
-  if(!do_syst) ReplaceAll(outname, "wspace_","wspace_nosyst_");
-
-  WorkspaceGenerator wgNom(*pbaseline, *pblocks, backgrounds, signal, data, sysfile, use_r4, sig_strength, 1.);
-  wgNom.UseGausApprox(!use_pois);
-  wgNom.SetRMax(rmax);
-  wgNom.SetKappaCorrected(!no_kappa);
-  wgNom.SetLuminosity(lumi);
-  wgNom.SetDoSystematics(do_syst);
-  if(inject_other_model){
-    wgNom.SetInjectionModel(injection);
+
+  //The background and data model is built once and reused for every mass point
+  WorkspaceGenerator wg(baseline1b, blocks_1bk, backgrounds, points.front().signal, data,
+                        "", use_r4, sig_strength, 1.);
+  shared_ptr<const SystematicsDatabase> database;
+  if(sys_db != "" && !dummy_syst){
+    database = make_shared<SystematicsDatabase>(sys_db);
+    cout<<"Using systematics of "<<database->NumPoints()<<" mass points from "<<sys_db<<endl;
   }
-  wgNom.AddToys(n_toys);
-  wgNom.WriteToFile(outname);
-
-  if(!nom_only){
-    ReplaceAll(outname, "Nom", "Up");
-    WorkspaceGenerator wgUp(*pbaseline, *pblocks, backgrounds, signal, data, sysfile, use_r4, sig_strength, 1+xsec_unc);
-    wgUp.UseGausApprox(!use_pois);
-    wgUp.SetRMax(rmax);
-    wgUp.SetKappaCorrected(!no_kappa);
-    wgUp.SetLuminosity(lumi);
-    wgUp.SetDoSystematics(do_syst);
-    if(inject_other_model){
-      wgUp.SetInjectionModel(injection);
-    }
-    wgUp.AddToys(n_toys);
-    wgUp.WriteToFile(outname);
-
-    ReplaceAll(outname, "Up", "Down");
-    WorkspaceGenerator wgDown(*pbaseline, *pblocks, backgrounds, signal, data, sysfile, use_r4, sig_strength, 1-xsec_unc);
-    wgDown.UseGausApprox(!use_pois);
-    wgDown.SetRMax(rmax);
-    wgDown.SetKappaCorrected(!no_kappa);
-    wgDown.SetLuminosity(lumi);
-    wgDown.SetDoSystematics(do_syst);
-    if(inject_other_model){
-      wgDown.SetInjectionModel(injection);
-    }
-    wgDown.AddToys(n_toys);
-    wgDown.WriteToFile(outname);
+  for(const auto &point: points){
+    MakeWorkspaces(point, wg, injection, database, hostname);
   }
 
   time(&endtime); 
@@ -433,6 +424,124 @@ int main(int argc, char *argv[]){
 
 
 
+namespace{
+  Process SignalProcess(const string &file){
+    return Process{"signal", {
+        {file+"/tree"}
+      },"stitch", false, true};
+  }
+
+  Process MergedSignalProcess(const vector<string> &files, int mglu, int mlsp){
+    set<string> trees;
+    for(const auto &file: files) Append(trees, file+"/tree");
+    return Process{"signal", trees,
+        "stitch&&mgluino=="+to_string(mglu)+"&&mlsp=="+to_string(mlsp), false, true};
+  }
+
+  void ConfigureGenerator(WorkspaceGenerator &wg, double rmax, const Process &injection){
+    wg.UseGausApprox(!use_pois);
+    wg.UseCompiledFunctions(!formula_nodes);
+    wg.UseBarlowBeestonLite(bb_lite);
+    wg.SetRMax(rmax);
+    wg.SetKappaCorrected(!no_kappa);
+    wg.SetLuminosity(lumi);
+    wg.SetDoSystematics(do_syst);
+    if(inject_other_model){
+      wg.SetInjectionModel(injection);
+    }
+    wg.SetSplitToys(split_toys);
+    if(fixed_toy_seed) wg.SetToySeed(toy_seed);
+    wg.AddToys(n_toys);
+  }
+
+  void MakeWorkspaces(const MassPoint &point,
+                      WorkspaceGenerator &wg,
+                      const Process &injection,
+                      const shared_ptr<const SystematicsDatabase> &database,
+                      const string &hostname){
+    const string &file = point.file;
+    int mglu = point.mglu, mlsp = point.mlsp;
+    string glu_lsp("mGluino-"+to_string(mglu)+"_mLSP-"+to_string(mlsp));
+  
+    //// Creating workspaces for the Nominal, uncert Up, and uncert Down signal cross sections
+    const Process &signal = point.signal;
+    string model = "T1tttt";
+  
+    string sysfolder = "/net/cms2/cms2r0/babymaker/sys/2017_02_22/T1tttt_fakePU/";
+    //Protect default
+    if(binning=="nominal" && lumi < 3) sysfolder = "/net/cms2/cms2r0/babymaker/sys/2016_01_11/scan/";
+  
+    if(Contains(hostname, "lxplus")) sysfolder = "txt/systematics/";
+    if(Contains(file, "T5tttt")) {
+      sysfolder = "/net/cms2/cms2r0/babymaker/sys/2017_02_22/T5tttt_fakePU/";
+      model = "T5tttt";
+    }
+    if(Contains(file, "T2tt")) {
+      sysfolder = "/net/cms2/cms2r0/babymaker/sys/2016_02_09/T2tt/";
+      model = "T2tt";
+    }
+    if(Contains(file, "T6ttWW")) {
+      sysfolder = "/net/cms2/cms2r0/babymaker/sys/2016_02_09/T6ttWW/";
+      model = "T6ttWW";
+    }
+    cout<<"sysfolder is "<<sysfolder<<endl;
+  
+    //  string sysfile(sysfolder+"sys_SMS-"+model+"_"+glu_lsp+"_"+to_string(lumi)+"ifb");
+    string sysfile(sysfolder+"sys_SMS-"+model+"_"+glu_lsp+"_35.9ifb");
+    if(binning!="alternate") sysfile+="_nominal.txt";
+  
+    if(binning=="nominal" && lumi < 3) sysfile = sysfolder+"sys_SMS-"+model+"_"+glu_lsp+".txt";
+    if(dummy_syst) sysfile = dummy_syst_file;
+    bool in_database = database && database->HasPoint(mglu, mlsp);
+    if(in_database) cout<<"systematics are read from "<<sys_db<<endl;
+    else cout<<"sysfile is "<<sysfile<<endl;
+    // If systematic file does not exist, use m1bk_nc for tests
+    struct stat buffer;   
+    if(!in_database && stat (sysfile.c_str(), &buffer) != 0) {
+      cout<<endl<<"WARNING: "<<sysfile<<" does not exist. Using ";
+      sysfile = "txt/systematics/m1bk_nc.txt";
+      cout<<sysfile<<" instead"<<endl<<endl;
+    }
+  
+    // Cross sections
+    float xsec, xsec_unc;
+    if(model=="T1tttt" || model=="T5tttt") xsec::signalCrossSection(mglu, xsec, xsec_unc);
+    else xsec::stopCrossSection(mglu, xsec, xsec_unc);
+    double rmax = 20.;
+    if(mglu <= 1500 && mlsp <= 800){
+      rmax = 5.;
+      if(mglu <= 1200 && mlsp <= 550){
+        rmax = 1.25;
+        if(mglu <= 900 && mlsp <= 350){
+  	rmax = 0.5;
+        }
+      }
+    }
+  
+    string outname(outfolder+"/wspace_"+model+"_"+glu_lsp+"_xsecNom.root");
+    if(!use_r4) ReplaceAll(outname, "wspace_","wspace_nor4_");
+    if(no_kappa) ReplaceAll(outname, "wspace_","wspace_nokappa_");
+    if(!do_syst) ReplaceAll(outname, "wspace_","wspace_nosyst_");
+
+    //Nom/Up/Down only differ in the signal cross section, so the model is built once
+    //and only the signal weights are rescaled for each variant
+    wg.SetSignal(signal).SetSystematicsFile(sysfile).SetSignalXSecFactor(1.);
+    if(in_database) wg.SetSystematicsDatabase(database, mglu, mlsp);
+    ConfigureGenerator(wg, rmax, injection);
+    wg.WriteToFile(outname);
+
+    if(!nom_only){
+      ReplaceAll(outname, "Nom", "Up");
+      wg.SetSignalXSecFactor(1+xsec_unc);
+      wg.WriteToFile(outname);
+
+      ReplaceAll(outname, "Up", "Down");
+      wg.SetSignalXSecFactor(1-xsec_unc);
+      wg.WriteToFile(outname);
+    }
+  }
+}
+
 void GetOptions(int argc, char *argv[]){
   while(true){
     static struct option long_options[] = {
@@ -451,12 +560,21 @@ void GetOptions(int argc, char *argv[]){
       {"useVeto", required_argument, 0, 'v'},
       {"alt_binning", required_argument, 0, 'b'},
       {"toys", required_argument, 0, 0},
+      {"toy_seed", required_argument, 0, 0},
+      {"split_toys", no_argument, 0, 0},
       {"sig_strength", required_argument, 0, 'g'},
       {"dummy_syst", required_argument, 0, 0},
       {"outfolder", required_argument, 0, 'o'},
       {"inject", required_argument, 0, 'i'},
       {"nominal", no_argument, 0, 'n'},
       {"poisson", no_argument, 0, 'p'},
+      {"yield_cache", required_argument, 0, 0},
+      {"sys_db", required_argument, 0, 0},
+      {"formula_nodes", no_argument, 0, 0},
+      {"bb_lite", no_argument, 0, 0},
+      {"skim_dir", required_argument, 0, 0},
+      {"scan", required_argument, 0, 0},
+      {"merged", required_argument, 0, 0},
       {0, 0, 0, 0}
     };
 
@@ -537,9 +655,28 @@ void GetOptions(int argc, char *argv[]){
         do_syst = false;
       }else if(optname == "toys"){
         n_toys = atoi(optarg);
+      }else if(optname == "toy_seed"){
+        toy_seed = stoul(optarg);
+        fixed_toy_seed = true;
+      }else if(optname == "split_toys"){
+        split_toys = true;
       }else if(optname == "dummy_syst"){
 	dummy_syst = true;
 	dummy_syst_file = optarg;
+      }else if(optname == "yield_cache"){
+        yield_cache = optarg;
+      }else if(optname == "sys_db"){
+        sys_db = optarg;
+      }else if(optname == "formula_nodes"){
+        formula_nodes = true;
+      }else if(optname == "bb_lite"){
+        bb_lite = true;
+      }else if(optname == "skim_dir"){
+        skim_dir = optarg;
+      }else if(optname == "scan"){
+        scan = optarg;
+      }else if(optname == "merged"){
+        merged = optarg;
       }else{
         printf("Bad option! Found option name %s\n", optname.c_str());
       }
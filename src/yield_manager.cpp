@@ -2,17 +2,43 @@
 
 #include <iostream>
 #include <sstream>
+#include <fstream>
+#include <iomanip>
+#include <limits>
+#include <future>
+#include <memory>
+#include <utility>
+#include <cmath>
+#include <stdexcept>
+#include <cerrno>
+
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/file.h>
+
+#include "TROOT.h"
 #include <array>
+#include <vector>
+#include <algorithm>
 
 #include "bin.hpp"
 #include "process.hpp"
 #include "cut.hpp"
 #include "utilities.hpp"
+#include "thread_pool.hpp"
+#include "compiled_cuts.hpp"
+#include "skim_file.hpp"
 
 using namespace std;
 
 map<YieldKey, GammaParams> YieldManager::yields_ = map<YieldKey, GammaParams>();
 const double YieldManager::store_lumi_ = 4.;
+string YieldManager::cache_file_ = "";
+map<string, GammaParams> YieldManager::cached_yields_ = map<string, GammaParams>();
+map<string, GammaParams> YieldManager::pending_yields_ = map<string, GammaParams>();
+map<set<string>, string> YieldManager::file_signatures_ = map<set<string>, string>();
+size_t YieldManager::num_threads_ = 0;
+string YieldManager::skim_dir_ = "";
 
 YieldManager::YieldManager(double lumi):
   local_lumi_(lumi),
@@ -20,7 +46,10 @@ YieldManager::YieldManager(double lumi):
 }
 
 GammaParams YieldManager::GetYield(const YieldKey &key) const{
-  if(!HaveYield(key)) ComputeYield(key);
+  if(!HaveYield(key)){
+    ComputeYield(key);
+    WriteCache();
+  }
 
   double factor = local_lumi_/store_lumi_;
   if(GetProcess(key).IsData()) factor = 1.;
@@ -42,14 +71,209 @@ double & YieldManager::Luminosity(){
   return local_lumi_;
 }
 
+const string & YieldManager::SkimDir(){
+  return skim_dir_;
+}
+
+void YieldManager::SkimDir(const string &skim_dir){
+  skim_dir_ = skim_dir;
+}
+
+size_t YieldManager::NumThreads(){
+  return num_threads_;
+}
+
+void YieldManager::NumThreads(size_t num_threads){
+  num_threads_ = num_threads;
+}
+
+const string & YieldManager::CacheFile(){
+  return cache_file_;
+}
+
+void YieldManager::CacheFile(const string &file_name){
+  cache_file_ = file_name;
+  cached_yields_.clear();
+  pending_yields_.clear();
+  if(cache_file_ == "") return;
+  cached_yields_ = ReadCache(cache_file_);
+}
+
 bool YieldManager::HaveYield(const YieldKey &key) const{
   return yields_.find(key) != yields_.end();
 }
 
+void YieldManager::ComputeYields(const set<YieldKey> &keys) const{
+  //Group the missing keys by process so that each chain is only read once
+  map<Process, vector<YieldKey> > keys_by_process;
+  for(const auto &key: keys){
+    if(HaveYield(key) || ReadCachedYield(key)) continue;
+    keys_by_process[GetProcess(key)].push_back(key);
+  }
+  if(keys_by_process.size() == 0) return;
+
+  //Every cascade level and its met_tru variant is filled in the same pass; the nominal
+  //cuts come first so that a skim of the baseline can provide them on their own
+  map<Process, vector<Cut> > cuts_by_process;
+  map<Process, size_t> num_nominal_by_process;
+  map<Process, set<Cut> > baselines_by_process;
+  map<YieldKey, vector<size_t> > cut_indices;
+  for(const auto &proc_keys: keys_by_process){
+    const Process &process = proc_keys.first;
+    bool is_signal = Contains(process.Name(), "sig");
+    vector<Cut> &cuts = cuts_by_process[process];
+    map<Cut, size_t> indices;
+    auto add_cut = [&cuts, &indices](const Cut &cut) -> size_t{
+      auto index = indices.find(cut);
+      if(index != indices.end()) return index->second;
+      indices[cut] = cuts.size();
+      Append(cuts, cut);
+      return cuts.size()-1;
+    };
+    for(size_t level = 0; level < (process.CountZeros() ? 5 : 1); ++level){
+      for(const auto &key: proc_keys.second){
+        Cut cut = GetCuts(key).at(level);
+        vector<size_t> &key_indices = cut_indices[key];
+        Append(key_indices, add_cut(cut));
+        if(is_signal) Append(key_indices, add_cut(MetTruCut(cut)));
+      }
+      if(level == 0) num_nominal_by_process[process] = cuts.size();
+    }
+    for(const auto &key: proc_keys.second){
+      Append(baselines_by_process[process], GetCut(key));
+    }
+  }
+
+  ROOT::EnableThreadSafety();
+  unique_ptr<ThreadPool> pool(num_threads_ > 0 ? new ThreadPool(num_threads_) : new ThreadPool());
+
+  //Processes reading the same files, e.g. the mass points of a merged signal scan, are
+  //filled in one pass in which each event is routed to its point and bin
+  map<set<string>, vector<Process> > processes_by_files;
+  for(const auto &proc_cuts: cuts_by_process){
+    Append(processes_by_files[proc_cuts.first.FileNames()], proc_cuts.first);
+  }
+
+  //Processes whose keys share a baseline can be evaluated from a skim of that baseline
+  map<Process, vector<GammaParams> > gps_by_process;
+  if(skim_dir_ != ""){
+    for(const auto &proc_cuts: cuts_by_process){
+      const Process &process = proc_cuts.first;
+      if(baselines_by_process.at(process).size() != 1
+         || processes_by_files.at(process.FileNames()).size() != 1) continue;
+      try{
+        const vector<Cut> &cuts = proc_cuts.second;
+        vector<Cut> nominal(cuts.cbegin(), cuts.cbegin()+num_nominal_by_process.at(process));
+        gps_by_process[process] = GetSkimmedYields(process, *baselines_by_process.at(process).cbegin(),
+                                                    nominal, *pool);
+      }catch(const runtime_error &e){
+        if(verbose_){
+          cout << "Reading full chain for " << process << ": " << e.what() << endl;
+        }
+      }
+    }
+  }
+
+  //Every file of every file set is an independent task; partial sums are merged below
+  using Sums = pair<vector<double>, vector<double> >;
+  map<set<string>, vector<Cut> > cuts_by_files;
+  map<set<string>, vector<future<Sums> > > partial_sums;
+  vector<pair<const set<string> *, string> > queued_files;
+  for(auto &files_procs: processes_by_files){
+    vector<Process> &processes = files_procs.second;
+    processes.erase(remove_if(processes.begin(), processes.end(), [&gps_by_process](const Process &process){
+          return gps_by_process.find(process) != gps_by_process.end();
+        }), processes.end());
+    if(processes.size() == 0) continue;
+    vector<Cut> &cuts = cuts_by_files[files_procs.first];
+    for(const auto &process: processes){
+      for(const auto &cut: cuts_by_process.at(process)) Append(cuts, cut*process.Cut());
+    }
+    vector<string> chain_files = processes.front().ChainFiles();
+    for(const auto &chain_file: chain_files){
+      Append(queued_files, make_pair(&files_procs.first, chain_file));
+    }
+    if(verbose_){
+      cout << "Computing " << cuts.size() << " yields over " << chain_files.size()
+           << " files for " << processes.size() << " process(es) starting with "
+           << processes.front() << endl;
+    }
+  }
+
+  //Each task reads a single file, so while it runs it asks the kernel to start reading the
+  //file that will be picked up once every thread has moved on
+  vector<string> prefetch_files;
+  for(const auto &queued: queued_files){
+    const string &chain_file = queued.second;
+    Append(prefetch_files, chain_file.substr(0, chain_file.rfind('/')));
+  }
+  for(size_t ifile = 0; ifile < queued_files.size(); ++ifile){
+    const set<string> &files = *queued_files.at(ifile).first;
+    const vector<Cut> &cuts = cuts_by_files.at(files);
+    string chain_file = queued_files.at(ifile).second;
+    size_t iprefetch = ifile+pool->Size();
+    string prefetch_file = iprefetch < prefetch_files.size() ? prefetch_files.at(iprefetch) : "";
+    partial_sums[files].push_back(pool->Push([&cuts, chain_file, prefetch_file]() -> Sums{
+          if(prefetch_file != "") PrefetchFile(prefetch_file);
+          Sums sums;
+          ::GetSumsOfWeights(chain_file, cuts, sums.first, sums.second);
+          return sums;
+        }));
+  }
+
+  for(auto &files_futures: partial_sums){
+    size_t num_cuts = cuts_by_files.at(files_futures.first).size();
+    vector<double> sumw(num_cuts, 0.), sumw2(num_cuts, 0.);
+    for(auto &partial: files_futures.second){
+      Sums sums = partial.get();
+      for(size_t icut = 0; icut < num_cuts; ++icut){
+        sumw.at(icut) += sums.first.at(icut);
+        sumw2.at(icut) += sums.second.at(icut);
+      }
+    }
+    size_t offset = 0;
+    for(const auto &process: processes_by_files.at(files_futures.first)){
+      vector<GammaParams> &gps = gps_by_process[process];
+      gps.resize(cuts_by_process.at(process).size());
+      for(size_t icut = 0; icut < gps.size(); ++icut, ++offset){
+        gps.at(icut).SetYieldAndUncertainty(sumw.at(offset), sqrt(sumw2.at(offset)));
+      }
+    }
+  }
+
+  for(auto &proc_keys: keys_by_process){
+    const Process &process = proc_keys.first;
+    bool is_signal = Contains(process.Name(), "sig");
+    const vector<GammaParams> &gps = gps_by_process.at(process);
+
+    for(const auto &key: proc_keys.second){
+      const vector<size_t> &indices = cut_indices.at(key);
+      size_t num_variants = is_signal ? 2 : 1;
+      vector<GammaParams> levels;
+      for(size_t index = 0; index+num_variants <= indices.size(); index += num_variants){
+        if(indices.at(index+num_variants-1) >= gps.size()) break;
+        GammaParams this_gps = gps.at(indices.at(index));
+        if(is_signal) this_gps = AverageMet(this_gps, gps.at(indices.at(index+1)));
+        Append(levels, this_gps);
+      }
+      if(levels.at(0).Weight() <= 0. && levels.size()*num_variants < indices.size()){
+        //The looser cuts were not available (e.g. from a skim), so go back to the chain
+        ComputeYield(key);
+        continue;
+      }
+      GammaParams this_gps = CascadeYield(levels, process.CountZeros());
+      if(verbose_){
+        cout << "Found yield=" << this_gps << " for " << key << '\n' << endl;
+      }
+      StoreYield(key, this_gps);
+    }
+  }
+  WriteCache();
+}
+
 void YieldManager::ComputeYield(const YieldKey &key) const{
   const Bin &bin = GetBin(key);
   const Process &process = GetProcess(key);
-  const Cut &cut = GetCut(key);
 
   GammaParams gps;
 
@@ -58,6 +282,11 @@ void YieldManager::ComputeYield(const YieldKey &key) const{
       cout << "Using known yield for " << key << endl;
     }
     gps = GetYield(key);
+  }else if(ReadCachedYield(key)){
+    if(verbose_){
+      cout << "Using cached yield for " << key << endl;
+    }
+    return;
   }else if(process.GetEntries() == 0){
     if(verbose_){
       cout << "No entries found for " << key << endl;
@@ -67,51 +296,285 @@ void YieldManager::ComputeYield(const YieldKey &key) const{
     if(verbose_){
       cout << "Computing yield for " << key << endl;
     }
-    ostringstream oss;
-    oss << local_lumi_ << flush;
-    Cut lumi_weight = process.IsData() ? Cut() : 
-      (Contains(process.Name(), "sig")?Cut(oss.str()+"*weight*eff_trig"):Cut(oss.str()+"*weight*eff_trig"));
-
-    array<Cut, 5> cuts;
-    cuts.at(0) = lumi_weight*(cut && bin.Cut() && process.Cut());
-    cuts.at(1) = lumi_weight*(cut && process.Cut());
-    cuts.at(2) = lumi_weight*(process.Cut());
-    cuts.at(3) = lumi_weight;
-    cuts.at(4) = Cut();
-
-    for(size_t icut = 0; icut < cuts.size() && gps.Weight()<=0.; ++icut){
-      if(icut > 0 && !process.CountZeros()){
-        gps.SetNEffectiveAndWeight(0., 0.);
-        break;
-      }
-      Cut &this_cut = cuts.at(icut);
+    array<Cut, 5> cuts = GetCuts(key);
+    bool is_signal = Contains(process.Name(), "sig");
+    vector<Cut> level_cuts;
+    for(size_t level = 0; level < (process.CountZeros() ? cuts.size() : 1); ++level){
       if(verbose_){
-        cout << "Trying cut " << this_cut << endl;
+        cout << "Trying cut " << cuts.at(level) << endl;
       }
-      GammaParams temp_gps = process.GetYield(this_cut);
-      //// Averaging signal yields cutting on met and met_tru, as prescripted by SUSY group
-      //// https://twiki.cern.ch/twiki/bin/viewauth/CMS/SUSRecommendationsICHEP16#Special_treatment_of_MET_uncerta
-      if(Contains(process.Name(), "sig")){
-	string mettru_s = this_cut.GetCut(); 
-	ReplaceAll(mettru_s, "met_calo", "XXXYYYZZZ_calo");
-	ReplaceAll(mettru_s, "met", "met_tru");
-	ReplaceAll(mettru_s, "XXXYYYZZZ_calo", "met_calo");
-	Cut mettru_cut(mettru_s); 
-	GammaParams mettru_gps = process.GetYield(mettru_cut);
-	if(verbose_) cout<<"Yields: met "<<temp_gps.Yield()<<", met_tru "<<mettru_gps.Yield();
-	temp_gps.SetYieldAndUncertainty(0.5*(temp_gps.Yield()+mettru_gps.Yield()),
-					max(temp_gps.Uncertainty(), mettru_gps.Uncertainty()));
-	if(verbose_) cout<<", average "<<temp_gps.Yield()<<" for bin "<<bin.Name()<<endl;
+      Append(level_cuts, cuts.at(level));
+      if(is_signal) Append(level_cuts, MetTruCut(cuts.at(level)));
+    }
+    vector<GammaParams> yields = process.GetYields(level_cuts);
+    vector<GammaParams> levels;
+    for(size_t icut = 0; icut < yields.size(); icut += is_signal ? 2 : 1){
+      GammaParams temp_gps = yields.at(icut);
+      if(is_signal){
+        GammaParams mettru_gps = yields.at(icut+1);
+        if(verbose_) cout<<"Yields: met "<<temp_gps.Yield()<<", met_tru "<<mettru_gps.Yield();
+        temp_gps = AverageMet(temp_gps, mettru_gps);
+        if(verbose_) cout<<", average "<<temp_gps.Yield()<<" for bin "<<bin.Name()<<endl;
       } // If it is signal
-      if(icut == 0) gps = temp_gps;
-      else gps.SetNEffectiveAndWeight(0., temp_gps.Weight());
+      Append(levels, temp_gps);
     }
+    gps = CascadeYield(levels, process.CountZeros());
   }
 
   if(verbose_){
     cout << "Found yield=" << gps << '\n' << endl;
   }
+  StoreYield(key, gps);
+}
+
+void YieldManager::StoreYield(const YieldKey &key, const GammaParams &gps) const{
   double factor = store_lumi_/local_lumi_;
-  if(process.IsData()) factor = 1.;
+  if(GetProcess(key).IsData()) factor = 1.;
   yields_[key] = factor*gps;
+
+  if(cache_file_ == "") return;
+  string hash = CacheHash(key);
+  if(cached_yields_.find(hash) != cached_yields_.end()) return;
+  cached_yields_[hash] = yields_.at(key);
+
+  pending_yields_[hash] = yields_.at(key);
+}
+
+map<string, GammaParams> YieldManager::ReadCache(const string &file_name){
+  //The cache is only ever replaced whole, but a record that is short or fails its
+  //checksum is still treated as a miss rather than an error
+  map<string, GammaParams> records;
+  ifstream file(file_name);
+  string line;
+  size_t num_bad = 0;
+  while(getline(file, line)){
+    string hash;
+    GammaParams gps;
+    if(ParseCacheRecord(line, hash, gps)){
+      records[hash] = gps;
+    }else{
+      ++num_bad;
+    }
+  }
+  if(num_bad > 0){
+    cerr << "Skipped " << num_bad << " corrupted records in yield cache " << file_name << endl;
+  }
+  return records;
+}
+
+void YieldManager::WriteCache(){
+  if(cache_file_ == "" || pending_yields_.size() == 0) return;
+  //Jobs sharing the cache take turns through a lock file. Each merges its new yields
+  //into the current cache, writes the result to a temporary file and renames it into
+  //place, so a reader sees either the old or the new cache and never a partial one.
+  //A cache that cannot be updated only costs recomputing the yields next time
+  string lock_name = cache_file_+".lock";
+  int lock_fd = open(lock_name.c_str(), O_RDWR | O_CREAT, 0644);
+  if(lock_fd < 0 || flock(lock_fd, LOCK_EX) != 0){
+    if(lock_fd >= 0) close(lock_fd);
+    cerr << "Could not lock yield cache " << cache_file_ << "; new yields not stored" << endl;
+    pending_yields_.clear();
+    return;
+  }
+
+  map<string, GammaParams> records = ReadCache(cache_file_);
+  for(const auto &record: records) cached_yields_.insert(record);
+  for(const auto &pending: pending_yields_) records[pending.first] = pending.second;
+  string contents;
+  for(const auto &record: records) contents += CacheRecord(record.first, record.second);
+
+  char host[256] = "";
+  gethostname(host, sizeof(host)-1);
+  string temp_name = cache_file_+".tmp."+string(host)+"."+to_string(getpid());
+  bool written = false;
+  int fd = open(temp_name.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  if(fd >= 0){
+    const char *data = contents.data();
+    size_t size = contents.size();
+    while(size > 0){
+      ssize_t num = write(fd, data, size);
+      if(num < 0 && errno == EINTR) continue;
+      if(num <= 0) break;
+      data += num;
+      size -= num;
+    }
+    written = size == 0 && fsync(fd) == 0;
+    written = close(fd) == 0 && written;
+  }
+  if(!written || rename(temp_name.c_str(), cache_file_.c_str()) != 0){
+    unlink(temp_name.c_str());
+    cerr << "Could not update yield cache " << cache_file_ << "; new yields not stored" << endl;
+  }
+  pending_yields_.clear();
+  flock(lock_fd, LOCK_UN);
+  close(lock_fd);
+}
+
+string YieldManager::CacheRecord(const string &hash, const GammaParams &gps){
+  //Each record ends with the hash of the rest of its line and a terminator
+  ostringstream oss;
+  oss << hash << ' ' << setprecision(numeric_limits<double>::max_digits10)
+      << gps.NEffective() << ' ' << gps.Weight();
+  string body = oss.str();
+  return body+' '+HashString(body)+" ;\n";
+}
+
+bool YieldManager::ParseCacheRecord(const string &line, string &hash, GammaParams &gps){
+  auto pos = line.rfind(' ', line.size() >= 2 ? line.size()-3 : 0);
+  if(line.size() < 2 || line.substr(line.size()-2) != " ;" || pos == string::npos) return false;
+  string body = line.substr(0, pos);
+  if(HashString(body) != line.substr(pos+1, line.size()-2-(pos+1))) return false;
+  istringstream iss(body);
+  double n_effective, weight;
+  string extra;
+  if(!(iss >> hash >> n_effective >> weight) || (iss >> extra)) return false;
+  gps = GammaParams(n_effective, weight);
+  return true;
+}
+
+bool YieldManager::ReadCachedYield(const YieldKey &key) const{
+  if(cache_file_ == "") return false;
+  auto cached = cached_yields_.find(CacheHash(key));
+  if(cached == cached_yields_.end()) return false;
+  yields_[key] = cached->second;
+  return true;
+}
+
+vector<GammaParams> YieldManager::GetSkimmedYields(const Process &process,
+                                                   const Cut &baseline,
+                                                   const vector<Cut> &cuts,
+                                                   ThreadPool &pool) const{
+  vector<Cut> process_cuts;
+  for(const auto &cut: cuts) process_cuts.push_back(cut*process.Cut());
+  CompiledCuts compiled(process_cuts);
+  vector<string> columns(compiled.Variables());
+  sort(columns.begin(), columns.end());
+
+  ostringstream oss;
+  oss << FilesSignature(process)
+      << "|process=" << process.Cut()
+      << "|baseline=" << baseline
+      << "|columns=";
+  for(const auto &column: columns) oss << column << ",";
+  oss << flush;
+  string file_name = skim_dir_+"/skim_"+HashString(oss.str())+".bin";
+
+  if(!ifstream(file_name).good()){
+    if(verbose_){
+      cout << "Writing skim " << file_name << " for " << process << endl;
+    }
+    vector<future<vector<vector<double> > > > futures;
+    for(const auto &chain_file: process.ChainFiles()){
+      futures.push_back(pool.Push([&process, &baseline, &columns, chain_file]() -> vector<vector<double> >{
+            vector<vector<double> > file_columns;
+            process.GetColumns(chain_file, baseline, columns, file_columns);
+            return file_columns;
+          }));
+    }
+    //Wait for every file before get() can throw, since the tasks reference local variables
+    for(auto &partial: futures) partial.wait();
+    vector<vector<double> > skim_columns(columns.size());
+    for(auto &partial: futures){
+      vector<vector<double> > file_columns = partial.get();
+      for(size_t icol = 0; icol < columns.size(); ++icol){
+        skim_columns.at(icol).insert(skim_columns.at(icol).end(),
+                                     file_columns.at(icol).cbegin(), file_columns.at(icol).cend());
+      }
+    }
+    SkimFile::Write(file_name, columns, skim_columns);
+  }
+
+  SkimFile skim(file_name);
+  vector<const double *> bound;
+  for(const auto &variable: compiled.Variables()){
+    bound.push_back(skim.Column(variable));
+  }
+  vector<double> sumw, sumw2;
+  compiled.AddSums(bound, skim.NumEntries(), sumw, sumw2);
+  vector<GammaParams> gps(cuts.size());
+  for(size_t icut = 0; icut < cuts.size(); ++icut){
+    gps.at(icut).SetYieldAndUncertainty(sumw.at(icut), sqrt(sumw2.at(icut)));
+  }
+  return gps;
+}
+
+const string & YieldManager::FilesSignature(const Process &process) const{
+  auto signature = file_signatures_.find(process.FileNames());
+  if(signature == file_signatures_.end()){
+    string files;
+    for(const auto &file_name: process.FileNames()){
+      files += file_name+"=>"+FileSignature(file_name)+"|";
+    }
+    signature = file_signatures_.insert(make_pair(process.FileNames(), files)).first;
+  }
+  return signature->second;
+}
+
+string YieldManager::CacheHash(const YieldKey &key) const{
+  //Stored yields are normalized to store_lumi_, so the luminosity is left out of the hash
+  const Process &process = GetProcess(key);
+  ostringstream oss;
+  oss << FilesSignature(process)
+      << "|process=" << process.Cut()
+      << "|bin=" << GetBin(key).Cut()
+      << "|baseline=" << GetCut(key)
+      << "|weight=" << WeightExpression(process)
+      << "|count_zeros=" << process.CountZeros()
+      << "|met_average=" << Contains(process.Name(), "sig")
+      << flush;
+  return HashString(oss.str());
+}
+
+array<Cut, 5> YieldManager::GetCuts(const YieldKey &key) const{
+  const Bin &bin = GetBin(key);
+  const Process &process = GetProcess(key);
+  const Cut &cut = GetCut(key);
+
+  ostringstream oss;
+  oss << local_lumi_ << flush;
+  Cut lumi_weight = process.IsData() ? Cut() : Cut(oss.str()+"*"+WeightExpression(process));
+
+  array<Cut, 5> cuts;
+  cuts.at(0) = lumi_weight*(cut && bin.Cut() && process.Cut());
+  cuts.at(1) = lumi_weight*(cut && process.Cut());
+  cuts.at(2) = lumi_weight*(process.Cut());
+  cuts.at(3) = lumi_weight;
+  cuts.at(4) = Cut();
+  return cuts;
+}
+
+string YieldManager::WeightExpression(const Process &process){
+  return process.IsData() ? "1" : "weight*eff_trig";
+}
+
+Cut YieldManager::MetTruCut(const Cut &cut){
+  string mettru_s = static_cast<string>(cut);
+  ReplaceAll(mettru_s, "met_calo", "XXXYYYZZZ_calo");
+  ReplaceAll(mettru_s, "met", "met_tru");
+  ReplaceAll(mettru_s, "XXXYYYZZZ_calo", "met_calo");
+  return Cut(mettru_s);
+}
+
+GammaParams YieldManager::CascadeYield(const vector<GammaParams> &levels, bool count_zeros){
+  //Empty bins keep zero events but take the weight of the first looser cut that has any
+  GammaParams gps = levels.at(0);
+  if(gps.Weight() > 0.) return gps;
+  if(!count_zeros){
+    gps.SetNEffectiveAndWeight(0., 0.);
+    return gps;
+  }
+  for(size_t level = 1; level < levels.size(); ++level){
+    gps.SetNEffectiveAndWeight(0., levels.at(level).Weight());
+    if(gps.Weight() > 0.) break;
+  }
+  return gps;
+}
+
+GammaParams YieldManager::AverageMet(const GammaParams &met_gps, const GammaParams &mettru_gps){
+  //// Averaging signal yields cutting on met and met_tru, as prescripted by SUSY group
+  //// https://twiki.cern.ch/twiki/bin/viewauth/CMS/SUSRecommendationsICHEP16#Special_treatment_of_MET_uncerta
+  GammaParams gps;
+  gps.SetYieldAndUncertainty(0.5*(met_gps.Yield()+mettru_gps.Yield()),
+                             max(met_gps.Uncertainty(), mettru_gps.Uncertainty()));
+  return gps;
 }